@@ -0,0 +1,124 @@
+﻿//-------------------------------------------------------------------------------------------------
+// File : s3d_accel.h
+// Desc : Acceleration Structure Module.
+// Copyright(c) Project Asura. All right reserved.
+//-------------------------------------------------------------------------------------------------
+#pragma once
+
+//-------------------------------------------------------------------------------------------------
+// Includes
+//-------------------------------------------------------------------------------------------------
+#include <s3d_typedef.h>
+
+
+namespace s3d {
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// TRAVERSAL_ORDER
+///////////////////////////////////////////////////////////////////////////////////////////////////
+enum TRAVERSAL_ORDER
+{
+    TRAVERSAL_ORDER_INDEX,          //!< 子ノード番号順(距離による枝刈りなし).
+    TRAVERSAL_ORDER_NEAREST,        //!< 近い子ノードから順に走査し，最近接交差より遠いものは枝刈り.
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// ACCEL_LEVEL
+///////////////////////////////////////////////////////////////////////////////////////////////////
+enum ACCEL_LEVEL
+{
+    ACCEL_LEVEL_BOTTOM,             //!< メッシュ単位の加速構造(BLAS).
+    ACCEL_LEVEL_TOP,                //!< シーン単位の加速構造(TLAS).
+    ACCEL_LEVEL_COUNT,
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// BUILD_MODE
+///////////////////////////////////////////////////////////////////////////////////////////////////
+enum BUILD_MODE
+{
+    BUILD_MODE_OBJECT,              //!< 形状単位で分割(通常のSAH).
+    BUILD_MODE_SPATIAL,             //!< 空間分割で形状の参照を複製することを許可(SBVH).
+    BUILD_MODE_LINEAR,              //!< モートン符号順に並べて高速に構築(LBVH).
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// BuildConfig structure
+///////////////////////////////////////////////////////////////////////////////////////////////////
+struct BuildConfig
+{
+    s32     bucketCount;        //!< SAH分割の1軸あたりのバケット数です(2～32).
+    f32     costTraversal;      //!< ノード走査のSAHコストです.
+    f32     costIntersect;      //!< 形状判定のSAHコストです.
+    f32     spatialAlpha;       //!< 空間分割を試す子ノードの重なり面積の閾値です(ルートの表面積に対する比).
+    f32     spatialBudget;      //!< 空間分割で複製を許可する参照数です(形状数に対する比).
+    s32     treeletIterations;  //!< 構築後に木を組み替えて最適化する反復回数です(0で無効).
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Accel class
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class Accel
+{
+public:
+    //---------------------------------------------------------------------------------------------
+    //! @brief      子ノードの走査順を設定します.
+    //---------------------------------------------------------------------------------------------
+    static void SetTraversalOrder( TRAVERSAL_ORDER order );
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      子ノードの走査順を取得します.
+    //---------------------------------------------------------------------------------------------
+    static TRAVERSAL_ORDER GetTraversalOrder();
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      構築設定を設定します.
+    //---------------------------------------------------------------------------------------------
+    static void SetBuildConfig( const BuildConfig& config );
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      構築設定を取得します.
+    //---------------------------------------------------------------------------------------------
+    static const BuildConfig& GetBuildConfig();
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      構築時間の集計をリセットします.
+    //---------------------------------------------------------------------------------------------
+    static void ResetBuildTime();
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      構築時間を加算します.
+    //---------------------------------------------------------------------------------------------
+    static void AddBuildTime( ACCEL_LEVEL level, f64 msec );
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      構築時間の合計をミリ秒単位で取得します.
+    //---------------------------------------------------------------------------------------------
+    static f64 GetBuildTime( ACCEL_LEVEL level );
+
+private:
+    static TRAVERSAL_ORDER  s_TraversalOrder;                   //!< 子ノードの走査順です.
+    static BuildConfig      s_BuildConfig;                      //!< 構築設定です.
+    static f64              s_BuildTime[ACCEL_LEVEL_COUNT];     //!< 構築時間の合計です.
+};
+
+//-------------------------------------------------------------------------------------------------
+//! @brief      子ノード番号を距離の昇順に並び替えます.
+//-------------------------------------------------------------------------------------------------
+S3D_INLINE
+void SortByDistance( u32 count, u32* pIndices, const f32* pDistances )
+{
+    for( u32 i=1; i<count; ++i )
+    {
+        auto index = pIndices[i];
+        auto dist  = pDistances[index];
+
+        auto j = i;
+        for( ; j > 0 && pDistances[pIndices[j - 1]] > dist; --j )
+        { pIndices[j] = pIndices[j - 1]; }
+
+        pIndices[j] = index;
+    }
+}
+
+} // namespace s3d
@@ -0,0 +1,113 @@
+﻿//-------------------------------------------------------------------------------------------------
+// File : s3d_arena.h
+// Desc : Arena Allocator Module.
+// Copyright(c) Project Asura. All right reserved.
+//-------------------------------------------------------------------------------------------------
+#pragma once
+
+//-------------------------------------------------------------------------------------------------
+// Includes
+//-------------------------------------------------------------------------------------------------
+#include <s3d_typedef.h>
+#include <vector>
+
+
+namespace s3d {
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Arena class
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class Arena
+{
+public:
+    //---------------------------------------------------------------------------------------------
+    //! @brief      コンストラクタです.
+    //!
+    //! @param [in]     chunkSize   一度に確保するメモリのサイズ.
+    //---------------------------------------------------------------------------------------------
+    explicit Arena( size_t chunkSize = 1024 * 1024 );
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      デストラクタです.
+    //---------------------------------------------------------------------------------------------
+    ~Arena();
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      メモリを確保します.
+    //!
+    //! @param [in]     size        確保するサイズ.
+    //! @param [in]     alignment   アライメント(2の累乗).
+    //! @return     確保したメモリを返却します. 確保に失敗した場合は nullptr を返却します.
+    //! @note       スレッドセーフではありません. 個別の解放はできません.
+    //---------------------------------------------------------------------------------------------
+    void* Alloc( size_t size, size_t alignment );
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      配列を確保します.
+    //!
+    //! @note       コンストラクタは呼び出されません.
+    //---------------------------------------------------------------------------------------------
+    template<typename T>
+    T* Alloc( size_t count )
+    { return static_cast<T*>( Alloc( sizeof(T) * count, alignof(T) ) ); }
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      続けて確保するメモリが1つのチャンクに収まるように予約します.
+    //!
+    //! @param [in]     size        予約するサイズ(アライメントによる隙間を含む).
+    //! @retval true    予約しました.
+    //! @retval false   メモリ不足です.
+    //---------------------------------------------------------------------------------------------
+    bool Reserve( size_t size );
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      確保したメモリを全て無効にして先頭から使い直します.
+    //!
+    //! @note       複数のチャンクに分かれていた場合は1つにまとめ直すので，
+    //!             次回以降の同じサイズの確保は連続したメモリから行われます.
+    //---------------------------------------------------------------------------------------------
+    void Reset();
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      全てのメモリを解放します.
+    //---------------------------------------------------------------------------------------------
+    void Term();
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      確保済みのサイズを取得します.
+    //---------------------------------------------------------------------------------------------
+    size_t GetUsedSize() const;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    // Chunk structure
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    struct Chunk
+    {
+        u8*     pBuffer;    //!< バッファです.
+        size_t  size;       //!< バッファのサイズです.
+    };
+
+    //=============================================================================================
+    // private variables.
+    //=============================================================================================
+    std::vector<Chunk>  m_Chunks;       //!< チャンクです.
+    size_t              m_ChunkSize;    //!< 一度に確保するサイズです.
+    size_t              m_Current;      //!< 使用中のチャンク番号です.
+    size_t              m_Offset;       //!< 使用中のチャンク内のオフセットです.
+    size_t              m_UsedSize;     //!< 確保済みのサイズです.
+
+    //=============================================================================================
+    // private methods.
+    //=============================================================================================
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      チャンクを追加します.
+    //---------------------------------------------------------------------------------------------
+    bool AddChunk( size_t size );
+
+    Arena           ( const Arena& ) = delete;      // アクセス禁止.
+    void operator = ( const Arena& ) = delete;      // アクセス禁止.
+};
+
+} // namespace s3d
@@ -10,6 +10,7 @@
 //-------------------------------------------------------------------------------------------------
 #include <s3d_math.h>
 #include <s3d_shape.h>
+#include <s3d_bvhbuilder.h>
 #include <atomic>
 
 
@@ -60,6 +61,11 @@ public:
     //---------------------------------------------------------------------------------------------
     bool IsHit(const RaySet& raySet, HitRecord& record ) const override;
 
+    //---------------------------------------------------------------------------------------------
+    //! @brief      遮蔽判定を行います.
+    //---------------------------------------------------------------------------------------------
+    bool IsOccluded(const RaySet& raySet, f32 distance) const override;
+
     //---------------------------------------------------------------------------------------------
     //! @brief      バウンディングボックスを取得します.
     //---------------------------------------------------------------------------------------------
@@ -91,6 +97,11 @@ private:
     //! @brief      デストラクタです.
     //---------------------------------------------------------------------------------------------
     ~BVH2();
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      指定範囲の形状から生成処理を行います.
+    //---------------------------------------------------------------------------------------------
+    static IShape* Create( BVHBuilder& builder, size_t offset, size_t count );
 };
 
 } // namespace s3d
@@ -10,6 +10,7 @@
 //-------------------------------------------------------------------------------------------------
 #include <s3d_math.h>
 #include <s3d_shape.h>
+#include <s3d_bvhbuilder.h>
 #include <atomic>
 
 
@@ -60,6 +61,11 @@ public:
     //---------------------------------------------------------------------------------------------
     bool IsHit(const RaySet& raySet, HitRecord& record ) const override;
 
+    //---------------------------------------------------------------------------------------------
+    //! @brief      遮蔽判定を行います.
+    //---------------------------------------------------------------------------------------------
+    bool IsOccluded(const RaySet& raySet, f32 distance) const override;
+
     //---------------------------------------------------------------------------------------------
     //! @brief      バウンディングボックスを取得します.
     //---------------------------------------------------------------------------------------------
@@ -99,17 +105,22 @@ private:
     //---------------------------------------------------------------------------------------------
     //! @brief      SAH分割します.
     //---------------------------------------------------------------------------------------------
-    static bool SplitSAH( size_t count, IShape** ppShapes, size_t& mid );
+    static bool SplitSAH( BVHBuilder& builder, size_t offset, size_t count, size_t& mid );
 
     //---------------------------------------------------------------------------------------------
     //! @brief      中間分割します.
     //---------------------------------------------------------------------------------------------
-    static bool SplitMid( size_t count, IShape** ppShapes, size_t& mid );
+    static bool SplitMid( BVHBuilder& builder, size_t offset, size_t count, size_t& mid );
 
     //---------------------------------------------------------------------------------------------
     //! @brief      分割します.
     //---------------------------------------------------------------------------------------------
-    static bool Split( size_t count, IShape** ppShapes, size_t& mid );
+    static bool Split( BVHBuilder& builder, size_t offset, size_t count, size_t& mid );
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      指定範囲の形状から生成処理を行います.
+    //---------------------------------------------------------------------------------------------
+    static IShape* Create( BVHBuilder& builder, size_t offset, size_t count );
 
     //---------------------------------------------------------------------------------------------
     //! @brief      new 演算子のオーバーロードです.
@@ -0,0 +1,291 @@
+﻿//-------------------------------------------------------------------------------------------------
+// File : s3d_bvhbuilder.h
+// Desc : BVH Builder Module.
+// Copyright(c) Project Asura. All right reserved.
+//-------------------------------------------------------------------------------------------------
+#pragma once
+
+//-------------------------------------------------------------------------------------------------
+// Includes
+//-------------------------------------------------------------------------------------------------
+#include <s3d_math.h>
+#include <s3d_shape.h>
+#include <s3d_accel.h>
+#include <atomic>
+#include <vector>
+
+
+namespace s3d {
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// BuildNode structure
+///////////////////////////////////////////////////////////////////////////////////////////////////
+struct BuildNode
+{
+    BoundingBox     box;            //!< バウンディングボックスです.
+    s32             child[2];       //!< 子ノード番号です(葉ノードの場合は-1).
+    u32             offset;         //!< 形状のオフセットです(木構造の最適化後の内部ノードでは無効).
+    u32             count;          //!< 形状数です.
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// BVHBuilder class
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class BVHBuilder
+{
+public:
+    //---------------------------------------------------------------------------------------------
+    //! @brief      部分木の構築を並列化するかどうかを判定します.
+    //!
+    //! @param [in]     count       部分木に含まれる形状数.
+    //! @retval true    別タスクで構築します.
+    //! @retval false   呼び出し元のスレッドで構築します.
+    //---------------------------------------------------------------------------------------------
+    static bool IsParallel( size_t count );
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      コンストラクタです.
+    //!
+    //! @param [in]     count       形状数.
+    //! @param [in]     ppShapes    形状配列. 分割時に並び替えられます.
+    //! @note       各形状のバウンディングボックスと中心座標をここで一度だけ取得します.
+    //---------------------------------------------------------------------------------------------
+    BVHBuilder( size_t count, IShape** ppShapes );
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      形状配列を取得します.
+    //---------------------------------------------------------------------------------------------
+    IShape** GetShapes( size_t offset ) const;
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      指定範囲の形状をマージしたバウンディングボックスを取得します.
+    //---------------------------------------------------------------------------------------------
+    BoundingBox GetBox( size_t offset, size_t count ) const;
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      3軸すべてのビンを評価してSAH分割します.
+    //!
+    //! @param [in]     offset      範囲の先頭位置.
+    //! @param [in]     count       範囲の形状数.
+    //! @param [in]     leafCount   葉ノードとする最大形状数.
+    //! @param [out]    mid         範囲の先頭からの分割位置.
+    //! @retval true    分割しました.
+    //! @retval false   葉ノードとすべきため分割しませんでした.
+    //---------------------------------------------------------------------------------------------
+    bool SplitSAH( size_t offset, size_t count, size_t leafCount, size_t& mid );
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      中間分割します.
+    //---------------------------------------------------------------------------------------------
+    bool SplitMid( size_t offset, size_t count, size_t& mid );
+
+private:
+    //=============================================================================================
+    // private variables.
+    //=============================================================================================
+    IShape**            m_ppShapes;     //!< 形状配列です.
+    BuildConfig         m_Config;       //!< 構築設定です.
+    std::vector<f32>    m_Mini  [3];    //!< 形状毎のバウンディングボックスの最小値です.
+    std::vector<f32>    m_Maxi  [3];    //!< 形状毎のバウンディングボックスの最大値です.
+    std::vector<f32>    m_Center[3];    //!< 形状毎の中心座標です.
+
+    //=============================================================================================
+    // private methods.
+    //=============================================================================================
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      指定範囲のバウンディングボックスと中心座標のバウンディングボックスを求めます.
+    //---------------------------------------------------------------------------------------------
+    void CalcBounds( size_t offset, size_t count, BoundingBox& bound, BoundingBox& centroid ) const;
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      形状とキャッシュした値を入れ替えます.
+    //---------------------------------------------------------------------------------------------
+    void Swap( size_t a, size_t b );
+
+    BVHBuilder      ( const BVHBuilder& ) = delete;     // アクセス禁止.
+    void operator = ( const BVHBuilder& ) = delete;     // アクセス禁止.
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// SpatialBuilder class
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class SpatialBuilder
+{
+public:
+    //---------------------------------------------------------------------------------------------
+    //! @brief      コンストラクタです.
+    //!
+    //! @param [in]     count       形状数.
+    //! @param [in]     ppShapes    形状配列.
+    //---------------------------------------------------------------------------------------------
+    SpatialBuilder( size_t count, IShape** ppShapes );
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      空間分割を併用して二分木を構築します.
+    //!
+    //! @param [in]     leafSize    葉ノードに格納する最大参照数.
+    //! @param [out]    nodes       構築したノード.
+    //! @return     ルートノードの番号を返却します.
+    //---------------------------------------------------------------------------------------------
+    s32 Build( size_t leafSize, std::vector<BuildNode>& nodes );
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      葉ノードの順に並べた参照先の形状を取得します.
+    //---------------------------------------------------------------------------------------------
+    const std::vector<IShape*>& GetShapes() const;
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      葉ノードの順に並べた参照のバウンディングボックスを取得します.
+    //---------------------------------------------------------------------------------------------
+    const std::vector<BoundingBox>& GetBoxes() const;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    // Reference structure
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    struct Reference
+    {
+        IShape*         pShape;     //!< 参照先の形状です.
+        BoundingBox     box;        //!< 分割平面で切り取られたバウンディングボックスです.
+    };
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    // Split structure
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    struct Split;
+
+    //=============================================================================================
+    // private variables.
+    //=============================================================================================
+    BuildConfig                 m_Config;       //!< 構築設定です.
+    std::vector<Reference>      m_Input;        //!< 入力形状の参照です.
+    std::vector<IShape*>        m_Shapes;       //!< 葉ノードの順に並べた参照先の形状です.
+    std::vector<BoundingBox>    m_Boxes;        //!< 葉ノードの順に並べた参照のバウンディングボックスです.
+    size_t                      m_Budget;       //!< 残りの複製可能な参照数です.
+    f32                         m_RootArea;     //!< ルートノードの表面積です.
+
+    //=============================================================================================
+    // private methods.
+    //=============================================================================================
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      ノードを再帰的に構築します.
+    //---------------------------------------------------------------------------------------------
+    s32 BuildRecursive( std::vector<Reference>& refs, const BoundingBox& box, size_t leafSize, std::vector<BuildNode>& nodes );
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      形状単位の分割を探索します.
+    //---------------------------------------------------------------------------------------------
+    bool FindObjectSplit( const std::vector<Reference>& refs, const BoundingBox& box, Split& result ) const;
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      空間分割を探索します.
+    //---------------------------------------------------------------------------------------------
+    bool FindSpatialSplit( const std::vector<Reference>& refs, const BoundingBox& box, Split& result ) const;
+
+    SpatialBuilder  ( const SpatialBuilder& ) = delete;     // アクセス禁止.
+    void operator = ( const SpatialBuilder& ) = delete;     // アクセス禁止.
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// LinearBuilder class
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class LinearBuilder
+{
+public:
+    //---------------------------------------------------------------------------------------------
+    //! @brief      コンストラクタです.
+    //!
+    //! @param [in]     count       形状数.
+    //! @param [in]     ppShapes    形状配列. 構築時にモートン符号順に並び替えられます.
+    //---------------------------------------------------------------------------------------------
+    LinearBuilder( size_t count, IShape** ppShapes );
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      中心座標のモートン符号から二分木を構築します.
+    //!
+    //! @param [in]     leafSize    葉ノードに格納する最大形状数.
+    //! @param [out]    nodes       構築したノード.
+    //! @return     ルートノードの番号を返却します.
+    //---------------------------------------------------------------------------------------------
+    s32 Build( size_t leafSize, std::vector<BuildNode>& nodes );
+
+private:
+    //=============================================================================================
+    // private variables.
+    //=============================================================================================
+    IShape**                    m_ppShapes;     //!< 形状配列です.
+    size_t                      m_Count;        //!< 形状数です.
+    std::vector<u64>            m_Codes;        //!< 並び替え済みのモートン符号です.
+    std::vector<BoundingBox>    m_Boxes;        //!< 並び替え済みの形状のバウンディングボックスです.
+    std::atomic<s32>            m_NodeCount;    //!< 確保済みのノード数です.
+
+    //=============================================================================================
+    // private methods.
+    //=============================================================================================
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      ノードを再帰的に構築します.
+    //---------------------------------------------------------------------------------------------
+    s32 BuildRecursive( size_t offset, size_t count, size_t leafSize, std::vector<BuildNode>& nodes );
+
+    LinearBuilder   ( const LinearBuilder& ) = delete;      // アクセス禁止.
+    void operator = ( const LinearBuilder& ) = delete;      // アクセス禁止.
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// TreeletOptimizer class
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class TreeletOptimizer
+{
+public:
+    //---------------------------------------------------------------------------------------------
+    //! @brief      コンストラクタです.
+    //---------------------------------------------------------------------------------------------
+    TreeletOptimizer();
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      二分木のSAHコストを求めます.
+    //!
+    //! @param [in]     nodes       二分木のノード.
+    //! @param [in]     root        ルートノードの番号.
+    //! @return     ルートの表面積で正規化したSAHコストを返却します.
+    //---------------------------------------------------------------------------------------------
+    f32 GetCost( const std::vector<BuildNode>& nodes, s32 root ) const;
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      部分木(treelet)の組み替えによって二分木のSAHコストを下げます.
+    //!
+    //! @param [in,out] nodes           二分木のノード.
+    //! @param [in]     root            ルートノードの番号.
+    //! @param [in]     iterationCount  反復回数.
+    //! @note       葉ノードの形状の範囲は変更しないので，構築時の形状の並びはそのまま使えます.
+    //---------------------------------------------------------------------------------------------
+    void Optimize( std::vector<BuildNode>& nodes, s32 root, s32 iterationCount );
+
+private:
+    //=============================================================================================
+    // private variables.
+    //=============================================================================================
+    BuildConfig     m_Config;       //!< 構築設定です.
+
+    //=============================================================================================
+    // private methods.
+    //=============================================================================================
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      葉から根に向かって部分木を組み替えます.
+    //---------------------------------------------------------------------------------------------
+    void OptimizeRecursive( std::vector<BuildNode>& nodes, s32 index );
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      指定ノードを根とする部分木を最適な形に組み替えます.
+    //---------------------------------------------------------------------------------------------
+    void Restructure( std::vector<BuildNode>& nodes, s32 index );
+
+    TreeletOptimizer( const TreeletOptimizer& ) = delete;   // アクセス禁止.
+    void operator =  ( const TreeletOptimizer& ) = delete;  // アクセス禁止.
+};
+
+} // namespace s3d
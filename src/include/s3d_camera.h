@@ -20,8 +20,12 @@ struct ICamera
 {
     //---------------------------------------------------------------------------------------------
     //! @brief      レイを取得します.
+    //!
+    //! @param [in]     x           スクリーンの横方向の位置.
+    //! @param [in]     y           スクリーンの縦方向の位置.
+    //! @param [in]     lens        レンズ上の位置を決める[0, 1)^2のサンプル値.
     //---------------------------------------------------------------------------------------------
-    virtual Ray GetRay( const f32 x, const f32 y ) = 0;
+    virtual Ray GetRay( const f32 x, const f32 y, const Vector2& lens ) = 0;
 };
 
 
@@ -92,7 +96,7 @@ public:
     //---------------------------------------------------------------------------------------------
     //! @brief      スクリーンまでへのレイを取得します.
     //---------------------------------------------------------------------------------------------
-    Ray GetRay( const f32 x, const f32 y ) override
+    Ray GetRay( const f32 x, const f32 y, const Vector2& ) override
     {
         Vector3 pos = ( m_CX * x ) + ( m_CY * y ) + m_CZ;
         Vector3 dir = Vector3::UnitVector( pos - m_Position );
@@ -204,7 +208,7 @@ public:
     //---------------------------------------------------------------------------------------------
     //! @brief      スクリーンまでへのレイを取得します.
     //---------------------------------------------------------------------------------------------
-    Ray GetRay( const f32 x, const f32 y ) override
+    Ray GetRay( const f32 x, const f32 y, const Vector2& lens ) override
     {
         Vector3 pos = ( m_CX * x ) + ( m_CY * y ) + m_CZ;
         Vector3 dir = Vector3::UnitVector( pos - m_Position );
@@ -212,7 +216,7 @@ public:
 
         if ( m_LensRadius > 0.0f )
         {
-            auto diff = Vector3( SampleLens(), 0.0f );
+            auto diff = Vector3( SampleLens( lens ), 0.0f );
 
             auto hitDist  = m_FocalDistance / fabs(dir.z);
             auto focusPos = m_Position + dir * hitDist;
@@ -252,17 +256,16 @@ private:
     Vector3 m_CY;           //!< スクリーンY方向を構成するベクトルです.
     Vector3 m_CZ;           //!< カメラ位置とスクリーン中心を結ぶベクトルです.
 
-    Random  m_Random;
     f32     m_LensRadius;       //!< レンズ半径.
     f32     m_FocalDistance;    //!< 焦点距離.
 
     //=============================================================================================
     // private methods.
     //=============================================================================================
-    Vector2 SampleLens()
+    Vector2 SampleLens( const Vector2& sample )
     {
-        auto theta = F_2PI * m_Random.GetAsF32();
-        auto r = m_LensRadius * SafeSqrt(m_Random.GetAsF32());
+        auto theta = F_2PI * sample.x;
+        auto r = m_LensRadius * SafeSqrt(sample.y);
         return Vector2( r * cosf(theta), r * sinf(theta) );
     }
 };
@@ -0,0 +1,121 @@
+﻿//-------------------------------------------------------------------------------------------------
+// File : s3d_capture.h
+// Desc : Capture Module.
+// Copyright(c) Project Asura. All right reserved.
+//-------------------------------------------------------------------------------------------------
+#pragma once
+
+//-------------------------------------------------------------------------------------------------
+// Includes
+//-------------------------------------------------------------------------------------------------
+#include <s3d_typedef.h>
+#include <s3d_math.h>
+#include <s3d_tonemapper.h>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace s3d {
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// CaptureWriter class
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class CaptureWriter
+{
+public:
+    //=============================================================================================
+    // public variables.
+    //=============================================================================================
+    /* NOTHING */
+
+    //=============================================================================================
+    // public methods.
+    //=============================================================================================
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      コンストラクタです.
+    //---------------------------------------------------------------------------------------------
+    CaptureWriter();
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      デストラクタです.
+    //---------------------------------------------------------------------------------------------
+    ~CaptureWriter();
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      初期化処理を行い，出力スレッドを起動します.
+    //!
+    //! @param [in]     width       画像の横幅.
+    //! @param [in]     height      画像の縦幅.
+    //! @param [in]     type        トーンマッピングの種類.
+    //---------------------------------------------------------------------------------------------
+    bool Init( s32 width, s32 height, TONE_MAPPING_TYPE type );
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      終了処理を行います.
+    //!
+    //! @note       依頼済みのキャプチャーは出力してから終了します.
+    //---------------------------------------------------------------------------------------------
+    void Term();
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      蓄積結果のスナップショットを取り，キャプチャーを依頼します.
+    //!
+    //! @param [in]     filename        出力するPNGファイル名.
+    //! @param [in]     pRadiance       ピクセル毎の放射輝度の和.
+    //! @param [in]     pSampleCounts   ピクセル毎のサンプル数.
+    //! @note       コピーするだけなので呼び出し側はすぐに蓄積を再開できます.
+    //!             出力前の依頼が残っている場合は新しいスナップショットで置き換えます.
+    //---------------------------------------------------------------------------------------------
+    void Request( const char* filename, const Color3* pRadiance, const u32* pSampleCounts );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    // Snapshot structure
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    struct Snapshot
+    {
+        std::string             filename;       //!< 出力するファイル名です.
+        std::vector<Color3>     radiance;       //!< ピクセル毎の放射輝度の和です.
+        std::vector<u32>        sampleCount;    //!< ピクセル毎のサンプル数です.
+    };
+
+    //=============================================================================================
+    // private variables.
+    //=============================================================================================
+    s32                     m_Width;        //!< 画像の横幅です.
+    s32                     m_Height;       //!< 画像の縦幅です.
+    TONE_MAPPING_TYPE       m_Type;         //!< トーンマッピングの種類です.
+    Snapshot                m_Snapshot[2];  //!< 依頼用と出力用のスナップショットです.
+    std::vector<f32>        m_Red;          //!< 平均を求めた赤チャンネルです.
+    std::vector<f32>        m_Green;        //!< 平均を求めた緑チャンネルです.
+    std::vector<f32>        m_Blue;         //!< 平均を求めた青チャンネルです.
+    std::vector<u8>         m_Outputs;      //!< 8bitに量子化した出力です.
+    std::thread             m_Thread;       //!< 出力スレッドです.
+    std::mutex              m_Mutex;        //!< 排他制御用ミューテックスです.
+    std::condition_variable m_Cond;         //!< キャプチャー依頼の通知です.
+    bool                    m_Pending;      //!< 出力前の依頼があるかどうか.
+    bool                    m_Exit;         //!< 終了要求があるかどうか.
+
+    //=============================================================================================
+    // private methods.
+    //=============================================================================================
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      出力スレッドのメイン関数です.
+    //---------------------------------------------------------------------------------------------
+    void WriterMain();
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      スナップショットをトーンマッピングしてPNGファイルに出力します.
+    //---------------------------------------------------------------------------------------------
+    void Write( const Snapshot& snapshot );
+
+    CaptureWriter   ( const CaptureWriter& ) = delete;      // アクセス禁止.
+    void operator = ( const CaptureWriter& ) = delete;      // アクセス禁止.
+};
+
+} // namespace s3d
@@ -0,0 +1,130 @@
+﻿//-------------------------------------------------------------------------------------------------
+// File : s3d_checkpoint.h
+// Desc : Checkpoint Module.
+// Copyright(c) Project Asura. All right reserved.
+//-------------------------------------------------------------------------------------------------
+#pragma once
+
+//-------------------------------------------------------------------------------------------------
+// Includes
+//-------------------------------------------------------------------------------------------------
+#include <s3d_typedef.h>
+#include <s3d_math.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace s3d {
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Checkpoint structure
+///////////////////////////////////////////////////////////////////////////////////////////////////
+struct Checkpoint
+{
+    s32                 Width;          //!< レンダーターゲットの横幅です.
+    s32                 Height;         //!< レンダーターゲットの縦幅です.
+    u32                 SamplerType;    //!< サンプラーの種類です.
+    f32                 Threshold;      //!< 適応サンプリングの現在の閾値です.
+    std::vector<Color3> Radiance;       //!< ピクセル毎の放射輝度の和です.
+    std::vector<u32>    SampleCounts;   //!< ピクセル毎のサンプル数です(次のサンプル番号を兼ねます).
+    std::vector<f32>    Moments;        //!< ピクセル毎の輝度の二乗和です.
+};
+
+//-------------------------------------------------------------------------------------------------
+//! @brief      チェックポイントをファイルに保存します.
+//!
+//! @note       一時ファイルに書き出してから置き換えるので，書き出し中に強制終了されても
+//!             直前のチェックポイントは壊れません.
+//-------------------------------------------------------------------------------------------------
+bool SaveCheckpoint( const char* filename, const Checkpoint& checkpoint );
+
+//-------------------------------------------------------------------------------------------------
+//! @brief      チェックポイントをファイルから読み込みます.
+//-------------------------------------------------------------------------------------------------
+bool LoadCheckpoint( const char* filename, Checkpoint& checkpoint );
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// CheckpointWriter class
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class CheckpointWriter
+{
+public:
+    //=============================================================================================
+    // public variables.
+    //=============================================================================================
+    /* NOTHING */
+
+    //=============================================================================================
+    // public methods.
+    //=============================================================================================
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      コンストラクタです.
+    //---------------------------------------------------------------------------------------------
+    CheckpointWriter();
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      デストラクタです.
+    //---------------------------------------------------------------------------------------------
+    ~CheckpointWriter();
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      初期化処理を行い，書き出しスレッドを起動します.
+    //!
+    //! @param [in]     filename        保存先のファイル名.
+    //---------------------------------------------------------------------------------------------
+    bool Init( const char* filename );
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      終了処理を行います.
+    //!
+    //! @note       書き出し中のチェックポイントがある場合は完了を待ちます.
+    //---------------------------------------------------------------------------------------------
+    void Term();
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      書き出し中かどうかチェックします.
+    //---------------------------------------------------------------------------------------------
+    bool IsBusy() const;
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      チェックポイントの書き出しを依頼します.
+    //!
+    //! @param [in,out] checkpoint      書き出すチェックポイント. 成功時は前回書き出したものと入れ替えます.
+    //! @retval true    書き出しを依頼しました.
+    //! @retval false   前回の書き出しが終わっていないため依頼しませんでした.
+    //! @note       コピーせずに入れ替えるので，呼び出し側は次回もバッファを使い回せます.
+    //---------------------------------------------------------------------------------------------
+    bool Request( Checkpoint& checkpoint );
+
+private:
+    //=============================================================================================
+    // private variables.
+    //=============================================================================================
+    std::string             m_FileName;     //!< 保存先のファイル名です.
+    Checkpoint              m_Data;         //!< 書き出すチェックポイントです.
+    std::thread             m_Thread;       //!< 書き出しスレッドです.
+    std::mutex              m_Mutex;        //!< 排他制御用ミューテックスです.
+    std::condition_variable m_Cond;         //!< 書き出し依頼の通知です.
+    std::atomic<bool>       m_Busy;         //!< 書き出し中かどうか.
+    bool                    m_Exit;         //!< 終了要求があるかどうか.
+
+    //=============================================================================================
+    // private methods.
+    //=============================================================================================
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      書き出しスレッドのメイン関数です.
+    //---------------------------------------------------------------------------------------------
+    void WriterMain();
+
+    CheckpointWriter( const CheckpointWriter& ) = delete;     // アクセス禁止.
+    void operator = ( const CheckpointWriter& ) = delete;     // アクセス禁止.
+};
+
+} // namespace s3d
@@ -0,0 +1,202 @@
+﻿//-------------------------------------------------------------------------------------------------
+// File : s3d_flatbvh8.h
+// Desc : Flat Oct BVH Module.
+// Copyright(c) Project Asura. All right reserved.
+//-------------------------------------------------------------------------------------------------
+#pragma once
+
+//-------------------------------------------------------------------------------------------------
+// Includes
+//-------------------------------------------------------------------------------------------------
+#include <s3d_math.h>
+#include <s3d_shape.h>
+#include <s3d_triangle.h>
+#include <s3d_bvhbuilder.h>
+#include <s3d_accel.h>
+#include <s3d_arena.h>
+#include <atomic>
+#include <vector>
+
+
+namespace s3d {
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// FlatBVH8 class
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class FlatBVH8 : public IShape
+{
+    //=============================================================================================
+    // list of friend classes and methods.
+    //=============================================================================================
+    /* NOTHING */
+
+public:
+    //=============================================================================================
+    // public variables.
+    //=============================================================================================
+    /* NOTHING */
+
+    //=============================================================================================
+    // public methods.
+    //=============================================================================================
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      平坦化したOBVHを構築します.
+    //!
+    //! @param [in]     count       形状数.
+    //! @param [in]     ppShapes    形状配列.
+    //! @param [in]     leafSize    葉ノードに格納する最大形状数(1～8).
+    //! @param [in]     mode        構築方法.
+    //! @note       BUILD_MODE_SPATIAL で構築した木は静的な形状専用です.
+    //!             BUILD_MODE_LINEAR は品質より構築速度を優先します.
+    //---------------------------------------------------------------------------------------------
+    static IShape* Create(size_t count, IShape** ppShapes, size_t leafSize = 8, BUILD_MODE mode = BUILD_MODE_OBJECT);
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      参照カウントを増やします.
+    //---------------------------------------------------------------------------------------------
+    void AddRef() override;
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      解放処理を行います.
+    //---------------------------------------------------------------------------------------------
+    void Release() override;
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      参照カウントを取得します.
+    //---------------------------------------------------------------------------------------------
+    u32 GetCount() const override;
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      交差判定を行います.
+    //---------------------------------------------------------------------------------------------
+    bool IsHit(const RaySet& raySet, HitRecord& record) const override;
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      遮蔽判定を行います.
+    //---------------------------------------------------------------------------------------------
+    bool IsOccluded(const RaySet& raySet, f32 distance) const override;
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      パケットにまとめたレイの交差判定を行います.
+    //!
+    //! @note       ノードのバウンディングボックスを全レーンでまとめて判定し，
+    //!             有効なレーンが少なくなった部分木はレーン毎の走査に切り替えます.
+    //---------------------------------------------------------------------------------------------
+    u32 IsHit8(const RayPacket8& packet, u32 mask, HitRecord* pRecords) const override;
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      バウンディングボックスを取得します.
+    //---------------------------------------------------------------------------------------------
+    BoundingBox GetBox() const override;
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      中心座標を取得します.
+    //---------------------------------------------------------------------------------------------
+    Vector3 GetCenter() const override;
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      木構造を保ったままバウンディングボックスを再計算します.
+    //!
+    //! @return     再計算後のSAHコストを返却します.
+    //---------------------------------------------------------------------------------------------
+    f32 Refit();
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      形状の移動に追従して更新します.
+    //!
+    //! @param [in]     threshold   構築時のSAHコストに対する再構築の閾値.
+    //! @retval true    SAHコストが閾値を超えて劣化したため再構築しました.
+    //! @retval false   再計算のみ行いました. 空間分割で構築した木は常に再計算のみです.
+    //! @note       レイの判定中に呼び出さないでください.
+    //---------------------------------------------------------------------------------------------
+    bool Update(f32 threshold);
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      構築時のSAHコストを取得します.
+    //---------------------------------------------------------------------------------------------
+    f32 GetBuildCost() const;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    // Node structure
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    S3D_ALIGN(32)
+    struct Node
+    {
+        BoundingBox8    box;            //!< 子ノードのバウンディングボックスです.
+        s32             child[8];       //!< 子ノード番号です(正:内部ノード, 負:葉ノード).
+        u32             mask;           //!< 有効な子ノードのビットマスクです.
+    };
+
+    //=============================================================================================
+    // private variables.
+    //=============================================================================================
+    std::atomic<u32>            m_Count;        //!< 参照カウントです.
+    Node*                       m_pNodes;       //!< ノード配列です.
+    u32                         m_NodeCount;    //!< ノード数です.
+    std::vector<IShape*>        m_Shapes;       //!< 葉ノードが参照する形状です.
+    BoundingBox                 m_Box;          //!< バウンディングボックスです.
+    u32                         m_LeafSize;     //!< 葉ノードに格納する最大形状数です.
+    f32                         m_BuildCost;    //!< 構築時のSAHコストです.
+    BUILD_MODE                  m_Mode;         //!< 構築方法です.
+    std::vector<BoundingBox>    m_Boxes;        //!< 空間分割で切り取られた参照のバウンディングボックスです.
+    Triangle8*                  m_pBlocks;      //!< 葉ノード毎にSoA形式に詰めた三角形です.
+    u32                         m_BlockCount;   //!< 三角形ブロック数です.
+    u32*                        m_pBlockOffsets; //!< 三角形ブロックに対応する形状のオフセットです.
+    Arena                       m_Arena;        //!< ノード配列と三角形ブロックのメモリです.
+
+    //=============================================================================================
+    // private methods.
+    //=============================================================================================
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      コンストラクタです.
+    //---------------------------------------------------------------------------------------------
+    FlatBVH8();
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      デストラクタです.
+    //---------------------------------------------------------------------------------------------
+    ~FlatBVH8();
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      初期化処理を行います.
+    //---------------------------------------------------------------------------------------------
+    bool Init(size_t count, IShape** ppShapes, size_t leafSize, BUILD_MODE mode);
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      保持している形状から木を構築します.
+    //---------------------------------------------------------------------------------------------
+    bool Build();
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      二分木を構築します.
+    //---------------------------------------------------------------------------------------------
+    s32 BuildBinary(
+        BVHBuilder&             builder,
+        std::vector<BuildNode>& nodes,
+        std::atomic<s32>&       nodeCount,
+        size_t                  offset,
+        size_t                  count,
+        size_t                  leafSize);
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      指定ノード以下を1本のレイで走査します.
+    //---------------------------------------------------------------------------------------------
+    bool Traverse(s32 root, const RaySet& raySet, HitRecord& record) const;
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      ノード配列と三角形ブロックを破棄します.
+    //!
+    //! @note       メモリは再構築で使い回すために保持します.
+    //---------------------------------------------------------------------------------------------
+    void Term();
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      二分木を8分木に変換してノード配列に格納します.
+    //---------------------------------------------------------------------------------------------
+    u32 Collapse(const std::vector<BuildNode>& nodes, s32 index, u32 depth, u32& maxDepth);
+};
+
+} // namespace s3d
@@ -59,6 +59,19 @@ public:
     //---------------------------------------------------------------------------------------------
     bool IsHit( const RaySet& raySet, HitRecord& record ) const override;
 
+    //---------------------------------------------------------------------------------------------
+    //! @brief      遮蔽判定を行います.
+    //---------------------------------------------------------------------------------------------
+    bool IsOccluded( const RaySet& raySet, f32 distance ) const override;
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      パケットにまとめたレイの交差判定を行います.
+    //!
+    //! @note       有効なレーンをローカル空間に移したパケットで形状を判定し，
+    //!             交差距離をワールド空間に戻します.
+    //---------------------------------------------------------------------------------------------
+    u32 IsHit8( const RayPacket8& packet, u32 mask, HitRecord* pRecords ) const override;
+
     //---------------------------------------------------------------------------------------------
     //! @brief      バウンディングボックスを取得します.
     //---------------------------------------------------------------------------------------------
@@ -97,6 +110,15 @@ private:
     //! @brief      デストラクタです.
     //---------------------------------------------------------------------------------------------
     ~Instance();
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      ワールド空間のレイをローカル空間に変換します.
+    //!
+    //! @param [in]     raySet      ワールド空間のレイ.
+    //! @param [out]    pScale      ワールド空間の距離からローカル空間の距離への拡大率.
+    //! @return     方向ベクトルを正規化し，判定区間を拡大率で変換したローカル空間のレイを返却します.
+    //---------------------------------------------------------------------------------------------
+    RaySet ToLocal( const RaySet& raySet, f32* pScale ) const;
 };
 
 } // namespace s3d
@@ -60,6 +60,11 @@ public:
     //---------------------------------------------------------------------------------------------
     bool IsHit(const RaySet& raySet, HitRecord& record) const override;
 
+    //---------------------------------------------------------------------------------------------
+    //! @brief      遮蔽判定を行います.
+    //---------------------------------------------------------------------------------------------
+    bool IsOccluded(const RaySet& raySet, f32 distance) const override;
+
     //---------------------------------------------------------------------------------------------
     //! @brief      バウンディングボックスを取得します.
     //---------------------------------------------------------------------------------------------
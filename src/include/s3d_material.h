@@ -11,6 +11,7 @@
 #include <s3d_math.h>
 #include <s3d_texture.h>
 #include <s3d_reference.h>
+#include <s3d_sampler.h>
 
 
 namespace s3d {
@@ -24,7 +25,7 @@ struct ShadingArg
     Vector3     output;         //!< 出射方向.
     Vector3     normal;         //!< 法線ベクトル.
     Vector2     texcoord;       //!< テクスチャ座標.
-    PCG         random;         //!< 乱数.
+    Sampler     sampler;        //!< 反射回数に合わせて次元を設定したサンプラー.
     bool        dice;           //!< 打ち切りかどうか?
 };
 
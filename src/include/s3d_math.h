@@ -1446,54 +1446,46 @@ struct Ray
 struct Ray4
 {
     b128    pos[3];     //!< 位置座標です.
-    b128    dir[3];     //!< 方向ベクトルの逆数です.
+    b128    invDir[3];  //!< 方向ベクトルの逆数です.
 };
 
 ////////////////////////////////////////////////////////////////////////////////////////////
-// Ray4 structure
+// Ray8 structure
 ////////////////////////////////////////////////////////////////////////////////////////////
 struct Ray8
 {
     b256    pos[3];     //!< 位置座標です.
-    b256    dir[3];     //!< 方向ベクトルの逆数です.
-};
-
-///////////////////////////////////////////////////////////////////////////////////////////////////
-// RaySet structure
-///////////////////////////////////////////////////////////////////////////////////////////////////
-struct RaySet
-{
-    Ray     ray;
-    Ray4    ray4;
-    Ray8    ray8;
+    b256    invDir[3];  //!< 方向ベクトルの逆数です.
 };
 
 //-------------------------------------------------------------------------------------------------
-//      レイを生成します.
+//      ゼロ除算にならないように逆数を求めます.
 //-------------------------------------------------------------------------------------------------
 S3D_INLINE
-Ray MakeRay(const Vector3& position, const Vector3& direction)
+f32 SafeRcp(const f32 value)
 {
-    Ray result = {};
-    result.pos = position;
-    result.dir = direction;
-    return result;
+    // 軸に平行なレイでも無限大やNaNにならないよう微小値でクランプします.
+    const f32 eps = 1e-20f;
+    if ( fabs(value) < eps )
+    { return ( value < 0.0f ) ? -1.0f / eps : 1.0f / eps; }
+
+    return 1.0f / value;
 }
 
 //-------------------------------------------------------------------------------------------------
 //      4つにパッキングされたレイを生成します.
 //-------------------------------------------------------------------------------------------------
 S3D_INLINE
-Ray4 MakeRay4(const Vector3& position, const Vector3& direction)
+Ray4 MakeRay4(const Vector3& position, const Vector3& invDir)
 {
-    Ray4 result = {};
+    Ray4 result;
     result.pos[0] = _mm_set1_ps( position.x );
     result.pos[1] = _mm_set1_ps( position.y );
     result.pos[2] = _mm_set1_ps( position.z );
 
-    result.dir[0] = _mm_set1_ps( direction.x );
-    result.dir[1] = _mm_set1_ps( direction.y );
-    result.dir[2] = _mm_set1_ps( direction.z );
+    result.invDir[0] = _mm_set1_ps( invDir.x );
+    result.invDir[1] = _mm_set1_ps( invDir.y );
+    result.invDir[2] = _mm_set1_ps( invDir.z );
 
     return result;
 }
@@ -1502,16 +1494,101 @@ Ray4 MakeRay4(const Vector3& position, const Vector3& direction)
 //      8つにパッキングされたレイを生成します.
 //-------------------------------------------------------------------------------------------------
 S3D_INLINE
-Ray8 MakeRay8(const Vector3& position, const Vector3& direction)
+Ray8 MakeRay8(const Vector3& position, const Vector3& invDir)
 {
-    Ray8 result = {};
+    Ray8 result;
     result.pos[0] = _mm256_set1_ps( position.x );
     result.pos[1] = _mm256_set1_ps( position.y );
     result.pos[2] = _mm256_set1_ps( position.z );
 
-    result.dir[0] = _mm256_set1_ps( direction.x );
-    result.dir[1] = _mm256_set1_ps( direction.y );
-    result.dir[2] = _mm256_set1_ps( direction.z );
+    result.invDir[0] = _mm256_set1_ps( invDir.x );
+    result.invDir[1] = _mm256_set1_ps( invDir.y );
+    result.invDir[2] = _mm256_set1_ps( invDir.z );
+    return result;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// RaySet structure
+///////////////////////////////////////////////////////////////////////////////////////////////////
+struct RaySet
+{
+public:
+    Ray     ray;        //!< レイです.
+    Vector3 invDir;     //!< 方向ベクトルの逆数です.
+    u32     octant;     //!< 方向ベクトルの符号ビットです(bit0:x, bit1:y, bit2:z が負なら1).
+    f32     tmin;       //!< 判定区間の下限値です.
+    f32     tmax;       //!< 判定区間の上限値です.
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      コンストラクタです.
+    //---------------------------------------------------------------------------------------------
+    S3D_INLINE
+    RaySet()
+    : octant    ( 0 )
+    , tmin      ( F_HIT_MIN )
+    , tmax      ( F_HIT_MAX )
+    , m_Flags   ( 0 )
+    { /* DO_NOTHING */ }
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      軸の符号を取得します(正なら0, 負なら1).
+    //---------------------------------------------------------------------------------------------
+    S3D_INLINE
+    u32 GetSign(u32 axis) const
+    { return ( octant >> axis ) & 0x1; }
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      4つにパッキングされたレイを取得します.
+    //!
+    //! @note       初めて参照された時に生成されます.
+    //---------------------------------------------------------------------------------------------
+    S3D_INLINE
+    const Ray4& GetRay4() const
+    {
+        if ( ( m_Flags & FLAG_RAY4 ) == 0 )
+        {
+            m_Ray4   = MakeRay4( ray.pos, invDir );
+            m_Flags |= FLAG_RAY4;
+        }
+        return m_Ray4;
+    }
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      8つにパッキングされたレイを取得します.
+    //!
+    //! @note       初めて参照された時に生成されます.
+    //---------------------------------------------------------------------------------------------
+    S3D_INLINE
+    const Ray8& GetRay8() const
+    {
+    #if S3D_IS_AVX
+        if ( ( m_Flags & FLAG_RAY8 ) == 0 )
+        {
+            m_Ray8   = MakeRay8( ray.pos, invDir );
+            m_Flags |= FLAG_RAY8;
+        }
+    #endif
+        return m_Ray8;
+    }
+
+private:
+    static const u32 FLAG_RAY4 = 0x1;   //!< Ray4 生成済みフラグです.
+    static const u32 FLAG_RAY8 = 0x2;   //!< Ray8 生成済みフラグです.
+
+    mutable Ray4    m_Ray4;     //!< 4つにパッキングされたレイです.
+    mutable Ray8    m_Ray8;     //!< 8つにパッキングされたレイです.
+    mutable u32     m_Flags;    //!< 生成済みフラグです.
+};
+
+//-------------------------------------------------------------------------------------------------
+//      レイを生成します.
+//-------------------------------------------------------------------------------------------------
+S3D_INLINE
+Ray MakeRay(const Vector3& position, const Vector3& direction)
+{
+    Ray result = {};
+    result.pos = position;
+    result.dir = direction;
     return result;
 }
 
@@ -1519,29 +1596,113 @@ Ray8 MakeRay8(const Vector3& position, const Vector3& direction)
 //      レイセットを生成します.
 //-------------------------------------------------------------------------------------------------
 S3D_INLINE
-RaySet MakeRaySet(const Vector3& position, const Vector3& direction)
+RaySet MakeRaySet
+(
+    const Vector3&  position,
+    const Vector3&  direction,
+    const f32       tmin = F_HIT_MIN,
+    const f32       tmax = F_HIT_MAX
+)
 {
-    RaySet result = {};
+    RaySet result;
     result.ray.pos = position;
     result.ray.dir = direction;
 
-    result.ray4.pos[0] = _mm_set1_ps( position.x );
-    result.ray4.pos[1] = _mm_set1_ps( position.y );
-    result.ray4.pos[2] = _mm_set1_ps( position.z );
+    result.invDir.x = SafeRcp( direction.x );
+    result.invDir.y = SafeRcp( direction.y );
+    result.invDir.z = SafeRcp( direction.z );
+
+    result.octant = ( ( result.invDir.x < 0.0f ) ? 0x1 : 0x0 )
+                  | ( ( result.invDir.y < 0.0f ) ? 0x2 : 0x0 )
+                  | ( ( result.invDir.z < 0.0f ) ? 0x4 : 0x0 );
+
+    result.tmin = tmin;
+    result.tmax = tmax;
+
+    return result;
+}
 
-    result.ray4.dir[0] = _mm_set1_ps( direction.x );
-    result.ray4.dir[1] = _mm_set1_ps( direction.y );
-    result.ray4.dir[2] = _mm_set1_ps( direction.z );
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// RayPacket8 structure
+///////////////////////////////////////////////////////////////////////////////////////////////////
+struct RayPacket8
+{
+    RaySet  raySet[8];  //!< 各レーンのレイセットです.
+    b256    pos[3];     //!< 各レーンの位置座標です.
+    b256    invDir[3];  //!< 各レーンの方向ベクトルの逆数です.
+    b256    tmin;       //!< 各レーンの判定区間の下限値です.
+    b256    tmax;       //!< 各レーンの判定区間の上限値です.
+    u32     mask;       //!< 有効なレーンのビットマスクです.
 
-#if S3D_IS_AVX
-    result.ray8.pos[0] = _mm256_set1_ps( position.x );
-    result.ray8.pos[1] = _mm256_set1_ps( position.y );
-    result.ray8.pos[2] = _mm256_set1_ps( position.z );
+    //---------------------------------------------------------------------------------------------
+    //! @brief      1つのバウンディングボックスと全レーンの交差判定を行います.
+    //!
+    //! @param [in]     mini        ボックスの最小値(各軸とも全レーンに同じ値を設定).
+    //! @param [in]     maxi        ボックスの最大値(各軸とも全レーンに同じ値を設定).
+    //! @param [in]     distance    各レーンの判定する最大距離.
+    //! @param [out]    dist        各レーンのボックスへの進入距離.
+    //! @return     交差したレーンのビットマスクを返却します.
+    //! @note       レーン毎に符号が異なるため，手前と奥の面は min/max で選択します.
+    //---------------------------------------------------------------------------------------------
+    S3D_INLINE
+    s32 IsHit( const b256* mini, const b256* maxi, const b256& distance, b256& dist ) const
+    {
+        auto tnear = tmin;
+        auto tfar  = _mm256_min_ps( distance, tmax );
 
-    result.ray8.dir[0] = _mm256_set1_ps( direction.x );
-    result.ray8.dir[1] = _mm256_set1_ps( direction.y );
-    result.ray8.dir[2] = _mm256_set1_ps( direction.z );
-#endif
+        for( auto i=0; i<3; ++i )
+        {
+            auto t0 = _mm256_mul_ps( _mm256_sub_ps( mini[i], pos[i] ), invDir[i] );
+            auto t1 = _mm256_mul_ps( _mm256_sub_ps( maxi[i], pos[i] ), invDir[i] );
+
+            tnear = _mm256_max_ps( tnear, _mm256_min_ps( t0, t1 ) );
+            tfar  = _mm256_min_ps( tfar,  _mm256_max_ps( t0, t1 ) );
+        }
+
+        dist = tnear;
+        return _mm256_movemask_ps( _mm256_cmp_ps( tfar, tnear, _CMP_GE_OS ) );
+    }
+};
+
+//-------------------------------------------------------------------------------------------------
+//      8本のレイをパケットにまとめます.
+//-------------------------------------------------------------------------------------------------
+S3D_INLINE
+RayPacket8 MakeRayPacket8( const Ray* pRays, u32 count )
+{
+    RayPacket8 result;
+
+    S3D_ALIGN(32) f32 pos   [3][8];
+    S3D_ALIGN(32) f32 invDir[3][8];
+    S3D_ALIGN(32) f32 tmin  [8];
+    S3D_ALIGN(32) f32 tmax  [8];
+
+    for( u32 i=0; i<8; ++i )
+    {
+        // 空きレーンは先頭のレイで埋めて，マスクで無効にします.
+        const auto& ray = pRays[ ( i < count ) ? i : 0 ];
+        auto& raySet = result.raySet[i];
+        raySet = MakeRaySet( ray.pos, ray.dir );
+
+        for( auto j=0; j<3; ++j )
+        {
+            pos   [j][i] = raySet.ray.pos.a[j];
+            invDir[j][i] = raySet.invDir.a[j];
+        }
+
+        tmin[i] = raySet.tmin;
+        tmax[i] = raySet.tmax;
+    }
+
+    for( auto j=0; j<3; ++j )
+    {
+        result.pos   [j] = _mm256_load_ps( pos   [j] );
+        result.invDir[j] = _mm256_load_ps( invDir[j] );
+    }
+
+    result.tmin = _mm256_load_ps( tmin );
+    result.tmax = _mm256_load_ps( tmax );
+    result.mask = ( count >= 8 ) ? 0xff : ( ( 0x1u << count ) - 1 );
 
     return result;
 }
@@ -2225,6 +2386,38 @@ public:
         return true;
     }
 
+    //-------------------------------------------------------------------------------
+    //! @brief      交差判定を行います.
+    //!
+    //! @param [in]     raySet      判定するレイ.
+    //! @param [in]     distance    判定する最大距離.
+    //-------------------------------------------------------------------------------
+    S3D_INLINE
+    bool IsHit( const RaySet& raySet, f32 distance ) const
+    {
+        if ( empty )
+        { return false; }
+
+        const Vector3* v[ 2 ] = { &mini, &maxi };
+        auto tmin = raySet.tmin;
+        auto tmax = Min( distance, raySet.tmax );
+
+        for( auto i=0; i<3; ++i )
+        {
+            auto s = raySet.GetSign( i );
+            auto n = ( v[ s     ]->a[i] - raySet.ray.pos.a[i] ) * raySet.invDir.a[i];
+            auto f = ( v[ 1 - s ]->a[i] - raySet.ray.pos.a[i] ) * raySet.invDir.a[i];
+
+            tmin = s3d::Max( tmin, n );
+            tmax = s3d::Min( tmax, f );
+
+            if ( tmin > tmax )
+            { return false; }
+        }
+
+        return true;
+    }
+
 
     //-------------------------------------------------------------------------------
     //! @brief      2つのバウンディングボックスをマージします.
@@ -2263,13 +2456,47 @@ public:
         return BoundingBox( p );
     }
 
+    //-------------------------------------------------------------------------------
+    //! @brief      2つのバウンディングボックスの共通部分を求めます.
+    //-------------------------------------------------------------------------------
     S3D_INLINE
-    static BoundingBox Transform( const BoundingBox& box, const Matrix& matrix )
+    static BoundingBox Intersect( const BoundingBox& a, const BoundingBox& b )
     {
-        auto mini = Vector3::Transform( box.mini, matrix );
-        auto maxi = Vector3::Transform( box.maxi, matrix );
+        if ( a.empty || b.empty )
+        { return BoundingBox(); }
+
+        auto mini = Vector3::Max( a.mini, b.mini );
+        auto maxi = Vector3::Min( a.maxi, b.maxi );
+
+        if ( mini.x > maxi.x || mini.y > maxi.y || mini.z > maxi.z )
+        { return BoundingBox(); }
+
         return BoundingBox( mini, maxi );
     }
+
+    //-------------------------------------------------------------------------------
+    //! @brief      バウンディングボックスを変換します.
+    //-------------------------------------------------------------------------------
+    S3D_INLINE
+    static BoundingBox Transform( const BoundingBox& box, const Matrix& matrix )
+    {
+        if ( box.empty )
+        { return box; }
+
+        // 回転を含む場合も包含するように8頂点を変換してマージします.
+        BoundingBox result;
+        for( auto i=0; i<8; ++i )
+        {
+            Vector3 p(
+                ( i & 0x1 ) ? box.maxi.x : box.mini.x,
+                ( i & 0x2 ) ? box.maxi.y : box.mini.y,
+                ( i & 0x4 ) ? box.maxi.z : box.mini.z );
+
+            result = Merge( result, Vector3::Transform( p, matrix ) );
+        }
+
+        return result;
+    }
 };
 
 
@@ -2359,44 +2586,39 @@ public:
 
     //--------------------------------------------------------------------------------
     //! @brief      交差判定を行います.
+    //!
+    //! @param [in]     raySet      判定するレイ.
+    //! @param [in]     distance    判定する最大距離.
+    //! @param [out]    mask        交差したボックスのビットマスク.
+    //! @param [out]    dist        各ボックスへの進入距離.
     //--------------------------------------------------------------------------------
     S3D_INLINE
-    bool IsHit( const Ray4& ray, s32& mask ) const
+    bool IsHit( const RaySet& raySet, f32 distance, s32& mask, b128& dist ) const
     {
-        auto tmin = _mm_set1_ps( -F_HIT_MAX );
-        auto tmax = _mm_set1_ps(  F_HIT_MAX );
+        const auto& ray = raySet.GetRay4();
 
-        //-- x
-        auto t0 = _mm_div_ps( _mm_sub_ps( value[ 0 ][ 0 ], ray.pos[ 0 ] ), ray.dir[ 0 ] );
-        auto t1 = _mm_div_ps( _mm_sub_ps( value[ 1 ][ 0 ], ray.pos[ 0 ] ), ray.dir[ 0 ] );
+        // 符号によって手前と奥の面が決まるので min/max の選択は不要.
+        auto sx = raySet.GetSign( 0 );
+        auto sy = raySet.GetSign( 1 );
+        auto sz = raySet.GetSign( 2 );
 
-        auto n = _mm_min_ps( t0, t1 );
-        auto f = _mm_max_ps( t0, t1 );
+        auto tmin = _mm_set1_ps( raySet.tmin );
+        auto tmax = _mm_set1_ps( Min( distance, raySet.tmax ) );
 
-        tmin = _mm_max_ps( tmin, n );
-        tmax = _mm_min_ps( tmax, f );
+        //-- x
+        tmin = _mm_max_ps( tmin, _mm_mul_ps( _mm_sub_ps( value[ sx     ][ 0 ], ray.pos[ 0 ] ), ray.invDir[ 0 ] ) );
+        tmax = _mm_min_ps( tmax, _mm_mul_ps( _mm_sub_ps( value[ 1 - sx ][ 0 ], ray.pos[ 0 ] ), ray.invDir[ 0 ] ) );
 
         //-- y
-        t0 = _mm_div_ps( _mm_sub_ps( value[ 0 ][ 1 ], ray.pos[ 1 ] ), ray.dir[ 1 ] );
-        t1 = _mm_div_ps( _mm_sub_ps( value[ 1 ][ 1 ], ray.pos[ 1 ] ), ray.dir[ 1 ] );
-
-        n = _mm_min_ps( t0, t1 );
-        f = _mm_max_ps( t0, t1 );
-
-        tmin = _mm_max_ps( tmin, n );
-        tmax = _mm_min_ps( tmax, f );
+        tmin = _mm_max_ps( tmin, _mm_mul_ps( _mm_sub_ps( value[ sy     ][ 1 ], ray.pos[ 1 ] ), ray.invDir[ 1 ] ) );
+        tmax = _mm_min_ps( tmax, _mm_mul_ps( _mm_sub_ps( value[ 1 - sy ][ 1 ], ray.pos[ 1 ] ), ray.invDir[ 1 ] ) );
 
         //-- z
-        t0 = _mm_div_ps( _mm_sub_ps( value[ 0 ][ 2 ], ray.pos[ 2 ] ), ray.dir[ 2 ] );
-        t1 = _mm_div_ps( _mm_sub_ps( value[ 1 ][ 2 ], ray.pos[ 2 ] ), ray.dir[ 2 ] );
-
-        n = _mm_min_ps( t0, t1 );
-        f = _mm_max_ps( t0, t1 );
-
-        tmin = _mm_max_ps( tmin, n );
-        tmax = _mm_min_ps( tmax, f );
+        tmin = _mm_max_ps( tmin, _mm_mul_ps( _mm_sub_ps( value[ sz     ][ 2 ], ray.pos[ 2 ] ), ray.invDir[ 2 ] ) );
+        tmax = _mm_min_ps( tmax, _mm_mul_ps( _mm_sub_ps( value[ 1 - sz ][ 2 ], ray.pos[ 2 ] ), ray.invDir[ 2 ] ) );
 
         mask = _mm_movemask_ps( _mm_cmpge_ps( tmax, tmin ) );
+        dist = tmin;
         return ( mask > 0 );
     }
 
@@ -2545,43 +2767,38 @@ public:
 
     //---------------------------------------------------------------------------------------------
     //! @brief      交差判定を行います.
+    //!
+    //! @param [in]     raySet      判定するレイ.
+    //! @param [in]     distance    判定する最大距離.
+    //! @param [out]    mask        交差したボックスのビットマスク.
+    //! @param [out]    dist        各ボックスへの進入距離.
     //---------------------------------------------------------------------------------------------
-    bool IsHit( const Ray8& ray, s32& mask ) const
+    bool IsHit( const RaySet& raySet, f32 distance, s32& mask, b256& dist ) const
     {
-        auto tmin = _mm256_set1_ps( -F_HIT_MAX );
-        auto tmax = _mm256_set1_ps(  F_HIT_MAX );
+        const auto& ray = raySet.GetRay8();
 
-        //-- x
-        auto t0 = _mm256_div_ps( _mm256_sub_ps( value[ 0 ][ 0 ], ray.pos[ 0 ] ), ray.dir[ 0 ] );
-        auto t1 = _mm256_div_ps( _mm256_sub_ps( value[ 1 ][ 0 ], ray.pos[ 0 ] ), ray.dir[ 0 ] );
+        // 符号によって手前と奥の面が決まるので min/max の選択は不要.
+        auto sx = raySet.GetSign( 0 );
+        auto sy = raySet.GetSign( 1 );
+        auto sz = raySet.GetSign( 2 );
 
-        auto n = _mm256_min_ps( t0, t1 );
-        auto f = _mm256_max_ps( t0, t1 );
+        auto tmin = _mm256_set1_ps( raySet.tmin );
+        auto tmax = _mm256_set1_ps( Min( distance, raySet.tmax ) );
 
-        tmin = _mm256_max_ps( tmin, n );
-        tmax = _mm256_min_ps( tmax, f );
+        //-- x
+        tmin = _mm256_max_ps( tmin, _mm256_mul_ps( _mm256_sub_ps( value[ sx     ][ 0 ], ray.pos[ 0 ] ), ray.invDir[ 0 ] ) );
+        tmax = _mm256_min_ps( tmax, _mm256_mul_ps( _mm256_sub_ps( value[ 1 - sx ][ 0 ], ray.pos[ 0 ] ), ray.invDir[ 0 ] ) );
 
         //-- y
-        t0 = _mm256_div_ps( _mm256_sub_ps( value[ 0 ][ 1 ], ray.pos[ 1 ] ), ray.dir[ 1 ] );
-        t1 = _mm256_div_ps( _mm256_sub_ps( value[ 1 ][ 1 ], ray.pos[ 1 ] ), ray.dir[ 1 ] );
-
-        n = _mm256_min_ps( t0, t1 );
-        f = _mm256_max_ps( t0, t1 );
-
-        tmin = _mm256_max_ps( tmin, n );
-        tmax = _mm256_min_ps( tmax, f );
+        tmin = _mm256_max_ps( tmin, _mm256_mul_ps( _mm256_sub_ps( value[ sy     ][ 1 ], ray.pos[ 1 ] ), ray.invDir[ 1 ] ) );
+        tmax = _mm256_min_ps( tmax, _mm256_mul_ps( _mm256_sub_ps( value[ 1 - sy ][ 1 ], ray.pos[ 1 ] ), ray.invDir[ 1 ] ) );
 
         //-- z
-        t0 = _mm256_div_ps( _mm256_sub_ps( value[ 0 ][ 2 ], ray.pos[ 2 ] ), ray.dir[ 2 ] );
-        t1 = _mm256_div_ps( _mm256_sub_ps( value[ 1 ][ 2 ], ray.pos[ 2 ] ), ray.dir[ 2 ] );
-
-        n = _mm256_min_ps( t0, t1 );
-        f = _mm256_max_ps( t0, t1 );
-
-        tmin = _mm256_max_ps( tmin, n );
-        tmax = _mm256_min_ps( tmax, f );
+        tmin = _mm256_max_ps( tmin, _mm256_mul_ps( _mm256_sub_ps( value[ sz     ][ 2 ], ray.pos[ 2 ] ), ray.invDir[ 2 ] ) );
+        tmax = _mm256_min_ps( tmax, _mm256_mul_ps( _mm256_sub_ps( value[ 1 - sz ][ 2 ], ray.pos[ 2 ] ), ray.invDir[ 2 ] ) );
 
         mask = _mm256_movemask_ps( _mm256_cmp_ps( tmax, tmin, _CMP_GE_OS ) );
+        dist = tmin;
         return ( mask > 0 );
     }
 
@@ -2816,6 +3033,20 @@ private:
     u64                m_State     = 0x4d595df4d0f33173;
 };
 
+//-------------------------------------------------------------------------------------------------
+//      ピクセル番号, サンプル番号, 次元から乱数の種を求めます.
+//      共有の状態を持たないので, どのスレッドで処理しても同じ乱数列になります.
+//-------------------------------------------------------------------------------------------------
+S3D_INLINE
+u64 MakeSeed(u32 pixel, u32 sample, u32 dimension) noexcept
+{
+    // splitmix64 の攪拌関数で入力の偏りを取り除く.
+    auto z = ((u64(pixel) << 32) | sample) + (u64(dimension) + 1) * 0x9e3779b97f4a7c15u;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9u;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebu;
+    return z ^ (z >> 31);
+}
+
 S3D_INLINE 
 f32 Max2(const Vector2& value) noexcept
 { return s3d::Max(value.x, value.y); }
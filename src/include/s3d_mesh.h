@@ -10,6 +10,8 @@
 //-------------------------------------------------------------------------------------------------
 #include <s3d_shape.h>
 #include <s3d_material.h>
+#include <s3d_accel.h>
+#include <s3d_arena.h>
 #include <atomic>
 #include <vector>
 
@@ -38,13 +40,16 @@ public:
 
     //---------------------------------------------------------------------------------------------
     //! @brief      生成処理です.
+    //!
+    //! @param [in]     filename    ファイル名.
+    //! @param [in]     mode        BVHの構築方法. 細長い三角形が多い場合は BUILD_MODE_SPATIAL を指定します.
     //---------------------------------------------------------------------------------------------
-    static IShape* Create(const char* filename);
+    static IShape* Create(const char* filename, BUILD_MODE mode = BUILD_MODE_OBJECT);
 
     //---------------------------------------------------------------------------------------------
     //! @brief      生成処理です.
     //---------------------------------------------------------------------------------------------
-    static IShape* Create(u32 vertexCount, Vertex* pVertices, IMaterial* pMateiral);
+    static IShape* Create(u32 vertexCount, Vertex* pVertices, IMaterial* pMateiral, BUILD_MODE mode = BUILD_MODE_OBJECT);
 
     //---------------------------------------------------------------------------------------------
     //! @brief      参照カウントを増やします.
@@ -66,6 +71,16 @@ public:
     //---------------------------------------------------------------------------------------------
     bool IsHit(const RaySet&, HitRecord&) const override;
 
+    //---------------------------------------------------------------------------------------------
+    //! @brief      遮蔽判定を行います.
+    //---------------------------------------------------------------------------------------------
+    bool IsOccluded(const RaySet& raySet, f32 distance) const override;
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      パケットにまとめたレイの交差判定を行います.
+    //---------------------------------------------------------------------------------------------
+    u32 IsHit8(const RayPacket8& packet, u32 mask, HitRecord* pRecords) const override;
+
     //---------------------------------------------------------------------------------------------
     //! @brief      バウンディングボックスを取得します.
     //---------------------------------------------------------------------------------------------
@@ -77,13 +92,94 @@ public:
     Vector3 GetCenter() const override;
 
 private:
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    // Primitive class
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    class Primitive : public IShape
+    {
+    public:
+        //-----------------------------------------------------------------------------------------
+        //! @brief      コンストラクタです.
+        //-----------------------------------------------------------------------------------------
+        Primitive(const Mesh* pMesh, u32 index);
+
+        //-----------------------------------------------------------------------------------------
+        //! @brief      参照カウントを増やします.
+        //!
+        //! @note       メッシュが所有するため何もしません.
+        //-----------------------------------------------------------------------------------------
+        void AddRef() override;
+
+        //-----------------------------------------------------------------------------------------
+        //! @brief      解放処理を行います.
+        //!
+        //! @note       メッシュが所有するため何もしません.
+        //-----------------------------------------------------------------------------------------
+        void Release() override;
+
+        //-----------------------------------------------------------------------------------------
+        //! @brief      参照カウントを取得します.
+        //-----------------------------------------------------------------------------------------
+        u32 GetCount() const override;
+
+        //-----------------------------------------------------------------------------------------
+        //! @brief      交差判定を行います.
+        //-----------------------------------------------------------------------------------------
+        bool IsHit(const RaySet& raySet, HitRecord& record) const override;
+
+        //-----------------------------------------------------------------------------------------
+        //! @brief      遮蔽判定を行います.
+        //-----------------------------------------------------------------------------------------
+        bool IsOccluded(const RaySet& raySet, f32 distance) const override;
+
+        //-----------------------------------------------------------------------------------------
+        //! @brief      バウンディングボックスを取得します.
+        //-----------------------------------------------------------------------------------------
+        BoundingBox GetBox() const override;
+
+        //-----------------------------------------------------------------------------------------
+        //! @brief      中心座標を取得します.
+        //-----------------------------------------------------------------------------------------
+        Vector3 GetCenter() const override;
+
+        //-----------------------------------------------------------------------------------------
+        //! @brief      法線ベクトルとテクスチャ座標を求めます.
+        //-----------------------------------------------------------------------------------------
+        void CalcParam(const Vector3&, const Vector2&, Vector3*, Vector2*) const override;
+
+        //-----------------------------------------------------------------------------------------
+        //! @brief      三角形の一部を包むバウンディングボックスを分割平面で左右に切り分けます.
+        //-----------------------------------------------------------------------------------------
+        void SplitBox(s32 axis, f32 position, const BoundingBox& box, BoundingBox* pLeft, BoundingBox* pRight) const override;
+
+        //-----------------------------------------------------------------------------------------
+        //! @brief      始点と2辺，マテリアルを取得します.
+        //-----------------------------------------------------------------------------------------
+        bool GetTriangle(Vector3* pTriangle, const IMaterial** ppMaterial) const override;
+
+    private:
+        //-----------------------------------------------------------------------------------------
+        //! @brief      始点と2辺から頂点座標を求めます.
+        //-----------------------------------------------------------------------------------------
+        void GetPositions(Vector3* pPositions) const;
+
+        const Mesh*     m_pMesh;        //!< 頂点データを保持するメッシュです.
+        u32             m_Index;        //!< 三角形番号です.
+    };
+
     //=============================================================================================
     // private variables.
     //=============================================================================================
     std::atomic<u32>            m_Count;            //!< 参照カウントです.
-    std::vector<IShape*>        m_Triangles;        //!< 三角形です.
+    Arena                       m_Arena;            //!< 頂点データと三角形のメモリです.
+    size_t                      m_TriangleCount;    //!< 三角形数です.
+    Vector3*                    m_pTriangles;       //!< 三角形毎の始点と2辺です(v0, e1, e2 の順に3つ. 読み込み中は頂点座標).
+    Vector3*                    m_pNormals;         //!< 法線ベクトルです(三角形毎に3つ).
+    Vector2*                    m_pTexCoords;       //!< テクスチャ座標です(三角形毎に3つ).
+    s32*                        m_pMaterialIds;     //!< 三角形毎のマテリアル番号です(負の場合はマテリアル無し).
+    Primitive*                  m_pPrimitives;      //!< BVHに登録する三角形です.
     std::vector<IMaterial*>     m_Materials;        //!< マテリアルです.
-    std::vector<Texture>      m_Textures;         //!< テクスチャです.
+    std::vector<Texture>        m_Textures;         //!< テクスチャです.
     IShape*                     m_pBVH;             //!< BVHです.
 
     //=============================================================================================
@@ -103,12 +199,24 @@ private:
     //---------------------------------------------------------------------------------------------
     //! @brief      ファイルから読み込みします.
     //---------------------------------------------------------------------------------------------
-    bool LoadFromFile(const char* filename);
+    bool LoadFromFile(const char* filename, BUILD_MODE mode);
 
     //---------------------------------------------------------------------------------------------
     //! @brief      初期化処理を行います.
     //---------------------------------------------------------------------------------------------
-    bool Init(u32 vertexCount, Vertex* pVertices, IMaterial* pMaterial);
+    bool Init(u32 vertexCount, Vertex* pVertices, IMaterial* pMaterial, BUILD_MODE mode);
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      三角形数に合わせて頂点データの格納先を確保します.
+    //---------------------------------------------------------------------------------------------
+    bool Resize(size_t triangleCount);
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      三角形を登録してBVHを構築します.
+    //!
+    //! @note       交差判定で辺を毎回求めないよう，頂点座標を始点と2辺に置き換えます.
+    //---------------------------------------------------------------------------------------------
+    bool Build(BUILD_MODE mode);
 };
 
 
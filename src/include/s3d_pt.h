@@ -11,11 +11,25 @@
 #include <s3d_math.h>
 #include <s3d_scene.h>
 #include <s3d_timer.h>
+#include <s3d_scheduler.h>
+#include <s3d_sampler.h>
+#include <s3d_checkpoint.h>
+#include <s3d_capture.h>
 #include <atomic>
+#include <vector>
 
 
 namespace s3d {
 
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// INTEGRATOR_TYPE enum
+///////////////////////////////////////////////////////////////////////////////////////////////////
+enum INTEGRATOR_TYPE
+{
+    INTEGRATOR_MEGAKERNEL = 0,      //!< 1経路ずつ深さ優先で追跡します.
+    INTEGRATOR_WAVEFRONT,           //!< 全ピクセルの経路をまとめて段階毎に処理します.
+};
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 // PathTracer class
 ///////////////////////////////////////////////////////////////////////////////////////////////////
@@ -36,7 +50,18 @@ public:
         s32     Height;             //!< レンダーターゲットの縦幅です.
         s32     MaxBounceCount;     //!< 打ち切りバウンス数です.
         f32     MaxRenderingSec;    //!< 最大レンダリング可能時間(秒単位)です.
+        f32     ReservedSec;        //!< トーンマッピング，デノイズ，PNG出力のために残しておく時間(秒単位)です.
         s32     CpuCoreCount;       //!< CPUコア数です.
+        bool    EnablePacket;       //!< 一次レイを8本ずつパケットで判定するかどうか.
+        INTEGRATOR_TYPE Integrator; //!< 積分器の種類です.
+        s32     TileSampleCount;    //!< タイルを1回処理する毎に追加するサンプル数です.
+        SAMPLER_TYPE SamplerType;   //!< サンプラーの種類です.
+        f32     AdaptiveThreshold;  //!< 適応サンプリングで収束とみなすタイルの相対誤差です(0以下で無効).
+        s32     AdaptiveMinSampleCount; //!< 収束判定を始めるまでのピクセル毎のサンプル数です.
+        const char* CheckpointPath;     //!< チェックポイントの保存先です(nullptrで無効).
+        f32     CheckpointIntervalSec;  //!< チェックポイントを保存する間隔(秒単位)です(0以下で無効).
+        const char* ResumePath;         //!< 再開するチェックポイントのファイル名です(nullptrで最初から).
+        f32     CaptureIntervalSec;     //!< 途中経過の画像を出力する間隔(秒単位)です(0以下で無効).
     };
 
     //=============================================================================================
@@ -63,17 +88,55 @@ public:
     //---------------------------------------------------------------------------------------------
     bool Run( const Config& config );
 
+    //---------------------------------------------------------------------------------------------
+    //! @brief      途中経過のキャプチャーを要求します.
+    //!
+    //! @note       任意のスレッドから呼び出せます. 次のパスの区切りでスナップショットを取ります.
+    //---------------------------------------------------------------------------------------------
+    void RequestCapture();
+
 private:
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    // PathState structure
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    struct PathState
+    {
+        std::vector<Vector3>    position;       //!< 次のレイの原点です.
+        std::vector<Vector3>    direction;      //!< 次のレイの方向です.
+        std::vector<Color3>     throughput;     //!< 経路の重みです.
+        std::vector<Color3>     radiance;       //!< 経路が集めた放射輝度です.
+        std::vector<Sampler>    sampler;        //!< 経路毎のサンプラーです.
+        std::vector<HitRecord>  record;         //!< 交差記録です.
+        std::vector<u64>        key;            //!< 並び替えキーです.
+        std::vector<Vector3>    shadowDir;      //!< シャドウレイの方向です.
+        std::vector<f32>        shadowDist;     //!< 光源までの距離です.
+        std::vector<Color3>     shadowWeight;   //!< 遮蔽されなかった場合に加算する放射輝度です.
+        std::vector<u32>        pixel;          //!< 今回のパスで追跡するピクセル番号です.
+        std::vector<u32>        active;         //!< 追跡中の経路番号です.
+        std::vector<u32>        hit;            //!< 交差した経路番号です.
+        std::vector<u32>        shadow;         //!< シャドウレイを持つ経路番号です.
+    };
+
     //=============================================================================================
     // private variables.
     //=============================================================================================
     Config              m_Config;           //!< コンフィグです.
     Color3*             m_RenderTarget;     //!< レンダーターゲットです.
-    Color3*             m_Intermediate;     //!< 中間レンダーターゲットです.
-    PCG                 m_Random;           //!< 乱数.
+    u32*                m_SampleCounts;     //!< ピクセル毎のサンプル数です.
+    f32*                m_Moments;          //!< ピクセル毎の輝度の二乗和です.
+    std::vector<u8>     m_TileActive;       //!< タイル毎にサンプルを追加するかどうかです.
+    s32                 m_TileCountX;       //!< 横方向のタイル数です.
+    s32                 m_WavefrontTile;    //!< ウェーブフロント方式で次に追跡を始めるタイルです.
+    f32                 m_Threshold;        //!< 現在の収束判定の閾値です.
     Scene*              m_pScene;           //!< シーンデータ.
     std::atomic<bool>   m_Updatable;        //!< 更新可能かどうか?
     Timer               m_Timer;
+    PathState           m_Paths;            //!< ウェーブフロント用の経路状態です.
+    TileScheduler       m_Scheduler;        //!< タイルスケジューラです.
+    CheckpointWriter    m_Writer;           //!< チェックポイントの書き出しスレッドです.
+    Checkpoint          m_Checkpoint;       //!< チェックポイントの書き出しに使うバッファです.
+    CaptureWriter       m_CaptureWriter;    //!< 画像の出力スレッドです.
+    std::atomic<bool>   m_CaptureRequested; //!< 途中経過のキャプチャーが要求されたかどうか.
 
     //=============================================================================================
     // private methods.
@@ -82,7 +145,16 @@ private:
     //---------------------------------------------------------------------------------------------
     //! @brief      指定方向からの放射輝度を求めます.
     //---------------------------------------------------------------------------------------------
-    Color3 Radiance( const Ray& input );
+    Color3 Radiance( const Ray& input, const Sampler& sampler );
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      判定済みの一次レイの交差から放射輝度を求めます.
+    //!
+    //! @param [in]     raySet      一次レイ.
+    //! @param [in]     primary     一次レイの交差記録(交差しなかった場合は pShape が nullptr).
+    //! @param [in]     sampler     経路のサンプリングに使うサンプラー.
+    //---------------------------------------------------------------------------------------------
+    Color3 Radiance( const RaySet& raySet, const HitRecord& primary, const Sampler& sampler );
 
     //---------------------------------------------------------------------------------------------
     //! @brief      直接光ライティングをします.
@@ -92,18 +164,127 @@ private:
         const Vector3&      normal,
         const Vector2&      texcoord,
         const IMaterial*    pMaterial,
-        PCG&                random );
+        const Sampler&      sampler );
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      光源をサンプリングしてシャドウレイを生成します.
+    //!
+    //! @param [out]    shadowRay       光源へのシャドウレイ.
+    //! @param [out]    distance        光源までの距離.
+    //! @param [out]    contribution    遮蔽されなかった場合の放射輝度.
+    //! @retval true    シャドウレイを生成しました.
+    //! @retval false   光源に届かないため生成しませんでした.
+    //---------------------------------------------------------------------------------------------
+    bool SampleLight(
+        const Vector3&      position,
+        const Vector3&      normal,
+        const Vector2&      texcoord,
+        const IMaterial*    pMaterial,
+        const Sampler&      sampler,
+        RaySet&             shadowRay,
+        f32&                distance,
+        Color3&             contribution );
 
     //---------------------------------------------------------------------------------------------
     //! @brief      経路を追跡します.
+    //!
+    //! @retval true    レンダリング結果を出力しました.
+    //! @retval false   初期化またはチェックポイントからの再開に失敗したため中止しました.
+    //---------------------------------------------------------------------------------------------
+    bool  TracePath();
+
     //---------------------------------------------------------------------------------------------
-    void  TracePath();
+    //! @brief      サブピクセル位置とレンズ上の位置をサンプリングして一次レイを生成します.
+    //---------------------------------------------------------------------------------------------
+    Ray   GetPrimaryRay( s32 x, s32 y, const Sampler& sampler );
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      タイル内のピクセルの経路を追跡します.
+    //!
+    //! @retval true    経路を追跡しました.
+    //! @retval false   収束したタイルのため追跡しませんでした.
+    //---------------------------------------------------------------------------------------------
+    bool  RenderTile( const Tile& tile );
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      ピクセルにサンプルを蓄積します.
+    //---------------------------------------------------------------------------------------------
+    void  Accumulate( s32 index, const Color3& value );
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      タイル内のピクセルの平均の相対誤差を推定します.
+    //---------------------------------------------------------------------------------------------
+    f32   EstimateError( const Tile& tile ) const;
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      次のパスでサンプルを追加するタイルを決めます.
+    //!
+    //! @note       全てのタイルが収束した場合は閾値を半分にして判定し直し，残り時間を使い切ります.
+    //---------------------------------------------------------------------------------------------
+    void  UpdateActiveTiles();
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      タイル番号を取得します.
+    //---------------------------------------------------------------------------------------------
+    s32   GetTileIndex( s32 x, s32 y ) const;
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      タイル番号からタイルを取得します.
+    //---------------------------------------------------------------------------------------------
+    Tile  GetTile( s32 index ) const;
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      収束していないタイルのピクセルに1サンプルずつウェーブフロント方式で経路を追跡します.
+    //!
+    //! @param [in]     maxPixelCount   追跡する最大ピクセル数. タイル単位で収まる分だけ追跡します.
+    //! @return     追跡したピクセル数を返却します.
+    //! @note       全てのタイルを追跡できなかった場合は，次回は続きのタイルから追跡します.
+    //---------------------------------------------------------------------------------------------
+    u32   TraceWavefront( u32 maxPixelCount );
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      追跡中のレイを原点と方向で並び替えます.
+    //---------------------------------------------------------------------------------------------
+    void  SortRays( const BoundingBox& box );
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      追跡中のレイの交差判定をまとめて行います.
+    //---------------------------------------------------------------------------------------------
+    void  ExtendRays();
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      交差した経路をマテリアル毎にまとめてシェーディングします.
+    //---------------------------------------------------------------------------------------------
+    void  ShadeHits( s32 depth );
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      シャドウレイの遮蔽判定をまとめて行います.
+    //---------------------------------------------------------------------------------------------
+    void  TraceShadowRays();
 
     //---------------------------------------------------------------------------------------------
     //! @brief      レンダリング結果をキャプチャーします.
+    //!
+    //! @note       パスの間で呼び出してください. 出力は出力スレッドで行います.
     //---------------------------------------------------------------------------------------------
     void  Capture( const char* filename );
 
+    //---------------------------------------------------------------------------------------------
+    //! @brief      現在の蓄積結果をチェックポイントに写します.
+    //!
+    //! @note       パスの間で呼び出してください.
+    //---------------------------------------------------------------------------------------------
+    void  StoreCheckpoint( Checkpoint& checkpoint ) const;
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      チェックポイントから蓄積結果を復元します.
+    //!
+    //! @param [in]     filename        チェックポイントのファイル名.
+    //! @retval true    復元しました.
+    //! @retval false   読み込みに失敗したか，解像度やサンプラーが一致しないため復元しませんでした.
+    //---------------------------------------------------------------------------------------------
+    bool  Resume( const char* filename );
+
     PathTracer      ( const PathTracer& ) = delete;     // アクセス禁止.
     void operator = ( const PathTracer& ) = delete;     // アクセス禁止.
 
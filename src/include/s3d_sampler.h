@@ -0,0 +1,138 @@
+﻿//-------------------------------------------------------------------------------------------------
+// File : s3d_sampler.h
+// Desc : Sampler Module.
+// Copyright(c) Project Asura. All right reserved.
+//-------------------------------------------------------------------------------------------------
+#pragma once
+
+//-------------------------------------------------------------------------------------------------
+// Includes
+//-------------------------------------------------------------------------------------------------
+#include <s3d_typedef.h>
+#include <s3d_math.h>
+
+
+namespace s3d {
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// SAMPLER_TYPE enum
+///////////////////////////////////////////////////////////////////////////////////////////////////
+enum SAMPLER_TYPE
+{
+    SAMPLER_RANDOM = 0,         //!< 次元毎に独立した乱数.
+    SAMPLER_STRATIFIED,         //!< 2次元毎に4x4に層化した乱数.
+    SAMPLER_SOBOL,              //!< Owenスクランブルを掛けたSobol列.
+    SAMPLER_BLUE_NOISE,         //!< ブルーノイズでピクセル毎にずらしたSobol列.
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// SAMPLE_DIMENSION enum
+///////////////////////////////////////////////////////////////////////////////////////////////////
+enum SAMPLE_DIMENSION
+{
+    SAMPLE_DIMENSION_PIXEL_X = 0,       //!< サブピクセル位置(X).
+    SAMPLE_DIMENSION_PIXEL_Y,           //!< サブピクセル位置(Y).
+    SAMPLE_DIMENSION_LENS_U,            //!< レンズ上の位置(U).
+    SAMPLE_DIMENSION_LENS_V,            //!< レンズ上の位置(V).
+    SAMPLE_DIMENSION_COUNT,             //!< カメラが使う次元数.
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// BOUNCE_DIMENSION enum
+///////////////////////////////////////////////////////////////////////////////////////////////////
+enum BOUNCE_DIMENSION
+{
+    BOUNCE_DIMENSION_BSDF_U = 0,        //!< BSDFの方向(U).
+    BOUNCE_DIMENSION_BSDF_V,            //!< BSDFの方向(V).
+    BOUNCE_DIMENSION_LIGHT_U,           //!< ライト上の位置(U).
+    BOUNCE_DIMENSION_LIGHT_V,           //!< ライト上の位置(V).
+    BOUNCE_DIMENSION_LIGHT_SELECT,      //!< ライトの選択.
+    BOUNCE_DIMENSION_LOBE,              //!< BSDFのローブの選択.
+    BOUNCE_DIMENSION_ROULETTE,          //!< ロシアンルーレット.
+    BOUNCE_DIMENSION_COUNT = 8,         //!< 1回の反射で使う次元数(2次元の組を揃えるため偶数).
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Sampler class
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class Sampler
+{
+public:
+    //=============================================================================================
+    // public variables.
+    //=============================================================================================
+    /* NOTHING */
+
+    //=============================================================================================
+    // public methods.
+    //=============================================================================================
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      コンストラクタです.
+    //---------------------------------------------------------------------------------------------
+    Sampler();
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      引数付きコンストラクタです.
+    //!
+    //! @param [in]     type        サンプラーの種類.
+    //! @param [in]     x           ピクセルのX座標.
+    //! @param [in]     y           ピクセルのY座標.
+    //! @param [in]     index       ピクセル内のサンプル番号.
+    //---------------------------------------------------------------------------------------------
+    Sampler( SAMPLER_TYPE type, u32 x, u32 y, u32 index );
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      サンプラーが使うテーブルを生成します.
+    //!
+    //! @note       描画中に生成しないよう，レンダリングを始める前に呼び出してください.
+    //---------------------------------------------------------------------------------------------
+    static void Prepare( SAMPLER_TYPE type );
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      以降の取得で基準とする次元を設定します.
+    //---------------------------------------------------------------------------------------------
+    void SetDimension( u32 dimension );
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      反射回数に対応する基準の次元を設定します.
+    //!
+    //! @param [in]     depth       反射回数(一次レイの交差点が0).
+    //---------------------------------------------------------------------------------------------
+    void SetBounce( s32 depth );
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      [0, 2^32)のサンプル値を取得します.
+    //!
+    //! @param [in]     offset      基準の次元からのオフセット.
+    //! @note       状態を持たないので，同じ次元からは何度取得しても同じ値が返ります.
+    //---------------------------------------------------------------------------------------------
+    u32 GetAsU32( u32 offset ) const;
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      [0, 1)のサンプル値を取得します.
+    //!
+    //! @param [in]     offset      基準の次元からのオフセット.
+    //---------------------------------------------------------------------------------------------
+    f32 GetAsF32( u32 offset ) const;
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      [0, 1)^2のサンプル値を取得します.
+    //!
+    //! @param [in]     offset      基準の次元からのオフセット(偶数).
+    //---------------------------------------------------------------------------------------------
+    Vector2 GetAsVector2( u32 offset ) const;
+
+private:
+    //=============================================================================================
+    // private variables.
+    //=============================================================================================
+    SAMPLER_TYPE    m_Type;         //!< サンプラーの種類です.
+    u32             m_X;            //!< ピクセルのX座標です.
+    u32             m_Y;            //!< ピクセルのY座標です.
+    u32             m_Pixel;        //!< ピクセルの識別番号です.
+    u32             m_Index;        //!< ピクセル内のサンプル番号です.
+    u32             m_Dimension;    //!< 基準の次元です.
+};
+
+} // namespace s3d
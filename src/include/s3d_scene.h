@@ -11,6 +11,9 @@
 #include <s3d_shape.h>
 #include <s3d_texture.h>
 #include <s3d_camera.h>
+#include <s3d_flatbvh8.h>
+#include <s3d_accel.h>
+#include <s3d_timer.h>
 #include <vector>
 
 
@@ -54,8 +57,24 @@ public:
     //! @brief      カメラからレイを取得します.
     //---------------------------------------------------------------------------------------------
     S3D_INLINE
-    Ray GetRay( const f32 x, const f32 y )
-    { return m_pCamera->GetRay( x, y ); }
+    Ray GetRay( const f32 x, const f32 y, const Vector2& lens )
+    { return m_pCamera->GetRay( x, y, lens ); }
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      シーン全体のバウンディングボックスを取得します.
+    //---------------------------------------------------------------------------------------------
+    S3D_INLINE
+    BoundingBox GetBox() const
+    {
+        if ( m_pBVH != nullptr )
+        { return m_pBVH->GetBox(); }
+
+        BoundingBox box;
+        for (size_t i = 0; i < m_Shapes.size(); ++i)
+        { box = BoundingBox::Merge( box, m_Shapes[i]->GetBox() ); }
+
+        return box;
+    }
 
     //---------------------------------------------------------------------------------------------
     //! @brief      交差判定を行います.
@@ -63,15 +82,50 @@ public:
     S3D_INLINE
     bool Intersect( const RaySet& raySet, HitRecord& record )
     {
-#if 0
-        return m_pBVH->IsHit( raySet, record );
-#else
+        if ( m_pBVH != nullptr )
+        { return m_pBVH->IsHit( raySet, record ); }
+
         auto flag = false;
         for (size_t i = 0; i < m_Shapes.size(); ++i)
         { flag |= m_Shapes[i]->IsHit(raySet, record); }
 
         return flag;
-#endif
+    }
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      パケットにまとめたレイの交差判定を行います.
+    //!
+    //! @return     交差したレーンのビットマスクを返却します.
+    //---------------------------------------------------------------------------------------------
+    S3D_INLINE
+    u32 Intersect8( const RayPacket8& packet, HitRecord* pRecords )
+    {
+        if ( m_pBVH != nullptr )
+        { return m_pBVH->IsHit8( packet, packet.mask, pRecords ); }
+
+        u32 hit = 0;
+        for (size_t i = 0; i < m_Shapes.size(); ++i)
+        { hit |= m_Shapes[i]->IsHit8( packet, packet.mask, pRecords ); }
+
+        return hit;
+    }
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      指定距離より手前に遮蔽物があるかどうかを判定します.
+    //---------------------------------------------------------------------------------------------
+    S3D_INLINE
+    bool IsOccluded( const RaySet& raySet, f32 distance )
+    {
+        if ( m_pBVH != nullptr )
+        { return m_pBVH->IsOccluded( raySet, distance ); }
+
+        for (size_t i = 0; i < m_Shapes.size(); ++i)
+        {
+            if ( m_Shapes[i]->IsOccluded( raySet, distance ) )
+            { return true; }
+        }
+
+        return false;
     }
 
     //---------------------------------------------------------------------------------------------
@@ -82,10 +136,10 @@ public:
     { return m_IBL.SampleColor( dir ) * Color3( 10.0f, 10.0f, 10.0f ); }
 
     S3D_INLINE
-    IShape* GetLight(PCG& rand)
+    IShape* GetLight(f32 sample)
     {
-        auto idx = rand.GetAsU32();
-        idx = idx % m_pLightList.size();
+        auto count = static_cast<u32>( m_pLightList.size() );
+        auto idx   = s3d::Min( static_cast<u32>( sample * count ), count - 1 );
         return m_pLightList[idx];
     }
 
@@ -95,7 +149,7 @@ protected:
     //=============================================================================================
     // protected variables.
     //=============================================================================================
-    IShape*                 m_pBVH;
+    FlatBVH8*               m_pBVH;
     ICamera*                m_pCamera;
     Texture                 m_IBL;
     std::vector<IShape*>    m_pLightList;
@@ -105,7 +159,47 @@ protected:
     //=============================================================================================
     // protected methods.
     //=============================================================================================
-    /* NOTHING */
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      シーン全体の加速構造(TLAS)を構築します.
+    //!
+    //! @param [in]     mode        構築方法. 毎フレーム再構築する場合は BUILD_MODE_LINEAR が高速です.
+    //! @note       インスタンスの変換は葉ノードに到達した時のみ行われます.
+    //---------------------------------------------------------------------------------------------
+    bool BuildAccel( BUILD_MODE mode = BUILD_MODE_OBJECT )
+    {
+        SafeRelease( m_pBVH );
+
+        if ( m_Shapes.empty() )
+        { return false; }
+
+        Timer timer;
+        timer.Start();
+
+        // 形状ごとにボックス判定できるよう葉ノードには1つずつ格納します.
+        // 並び替えはBVH内部の配列に対して行われるので m_Shapes の順序は変わりません.
+        m_pBVH = static_cast<FlatBVH8*>( FlatBVH8::Create( m_Shapes.size(), m_Shapes.data(), 1, mode ) );
+
+        timer.Stop();
+        Accel::AddBuildTime( ACCEL_LEVEL_TOP, timer.GetElapsedTimeMsec() );
+
+        return ( m_pBVH != nullptr );
+    }
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      形状の移動に合わせて加速構造を更新します.
+    //!
+    //! @param [in]     threshold   構築時に比べてSAHコストがこの倍率を超えたら再構築します.
+    //---------------------------------------------------------------------------------------------
+    bool UpdateAccel( f32 threshold = 1.5f )
+    {
+        if ( m_pBVH == nullptr )
+        { return BuildAccel(); }
+
+        // 通常はボックスの再計算のみで済ませ，品質が劣化した時だけ再分割します.
+        m_pBVH->Update( threshold );
+        return true;
+    }
 };
 
 } // namespace s3d
@@ -0,0 +1,173 @@
+﻿//-------------------------------------------------------------------------------------------------
+// File : s3d_scheduler.h
+// Desc : Tile Scheduler Module.
+// Copyright(c) Project Asura. All right reserved.
+//-------------------------------------------------------------------------------------------------
+#pragma once
+
+//-------------------------------------------------------------------------------------------------
+// Includes
+//-------------------------------------------------------------------------------------------------
+#include <s3d_typedef.h>
+#include <s3d_timer.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace s3d {
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Tile structure
+///////////////////////////////////////////////////////////////////////////////////////////////////
+struct Tile
+{
+    s32     x;          //!< 左上のX座標です.
+    s32     y;          //!< 左上のY座標です.
+    s32     w;          //!< 横幅です.
+    s32     h;          //!< 縦幅です.
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// TileScheduler class
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class TileScheduler
+{
+public:
+    //=============================================================================================
+    // public variables.
+    //=============================================================================================
+    typedef std::function<bool(u32 workerId, const Tile& tile)>     TileFunc;
+
+    //=============================================================================================
+    // public methods.
+    //=============================================================================================
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      コンストラクタです.
+    //---------------------------------------------------------------------------------------------
+    TileScheduler();
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      デストラクタです.
+    //---------------------------------------------------------------------------------------------
+    ~TileScheduler();
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      初期化処理を行います.
+    //!
+    //! @param [in]     workerCount     ワーカースレッド数. 0の場合はハードウェアスレッド数を使います.
+    //! @param [in]     width           画像の横幅.
+    //! @param [in]     height          画像の縦幅.
+    //! @param [in]     tileSize        タイルの一辺のピクセル数.
+    //! @retval true    初期化に成功しました.
+    //! @retval false   初期化に失敗しました.
+    //! @note       タイルはモートン順に並べ，連続した範囲ごとにワーカーへ割り当てます.
+    //---------------------------------------------------------------------------------------------
+    bool Init( u32 workerCount, s32 width, s32 height, s32 tileSize );
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      終了処理を行います.
+    //---------------------------------------------------------------------------------------------
+    void Term();
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      全てのタイルを処理します.
+    //!
+    //! @param [in]     func            タイル毎に呼び出す関数. 処理せずに済ませた場合は false を返します.
+    //! @param [in]     timeLimitMsec   呼び出しからの制限時間(ミリ秒). 負の場合は制限しません.
+    //! @note       全てのタイルの処理が終わるまで戻りません.
+    //!             自分のキューが空になったワーカーは他のワーカーのキューの末尾から奪って処理します.
+    //!             前回の処理時間が分かっている場合は，重いタイルから順に負荷の軽いワーカーへ割り当てます.
+    //!             前回の処理時間から制限時間に間に合わないと予測したタイルは処理せずに捨てます.
+    //!             処理時間が分からない初回は，制限時間を過ぎた時点で残りのタイルを捨てます.
+    //!             関数が false を返したタイルは前回の処理時間をそのまま残します.
+    //---------------------------------------------------------------------------------------------
+    void Run( const TileFunc& func, f64 timeLimitMsec );
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      ワーカースレッド数を取得します.
+    //---------------------------------------------------------------------------------------------
+    u32 GetWorkerCount() const;
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      タイル数を取得します.
+    //---------------------------------------------------------------------------------------------
+    u32 GetTileCount() const;
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      前回の実行でタイルの処理にかかった時間をミリ秒単位で取得します.
+    //---------------------------------------------------------------------------------------------
+    f64 GetTileCost( u32 index ) const;
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      前回の実行で制限時間のために処理しなかったタイル数を取得します.
+    //---------------------------------------------------------------------------------------------
+    u32 GetSkipCount() const;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    // Worker structure
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    struct Worker
+    {
+        std::thread         thread;     //!< スレッドです.
+        std::mutex          mutex;      //!< キューの排他制御です.
+        std::deque<u32>     queue;      //!< 処理待ちのタイル番号です.
+    };
+
+    //=============================================================================================
+    // private variables.
+    //=============================================================================================
+    std::vector<Tile>           m_Tiles;        //!< モートン順に並べたタイルです.
+    std::vector<f64>            m_Costs;        //!< 前回の実行でタイルの処理にかかった時間です.
+    bool                        m_HasCost;      //!< 処理時間を計測済みかどうか?
+    Worker*                     m_pWorkers;     //!< ワーカーです.
+    u32                         m_WorkerCount;  //!< ワーカー数です.
+    std::mutex                  m_Mutex;        //!< 開始と終了の排他制御です.
+    std::condition_variable     m_StartCond;    //!< 開始通知です.
+    std::condition_variable     m_DoneCond;     //!< 終了通知です.
+    u64                         m_Generation;   //!< 実行回数です.
+    u32                         m_BusyCount;    //!< 処理中のワーカー数です.
+    bool                        m_Exit;         //!< 終了要求フラグです.
+    const TileFunc*             m_pFunc;        //!< 実行中の関数です.
+    Timer                       m_Timer;        //!< 実行開始からの経過時間を計るタイマーです.
+    f64                         m_TimeLimit;    //!< 実行中の制限時間(ミリ秒)です.
+    std::atomic<u32>            m_SkipCount;    //!< 制限時間のために処理しなかったタイル数です.
+
+    //=============================================================================================
+    // private methods.
+    //=============================================================================================
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      タイルをワーカーのキューに割り当てます.
+    //---------------------------------------------------------------------------------------------
+    void Distribute();
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      ワーカースレッドのメイン関数です.
+    //!
+    //! @param [in]     id              ワーカー番号.
+    //! @param [in]     generation      起動時の実行世代. これより新しい世代の実行を待ちます.
+    //---------------------------------------------------------------------------------------------
+    void WorkerMain( u32 id, u64 generation );
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      自分のキューの先頭からタイルを取り出します.
+    //---------------------------------------------------------------------------------------------
+    bool Pop( u32 id, u32& index );
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      他のワーカーのキューの末尾からタイルを奪います.
+    //---------------------------------------------------------------------------------------------
+    bool Steal( u32 id, u32& index );
+
+    TileScheduler   ( const TileScheduler& ) = delete;      // アクセス禁止.
+    void operator = ( const TileScheduler& ) = delete;      // アクセス禁止.
+};
+
+} // namespace s3d
@@ -64,7 +64,79 @@ struct IShape : IReference
     virtual BoundingBox GetBox   () const = 0;
     virtual Vector3     GetCenter() const = 0;
     virtual void        CalcParam( const Vector3&, const Vector2&, Vector3*, Vector2*) const {}
-    virtual void        Sample   ( PCG&, Vector3*, float* ) {}
+    virtual void        Sample   ( const Vector2&, Vector3*, float* ) {}
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      指定距離より手前に遮蔽物があるかどうかを判定します.
+    //!
+    //! @param [in]     raySet      判定するレイ.
+    //! @param [in]     distance    判定する最大距離. この距離以降の交差は無視します.
+    //! @retval true    遮蔽物があります.
+    //! @retval false   遮蔽物はありません.
+    //! @note       最近接の交差を求める必要は無いので，最初に見つかった遮蔽物で判定を打ち切れます.
+    //!             既定の実装は交差判定で代用します.
+    //---------------------------------------------------------------------------------------------
+    virtual bool IsOccluded( const RaySet& raySet, f32 distance ) const
+    {
+        HitRecord record;
+        record.distance = distance;
+        return IsHit( raySet, record );
+    }
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      パケットにまとめたレイの交差判定を行います.
+    //!
+    //! @param [in]     packet      判定するレイのパケット.
+    //! @param [in]     mask        判定するレーンのビットマスク.
+    //! @param [in,out] pRecords    各レーンの交差記録(8つ分).
+    //! @return     交差したレーンのビットマスクを返却します.
+    //! @note       既定の実装はレーン毎に交差判定を行います.
+    //---------------------------------------------------------------------------------------------
+    virtual u32 IsHit8( const RayPacket8& packet, u32 mask, HitRecord* pRecords ) const
+    {
+        u32 result = 0;
+        for( u32 i=0; i<8; ++i )
+        {
+            auto bit = 0x1u << i;
+            if ( (mask & bit) == bit && IsHit( packet.raySet[i], pRecords[i] ) )
+            { result |= bit; }
+        }
+
+        return result;
+    }
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      形状の一部を包むバウンディングボックスを分割平面で左右に切り分けます.
+    //!
+    //! @param [in]     axis        分割軸.
+    //! @param [in]     position    分割平面の位置.
+    //! @param [in]     box         切り分ける形状の一部を包むバウンディングボックス.
+    //! @param [out]    pLeft       分割平面より負側のバウンディングボックス.
+    //! @param [out]    pRight      分割平面より正側のバウンディングボックス.
+    //! @note       既定の実装は形状を考慮せずにバウンディングボックスをそのまま切り分けます.
+    //---------------------------------------------------------------------------------------------
+    virtual void SplitBox( s32 axis, f32 position, const BoundingBox& box, BoundingBox* pLeft, BoundingBox* pRight ) const
+    {
+        auto maxi = box.maxi;
+        auto mini = box.mini;
+        maxi.a[axis] = Min( maxi.a[axis], position );
+        mini.a[axis] = Max( mini.a[axis], position );
+
+        *pLeft  = BoundingBox::Intersect( box, BoundingBox( box.mini, maxi ) );
+        *pRight = BoundingBox::Intersect( box, BoundingBox( mini, box.maxi ) );
+    }
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      三角形の始点と2辺，マテリアルを取得します.
+    //!
+    //! @param [out]    pTriangle   始点と2辺(v0, e1, e2 の順)の格納先.
+    //! @note       交差判定で用いる辺をそのまま返すので，SoA形式に詰めても判定結果は一致します.
+    //! @param [out]    ppMaterial  マテリアルの格納先.
+    //! @retval true    三角形のため取得しました.
+    //! @retval false   三角形ではありません.
+    //---------------------------------------------------------------------------------------------
+    virtual bool GetTriangle( Vector3*, const IMaterial** ) const
+    { return false; }
 };
 
 } // namespace s3d
@@ -59,6 +59,11 @@ public:
     //---------------------------------------------------------------------------------------------
     bool IsHit(const RaySet& raySet, HitRecord& record) const override;
 
+    //---------------------------------------------------------------------------------------------
+    //! @brief      遮蔽判定を行います.
+    //---------------------------------------------------------------------------------------------
+    bool IsOccluded(const RaySet& raySet, f32 distance) const override;
+
     //---------------------------------------------------------------------------------------------
     //! @brief      バウンディングボックスを取得します.
     //---------------------------------------------------------------------------------------------
@@ -71,7 +76,7 @@ public:
 
     void CalcParam(const Vector3&, const Vector2&, Vector3*, Vector2*) const override;
 
-    void Sample( PCG&, Vector3*, float* ) override;
+    void Sample( const Vector2&, Vector3*, float* ) override;
 
 private:
     //=============================================================================================
@@ -40,6 +40,7 @@ public:
     f64  GetElapsedTimeSec () const;
     f64  GetElapsedTimeMin () const;
     f64  GetElapsedTimeHour() const;
+    f64  GetLapTimeMsec    () const;
 
 protected:
     //==========================================================================
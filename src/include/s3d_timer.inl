@@ -75,6 +75,18 @@ S3D_INLINE
 f64 Timer::GetElapsedTimeHour() const
 { return ( ( m_StopTime - m_StartTime ) * m_InvTicksPerSec ) / 3600.0; }
 
+//--------------------------------------------------------------------------------
+//      Stop()を呼ばずに計測開始から現在までの経過時間をミリ秒単位で取得します.
+//      状態を変更しないので，複数のスレッドから同時に呼び出せます.
+//--------------------------------------------------------------------------------
+S3D_INLINE
+f64 Timer::GetLapTimeMsec() const
+{
+    LARGE_INTEGER qwTime = { 0 };
+    QueryPerformanceCounter( &qwTime );
+    return ( qwTime.QuadPart - m_StartTime ) * 1000.0 * m_InvTicksPerSec;
+}
+
 
 } // namespace s3d
 
@@ -32,6 +32,24 @@ class ToneMapper
 public:
     static void Map( TONE_MAPPING_TYPE type, const s32 width, const s32 height, const Color3* pPixels, Color3* pResult );
 
+    //---------------------------------------------------------------------------------------------
+    //! @brief      トーンマッピングからsRGB変換，8bit量子化までをまとめて行います.
+    //!
+    //! @param [in]     pRed        赤チャンネルのピクセル値.
+    //! @param [in]     pGreen      緑チャンネルのピクセル値.
+    //! @param [in]     pBlue       青チャンネルのピクセル値.
+    //! @param [out]    pResult     RGB順に並べた8bitの出力(width * height * 3バイト).
+    //! @note       チャンネル毎に並べた入力を8ピクセルずつ並列に処理します.
+    //---------------------------------------------------------------------------------------------
+    static void MapToRGB8(
+        TONE_MAPPING_TYPE   type,
+        const s32           width,
+        const s32           height,
+        const f32*          pRed,
+        const f32*          pGreen,
+        const f32*          pBlue,
+        u8*                 pResult );
+
 private:
     static void ReinhardToneMapping         ( const s32 width, const s32 height, const Color3* pPixels, Color3* pResult );
     static void Uncharted2FilmicToneMapping ( const s32 width, const s32 height, const Color3* pPixels, Color3* pResult );
@@ -39,6 +39,46 @@ public:
     //---------------------------------------------------------------------------------------------
     static IShape* Create(Vertex* pVertices, IMaterial* pMaterial);
 
+    //---------------------------------------------------------------------------------------------
+    //! @brief      頂点と辺を指定して交差判定を行います.
+    //!
+    //! @param [in]     v0              頂点0の座標.
+    //! @param [in]     e1              頂点0から頂点1への辺.
+    //! @param [in]     e2              頂点0から頂点2への辺.
+    //! @param [in]     raySet          判定するレイ.
+    //! @param [in]     maxDistance     これ以上遠い交差は無視する距離.
+    //! @param [out]    distance        交差点までの距離.
+    //! @param [out]    barycentric     交差点の重心座標.
+    //! @retval true    交差しました.
+    //! @retval false   交差しませんでした.
+    //---------------------------------------------------------------------------------------------
+    static bool Intersect(
+        const Vector3&  v0,
+        const Vector3&  e1,
+        const Vector3&  e2,
+        const RaySet&   raySet,
+        f32             maxDistance,
+        f32&            distance,
+        Vector2&        barycentric);
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      三角形の一部を包むバウンディングボックスを分割平面で左右に切り分けます.
+    //!
+    //! @param [in]     pPositions  3つの頂点座標.
+    //! @param [in]     axis        分割軸.
+    //! @param [in]     position    分割平面の位置.
+    //! @param [in]     box         切り分ける範囲.
+    //! @param [out]    pLeft       分割平面より負側のバウンディングボックス.
+    //! @param [out]    pRight      分割平面より正側のバウンディングボックス.
+    //---------------------------------------------------------------------------------------------
+    static void ClipBox(
+        const Vector3*      pPositions,
+        s32                 axis,
+        f32                 position,
+        const BoundingBox&  box,
+        BoundingBox*        pLeft,
+        BoundingBox*        pRight);
+
     //---------------------------------------------------------------------------------------------
     //! @brief      参照カウントを増やします
     //---------------------------------------------------------------------------------------------
@@ -59,6 +99,11 @@ public:
     //---------------------------------------------------------------------------------------------
     bool IsHit(const RaySet& raySet, HitRecord& record) const override;
 
+    //---------------------------------------------------------------------------------------------
+    //! @brief      遮蔽判定を行います.
+    //---------------------------------------------------------------------------------------------
+    bool IsOccluded(const RaySet& raySet, f32 distance) const override;
+
     //---------------------------------------------------------------------------------------------
     //! @brief      バウンディングボックスを取得します.
     //---------------------------------------------------------------------------------------------
@@ -71,6 +116,16 @@ public:
 
     void CalcParam(const Vector3&, const Vector2&, Vector3*, Vector2*) const override;
 
+    //---------------------------------------------------------------------------------------------
+    //! @brief      三角形の一部を包むバウンディングボックスを分割平面で左右に切り分けます.
+    //---------------------------------------------------------------------------------------------
+    void SplitBox(s32 axis, f32 position, const BoundingBox& box, BoundingBox* pLeft, BoundingBox* pRight) const override;
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      始点と2辺，マテリアルを取得します.
+    //---------------------------------------------------------------------------------------------
+    bool GetTriangle(Vector3* pTriangle, const IMaterial** ppMaterial) const override;
+
 private:
     //=============================================================================================
     // private variables.
@@ -97,4 +152,46 @@ private:
 };
 
 
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Triangle8 structure
+///////////////////////////////////////////////////////////////////////////////////////////////////
+S3D_ALIGN(32)
+struct Triangle8
+{
+    b256                v0[3];          //!< 頂点0の座標です.
+    b256                e1[3];          //!< 頂点0から頂点1への辺です.
+    b256                e2[3];          //!< 頂点0から頂点2への辺です.
+    const IShape*       pShapes[8];     //!< 元の形状です.
+    const IMaterial*    pMaterials[8];  //!< マテリアルです.
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      三角形を8つ分のSoA形式に詰めます.
+    //!
+    //! @param [in]     count       形状数(1～8).
+    //! @param [in]     ppShapes    形状配列.
+    //! @param [out]    result      格納先. 空きのレーンは判定されない縮退三角形になります.
+    //! @retval true    詰めました.
+    //! @retval false   三角形ではない形状が含まれています.
+    //---------------------------------------------------------------------------------------------
+    static bool Pack(u32 count, IShape* const* ppShapes, Triangle8& result);
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      8つの三角形との交差判定をまとめて行います.
+    //!
+    //! @note       Triangle::IsHit() と同じ演算順序なので判定結果も一致します.
+    //---------------------------------------------------------------------------------------------
+    bool IsHit(const RaySet& raySet, HitRecord& record) const;
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      8つの三角形のいずれかが指定距離より手前にあるかを判定します.
+    //---------------------------------------------------------------------------------------------
+    bool IsOccluded(const RaySet& raySet, f32 distance) const;
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      8つの三角形と交差判定を行い，交差したレーンのビットマスクを求めます.
+    //---------------------------------------------------------------------------------------------
+    s32 Intersect(const RaySet& raySet, f32 distance, b256& dist, b256& beta, b256& gamma) const;
+};
+
+
 } // namespace s3d
@@ -17,8 +17,30 @@
 #include <crtdbg.h>
 #endif
 #include <s3d_pt.h>
+#include <cstring>
 #include <Windows.h>
 
+//-------------------------------------------------------------------------------------------------
+// Global Variables.
+//-------------------------------------------------------------------------------------------------
+s3d::PathTracer*    g_pRenderer = nullptr;      //!< 途中経過のキャプチャーを要求するレンダラーです.
+
+//-------------------------------------------------------------------------------------------------
+//! @brief      コンソールの制御イベントを処理します.
+//!
+//! @note       Ctrl+Break で途中経過をキャプチャーします.
+//-------------------------------------------------------------------------------------------------
+BOOL WINAPI ConsoleCtrlHandler( DWORD type )
+{
+    if ( type == CTRL_BREAK_EVENT && g_pRenderer != nullptr )
+    {
+        g_pRenderer->RequestCapture();
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
 //-------------------------------------------------------------------------------------------------
 //! @brief      CPUコアの数を取得します.
 //-------------------------------------------------------------------------------------------------
@@ -58,11 +80,14 @@ int main( int argc, char **argv )
     // リークチェック.
     _CrtSetDbgFlag( _CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF );
   #endif
+    auto exitCode = 0;
+
     {
         // アプリケーションの構成設定.
         s3d::PathTracer::Config config;
 
-        config.MaxRenderingSec    = 59.8f; // デノイズ時間を考慮してあとで調整.
+        config.MaxRenderingSec    = 60.0f;
+        config.ReservedSec        = 0.2f;  // デノイズ時間を考慮してあとで調整.
 
     #if 1
         // 本番用.
@@ -72,6 +97,12 @@ int main( int argc, char **argv )
         //config.SubSampleCount = 1;
         config.MaxBounceCount = 32;
         config.CpuCoreCount   = GetCPUCoreCount();
+        config.EnablePacket   = true;
+        config.Integrator     = s3d::INTEGRATOR_MEGAKERNEL;
+        config.TileSampleCount = 2;
+        config.SamplerType     = s3d::SAMPLER_SOBOL;
+        config.AdaptiveThreshold      = 0.05f;
+        config.AdaptiveMinSampleCount = 16;
     #else
         // デバッグ用.
         config.Width          = 256;
@@ -80,13 +111,38 @@ int main( int argc, char **argv )
         //config.SubSampleCount = 1;
         config.MaxBounceCount = 4;
         config.CpuCoreCount   = GetCPUCoreCount();
+        config.EnablePacket   = true;
+        config.Integrator     = s3d::INTEGRATOR_MEGAKERNEL;
+        config.TileSampleCount = 2;
+        config.SamplerType     = s3d::SAMPLER_SOBOL;
+        config.AdaptiveThreshold      = 0.05f;
+        config.AdaptiveMinSampleCount = 16;
     #endif
 
+        // --resume [filename] で中断したレンダリングを再開する.
+        config.CheckpointPath        = "checkpoint.bin";
+        config.CheckpointIntervalSec = 10.0f;
+        config.ResumePath            = nullptr;
+        config.CaptureIntervalSec    = 0.0f;    // 途中経過が必要な場合は間隔を指定する.
+        for( auto i=1; i<argc; ++i )
+        {
+            if ( strcmp( argv[i], "--resume" ) == 0 )
+            { config.ResumePath = ( i + 1 < argc && argv[i + 1][0] != '-' ) ? argv[++i] : config.CheckpointPath; }
+        }
+
         s3d::PathTracer renderer;
 
+        g_pRenderer = &renderer;
+        SetConsoleCtrlHandler( ConsoleCtrlHandler, TRUE );
+
         // アプリケーション実行.
-        renderer.Run( config );
+        // 再開に失敗した場合などは，呼び出し側で判別できるよう終了コードで通知する.
+        if ( !renderer.Run( config ) )
+        { exitCode = 1; }
+
+        SetConsoleCtrlHandler( ConsoleCtrlHandler, FALSE );
+        g_pRenderer = nullptr;
     }
 
-    return 0;
+    return exitCode;
 }
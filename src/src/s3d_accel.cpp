@@ -0,0 +1,67 @@
+﻿//-------------------------------------------------------------------------------------------------
+// File : s3d_accel.cpp
+// Desc : Acceleration Structure Module.
+// Copyright(c) Project Asura. All right reserved.
+//-------------------------------------------------------------------------------------------------
+
+//-------------------------------------------------------------------------------------------------
+// Includes
+//-------------------------------------------------------------------------------------------------
+#include <s3d_accel.h>
+
+
+namespace s3d {
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Accel class
+///////////////////////////////////////////////////////////////////////////////////////////////////
+TRAVERSAL_ORDER Accel::s_TraversalOrder = TRAVERSAL_ORDER_NEAREST;
+BuildConfig     Accel::s_BuildConfig    = { 16, 1.0f, 1.0f, 1e-5f, 0.3f, 0 };
+f64             Accel::s_BuildTime[ACCEL_LEVEL_COUNT] = {};
+
+//-------------------------------------------------------------------------------------------------
+//      子ノードの走査順を設定します.
+//-------------------------------------------------------------------------------------------------
+void Accel::SetTraversalOrder( TRAVERSAL_ORDER order )
+{ s_TraversalOrder = order; }
+
+//-------------------------------------------------------------------------------------------------
+//      子ノードの走査順を取得します.
+//-------------------------------------------------------------------------------------------------
+TRAVERSAL_ORDER Accel::GetTraversalOrder()
+{ return s_TraversalOrder; }
+
+//-------------------------------------------------------------------------------------------------
+//      構築設定を設定します.
+//-------------------------------------------------------------------------------------------------
+void Accel::SetBuildConfig( const BuildConfig& config )
+{ s_BuildConfig = config; }
+
+//-------------------------------------------------------------------------------------------------
+//      構築設定を取得します.
+//-------------------------------------------------------------------------------------------------
+const BuildConfig& Accel::GetBuildConfig()
+{ return s_BuildConfig; }
+
+//-------------------------------------------------------------------------------------------------
+//      構築時間の集計をリセットします.
+//-------------------------------------------------------------------------------------------------
+void Accel::ResetBuildTime()
+{
+    for(auto i=0; i<ACCEL_LEVEL_COUNT; ++i)
+    { s_BuildTime[i] = 0.0; }
+}
+
+//-------------------------------------------------------------------------------------------------
+//      構築時間を加算します.
+//-------------------------------------------------------------------------------------------------
+void Accel::AddBuildTime( ACCEL_LEVEL level, f64 msec )
+{ s_BuildTime[level] += msec; }
+
+//-------------------------------------------------------------------------------------------------
+//      構築時間の合計をミリ秒単位で取得します.
+//-------------------------------------------------------------------------------------------------
+f64 Accel::GetBuildTime( ACCEL_LEVEL level )
+{ return s_BuildTime[level]; }
+
+} // namespace s3d
@@ -0,0 +1,157 @@
+﻿//-------------------------------------------------------------------------------------------------
+// File : s3d_arena.cpp
+// Desc : Arena Allocator Module.
+// Copyright(c) Project Asura. All right reserved.
+//-------------------------------------------------------------------------------------------------
+
+//-------------------------------------------------------------------------------------------------
+// Includes
+//-------------------------------------------------------------------------------------------------
+#include <s3d_arena.h>
+#include <s3d_math.h>
+#include <malloc.h>
+
+
+namespace /* anonymous */ {
+
+//-------------------------------------------------------------------------------------------------
+// Constant Values.
+//-------------------------------------------------------------------------------------------------
+constexpr size_t    ChunkAlignment = 64;    //!< チャンクの先頭のアライメント(キャッシュラインサイズ)です.
+
+} // namespace /* anonymous */
+
+
+namespace s3d {
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Arena class
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------------------------------
+//      コンストラクタです.
+//-------------------------------------------------------------------------------------------------
+Arena::Arena( size_t chunkSize )
+: m_ChunkSize( chunkSize )
+, m_Current  ( 0 )
+, m_Offset   ( 0 )
+, m_UsedSize ( 0 )
+{ /* DO_NOTHING */ }
+
+//-------------------------------------------------------------------------------------------------
+//      デストラクタです.
+//-------------------------------------------------------------------------------------------------
+Arena::~Arena()
+{ Term(); }
+
+//-------------------------------------------------------------------------------------------------
+//      メモリを確保します.
+//-------------------------------------------------------------------------------------------------
+void* Arena::Alloc( size_t size, size_t alignment )
+{
+    if ( size == 0 )
+    { return nullptr; }
+
+    // 使用中のチャンクから順に収まる場所を探す.
+    while ( m_Current < m_Chunks.size() )
+    {
+        auto& chunk = m_Chunks[m_Current];
+        auto offset = ( m_Offset + alignment - 1 ) & ~( alignment - 1 );
+        if ( offset + size <= chunk.size )
+        {
+            m_Offset    = offset + size;
+            m_UsedSize += size;
+            return chunk.pBuffer + offset;
+        }
+
+        m_Current++;
+        m_Offset = 0;
+    }
+
+    // チャンクより大きな要求はそのサイズで確保する.
+    auto chunkSize = Max( m_ChunkSize, size + alignment );
+    if ( !AddChunk( chunkSize ) )
+    { return nullptr; }
+
+    return Alloc( size, alignment );
+}
+
+//-------------------------------------------------------------------------------------------------
+//      続けて確保するメモリが1つのチャンクに収まるように予約します.
+//-------------------------------------------------------------------------------------------------
+bool Arena::Reserve( size_t size )
+{
+    for(auto i=m_Current; i<m_Chunks.size(); ++i)
+    {
+        auto offset = ( i == m_Current ) ? m_Offset : 0;
+        if ( offset + size <= m_Chunks[i].size )
+        {
+            m_Current = i;
+            m_Offset  = offset;
+            return true;
+        }
+    }
+
+    return AddChunk( Max( m_ChunkSize, size ) );
+}
+
+//-------------------------------------------------------------------------------------------------
+//      確保したメモリを全て無効にして先頭から使い直します.
+//-------------------------------------------------------------------------------------------------
+void Arena::Reset()
+{
+    if ( m_Chunks.size() > 1 )
+    {
+        size_t total = 0;
+        for(size_t i=0; i<m_Chunks.size(); ++i)
+        { total += m_Chunks[i].size; }
+
+        Term();
+        AddChunk( total );
+    }
+
+    m_Current  = 0;
+    m_Offset   = 0;
+    m_UsedSize = 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      全てのメモリを解放します.
+//-------------------------------------------------------------------------------------------------
+void Arena::Term()
+{
+    for(size_t i=0; i<m_Chunks.size(); ++i)
+    { _aligned_free( m_Chunks[i].pBuffer ); }
+
+    m_Chunks.clear();
+    m_Current  = 0;
+    m_Offset   = 0;
+    m_UsedSize = 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      確保済みのサイズを取得します.
+//-------------------------------------------------------------------------------------------------
+size_t Arena::GetUsedSize() const
+{ return m_UsedSize; }
+
+//-------------------------------------------------------------------------------------------------
+//      チャンクを追加します.
+//-------------------------------------------------------------------------------------------------
+bool Arena::AddChunk( size_t size )
+{
+    Chunk chunk;
+    chunk.pBuffer = static_cast<u8*>( _aligned_malloc( size, ChunkAlignment ) );
+    chunk.size    = size;
+
+    if ( chunk.pBuffer == nullptr )
+    { return false; }
+
+    m_Chunks.push_back( chunk );
+    m_Current = m_Chunks.size() - 1;
+    m_Offset  = 0;
+
+    return true;
+}
+
+} // namespace s3d
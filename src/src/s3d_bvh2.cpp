@@ -8,85 +8,10 @@
 // Includes
 //-------------------------------------------------------------------------------------------------
 #include <s3d_bvh2.h>
+#include <s3d_accel.h>
 #include <s3d_leaf.h>
-#include <s3d_bucket.h>
-#include <algorithm>
-
-
-namespace /* anonymous */ {
-
-//-------------------------------------------------------------------------------------------------
-// Constant Values.
-//-------------------------------------------------------------------------------------------------
-constexpr int BucketCount = 12;     //!< バケット数です.
-
-//-------------------------------------------------------------------------------------------------
-//      マージしたバウンディングボックスを生成します.
-//-------------------------------------------------------------------------------------------------
-s3d::BoundingBox CreateMergedBox( size_t count, s3d::IShape** ppShapes )
-{
-    if ( count == 0 || ppShapes == nullptr )
-    { return s3d::BoundingBox(); }
-
-    s3d::BoundingBox box = ppShapes[0]->GetBox();
-
-    for( size_t i=1; i<count; ++i )
-    { box = s3d::BoundingBox::Merge( box, ppShapes[i]->GetBox() ); }
-
-    return box;
-}
-
-//-------------------------------------------------------------------------------------------------
-//      中心座標をもとにバウンディングボックスを生成します.
-//-------------------------------------------------------------------------------------------------
-s3d::BoundingBox CreateCentroidBox( size_t count, s3d::IShape** ppShapes )
-{
-    if ( count == 0 || ppShapes == nullptr )
-    { return s3d::BoundingBox(); }
-
-    s3d::BoundingBox box( ppShapes[0]->GetCenter() );
-
-    for( size_t i=1; i<count; ++i )
-    { box = s3d::BoundingBox::Merge( box, ppShapes[i]->GetCenter() ); }
-
-    return box;
-}
-
-//-------------------------------------------------------------------------------------------------
-//      最長軸を取得します.
-//-------------------------------------------------------------------------------------------------
-int GetLongestAxis( const s3d::BoundingBox& box )
-{
-    auto vec = box.maxi - box.mini;
-
-    if (vec.x > vec.y && vec.x > vec.z)
-    { return 0; }
-    else if (vec.y > vec.z)
-    { return 1; }
-    else
-    { return 2; }
-}
-
-//-------------------------------------------------------------------------------------------------
-//      オフセットを求めます.
-//-------------------------------------------------------------------------------------------------
-s3d::Vector3 CalcOffset( const s3d::BoundingBox& box, const s3d::Vector3& p )
-{
-    auto offset = p - box.mini;
-
-    if (box.maxi.x > box.mini.x)
-    { offset.x /= box.maxi.x - box.mini.x; }
-
-    if (box.maxi.y > box.mini.y)
-    { offset.y /= box.maxi.y - box.mini.y; }
-
-    if (box.maxi.z > box.mini.z)
-    { offset.z /= box.maxi.z - box.mini.z; }
-
-    return offset;
-}
-
-} // namespace /* anonymous */
+#include <s3d_bvhbuilder.h>
+#include <ppl.h>
 
 
 namespace s3d {
@@ -142,7 +67,8 @@ u32 BVH2::GetCount() const
 //-------------------------------------------------------------------------------------------------
 bool BVH2::IsHit( const RaySet& raySet, HitRecord& record ) const
 {
-    if ( !m_Box.IsHit( raySet.ray ) )
+    auto distance = ( Accel::GetTraversalOrder() == TRAVERSAL_ORDER_NEAREST ) ? record.distance : F_HIT_MAX;
+    if ( !m_Box.IsHit( raySet, distance ) )
     { return false; }
 
     auto hit = false;
@@ -152,6 +78,18 @@ bool BVH2::IsHit( const RaySet& raySet, HitRecord& record ) const
     return hit;
 }
 
+//-------------------------------------------------------------------------------------------------
+//      遮蔽判定を行います.
+//-------------------------------------------------------------------------------------------------
+bool BVH2::IsOccluded( const RaySet& raySet, f32 distance ) const
+{
+    if ( !m_Box.IsHit( raySet, distance ) )
+    { return false; }
+
+    return m_pNode[0]->IsOccluded( raySet, distance )
+        || m_pNode[1]->IsOccluded( raySet, distance );
+}
+
 //-------------------------------------------------------------------------------------------------
 //      バウンディングボックスを取得します.
 //-------------------------------------------------------------------------------------------------
@@ -173,104 +111,41 @@ Vector3 BVH2::GetCenter() const
 //-------------------------------------------------------------------------------------------------
 IShape* BVH2::Create( size_t count, IShape** ppShapes )
 {
-    // 最小要素に満たないものは葉ノードとして生成.  2つのノードがそれぞれ子供をもつので 2 * 2 = 4 が最小.
-    if ( count <= 4 )
-    { return Leaf::Create(count, ppShapes); }
-
-    auto bound = CreateMergedBox( count, ppShapes );
-
-    // バウンディングボックスを生成.
-    auto centroid = CreateCentroidBox( count, ppShapes );
-
-    // 分割軸を決めるためバウンディングボックスの最長軸を取得.
-    auto axis = GetLongestAxis( centroid );
-
-    if (centroid.maxi.a[axis] == centroid.mini.a[axis])
-    { return Leaf::Create(count, ppShapes); }
-
-    // SAH分割バケットの初期化処理.
-    Bucket bucket[BucketCount];
-    for (size_t i=0; i<count; ++i)
-    {
-        auto idx = static_cast<int>(BucketCount * CalcOffset( centroid, ppShapes[i]->GetCenter() ).a[axis]);
-
-        if ( idx == BucketCount ) 
-        { idx = BucketCount - 1; }
-        assert( 0 <= idx && idx < BucketCount );
-
-        bucket[idx].count++;
-        bucket[idx].box = BoundingBox::Merge( bucket[idx].box, ppShapes[i]->GetBox() );
-    }
-
-    // 分割後の各バケットに対するコストを計算する.
-    f32 cost[BucketCount - 1];
-    for (auto i=0; i<BucketCount - 1; ++i)
-    {
-        BoundingBox b0, b1;
-        int count0 = 0, count1 = 0;
-
-        for(auto j=0; j<=i; ++j)
-        {
-            b0 = BoundingBox::Merge(b0, bucket[j].box);
-            count0 += bucket[j].count;
-        }
-
-        for(auto j=i+1; j<BucketCount; ++j)
-        {
-            b1 = BoundingBox::Merge(b1, bucket[j].box);
-            count1 += bucket[j].count;
-        }
+    BVHBuilder builder( count, ppShapes );
+    return Create( builder, 0, count );
+}
 
-        cost[i] = 1 + (count0 * SurfaceArea(b0) + count1 * SurfaceArea(b1)) / SurfaceArea(bound);
-    }
+//-------------------------------------------------------------------------------------------------
+//      指定範囲の形状から生成処理を行います.
+//-------------------------------------------------------------------------------------------------
+IShape* BVH2::Create( BVHBuilder& builder, size_t offset, size_t count )
+{
+    // 最小要素に満たないものは葉ノードとして生成.  2つのノードがそれぞれ子供をもつので 2 * 2 = 4 が最小.
+    size_t mid = 0;
+    if ( !builder.SplitSAH( offset, count, 4, mid ) )
+    { return Leaf::Create(count, builder.GetShapes( offset )); }
 
-    // 最小SAHで分割のためのバケットを求める.
-    f32 minCost = cost[0];
-    int minCostSplitBucket = 0;
-    for(auto i=1; i<BucketCount - 1; ++i)
-    {
-        if (cost[i] < minCost)
-        {
-            minCost = cost[i];
-            minCostSplitBucket = i;
-        }
-    }
+    auto bound = builder.GetBox( offset, count );
 
-    auto mid = count / 2;
+    auto cnt0 = mid;
+    auto cnt1 = count - mid;
 
-    // 選択されたSAHバケットにおいて葉ノードを生成するか，分割するかどうかを決定する.
-    f32 leafCost = static_cast<f32>(count);
-    if (minCost < leafCost)
+    // 再帰呼び出し. 大きな部分木は別タスクで構築する.
+    IShape* pShape0 = nullptr;
+    IShape* pShape1 = nullptr;
+    if ( BVHBuilder::IsParallel( count ) )
     {
-        auto pMid = std::partition(
-            &ppShapes[0],
-            &ppShapes[count - 1] + 1,
-            [=](const IShape* pShape)
-            {
-                auto idx = BucketCount * CalcOffset(centroid, pShape->GetCenter()).a[axis];
-                if ( idx == BucketCount )
-                { idx = BucketCount - 1; }
-                assert( 0 <= idx && idx < BucketCount );
-
-                return idx <= minCostSplitBucket;
-            });
-
-        mid = pMid - &ppShapes[0];
+        concurrency::parallel_invoke(
+            [&] { pShape0 = BVH2::Create(builder, offset,       cnt0); },
+            [&] { pShape1 = BVH2::Create(builder, offset + mid, cnt1); });
     }
     else
     {
-        // 最小コスト満たすものがなかったら葉ノードとする.
-        return Leaf::Create(count, ppShapes);
+        pShape0 = BVH2::Create(builder, offset,       cnt0);
+        pShape1 = BVH2::Create(builder, offset + mid, cnt1);
     }
 
-    auto cnt0 = mid;
-    auto cnt1 = count - mid;
-
-    // 再帰呼び出し.
-    return new BVH2(
-        BVH2::Create(cnt0, &ppShapes[0]),
-        BVH2::Create(cnt1, &ppShapes[mid]),
-        bound);
+    return new BVH2( pShape0, pShape1, bound );
 }
 
 } // namespace s3d
@@ -9,85 +9,16 @@
 //-------------------------------------------------------------------------------------------------
 #include <s3d_bvh2.h>
 #include <s3d_bvh4.h>
-#include <s3d_bucket.h>
+#include <s3d_accel.h>
+#include <s3d_bvhbuilder.h>
 #include <s3d_leaf.h>
 #include <algorithm>
+#include <ppl.h>
 
 
 
 namespace /* anonymous */ {
 
-//-------------------------------------------------------------------------------------------------
-// Constant Values.
-//-------------------------------------------------------------------------------------------------
-constexpr int BucketCount = 16;     //!< バケット数です.
-
-//-------------------------------------------------------------------------------------------------
-//      マージしたバウンディングボックスを生成します.
-//-------------------------------------------------------------------------------------------------
-s3d::BoundingBox CreateMergedBox( size_t count, s3d::IShape** ppShapes )
-{
-    if ( count == 0 || ppShapes == nullptr )
-    { return s3d::BoundingBox(); }
-
-    s3d::BoundingBox box = ppShapes[0]->GetBox();
-
-    for( size_t i=1; i<count; ++i )
-    { box = s3d::BoundingBox::Merge( box, ppShapes[i]->GetBox() ); }
-
-    return box;
-}
-
-//-------------------------------------------------------------------------------------------------
-//      中心座標をもとにバウンディングボックスを生成します.
-//-------------------------------------------------------------------------------------------------
-s3d::BoundingBox CreateCentroidBox( size_t count, s3d::IShape** ppShapes )
-{
-    if ( count == 0 || ppShapes == nullptr )
-    { return s3d::BoundingBox(); }
-
-    s3d::BoundingBox box( ppShapes[0]->GetCenter() );
-
-    for( size_t i=1; i<count; ++i )
-    { box = s3d::BoundingBox::Merge( box, ppShapes[i]->GetCenter() ); }
-
-    return box;
-}
-
-//-------------------------------------------------------------------------------------------------
-//      最長軸を取得します.
-//-------------------------------------------------------------------------------------------------
-int GetLongestAxis( const s3d::BoundingBox& box )
-{
-    auto vec = box.maxi - box.mini;
-
-    if (vec.x > vec.y && vec.x > vec.z)
-    { return 0; }
-    else if (vec.y > vec.z)
-    { return 1; }
-    else
-    { return 2; }
-}
-
-//-------------------------------------------------------------------------------------------------
-//      オフセットを求めます.
-//-------------------------------------------------------------------------------------------------
-s3d::Vector3 CalcOffset( const s3d::BoundingBox& box, const s3d::Vector3& p )
-{
-    auto offset = p - box.mini;
-
-    if (box.maxi.x > box.mini.x)
-    { offset.x /= box.maxi.x - box.mini.x; }
-
-    if (box.maxi.y > box.mini.y)
-    { offset.y /= box.maxi.y - box.mini.y; }
-
-    if (box.maxi.z > box.mini.z)
-    { offset.z /= box.maxi.z - box.mini.z; }
-
-    return offset;
-}
-
 //-------------------------------------------------------------------------------------------------
 //      葉ノードを生成します.
 //-------------------------------------------------------------------------------------------------
@@ -173,21 +104,63 @@ u32 BVH4::GetCount() const
 //-------------------------------------------------------------------------------------------------
 bool BVH4::IsHit( const RaySet& raySet, HitRecord& record ) const
 {
-    s32 mask = 0;
-    if ( !m_Box.IsHit( raySet.ray4, mask ) )
+    auto nearest  = ( Accel::GetTraversalOrder() == TRAVERSAL_ORDER_NEAREST );
+    auto distance = ( nearest ) ? record.distance : F_HIT_MAX;
+
+    s32  mask = 0;
+    b128 tnear;
+    if ( !m_Box.IsHit( raySet, distance, mask, tnear ) )
     { return false; }
 
-    auto hit = false;
-    for ( auto i=0; i<4; ++i )
+    S3D_ALIGN(16) f32 dist[4];
+    _mm_store_ps( dist, tnear );
+
+    u32 order[4];
+    u32 count = 0;
+    for ( u32 i=0; i<4; ++i )
     {
         auto bit = 0x1 << i;
         if ( (mask & bit) == bit )
-        { hit |= m_pNode[i]->IsHit( raySet, record ); }
+        { order[count++] = i; }
+    }
+
+    if ( nearest )
+    { SortByDistance( count, order, dist ); }
+
+    auto hit = false;
+    for ( u32 i=0; i<count; ++i )
+    {
+        // 先に見つかった交差より遠い子ノードは判定しない.
+        if ( nearest && dist[order[i]] > record.distance )
+        { continue; }
+
+        hit |= m_pNode[order[i]]->IsHit( raySet, record );
     }
 
     return hit;
 }
 
+//-------------------------------------------------------------------------------------------------
+//      遮蔽判定を行います.
+//-------------------------------------------------------------------------------------------------
+bool BVH4::IsOccluded( const RaySet& raySet, f32 distance ) const
+{
+    s32  mask = 0;
+    b128 tnear;
+    if ( !m_Box.IsHit( raySet, distance, mask, tnear ) )
+    { return false; }
+
+    // 最近接である必要は無いので，並び替えずに見つかった時点で打ち切る.
+    for ( u32 i=0; i<4; ++i )
+    {
+        auto bit = 0x1 << i;
+        if ( (mask & bit) == bit && m_pNode[i]->IsOccluded( raySet, distance ) )
+        { return true; }
+    }
+
+    return false;
+}
+
 //-------------------------------------------------------------------------------------------------
 //      バウンディングボックスを取得します.
 //-------------------------------------------------------------------------------------------------
@@ -234,147 +207,26 @@ void BVH4::operator delete[] (void* ptr)
 //-------------------------------------------------------------------------------------------------
 //      SAH分割します.
 //-------------------------------------------------------------------------------------------------
-bool BVH4::SplitSAH( size_t count, IShape** ppShapes, size_t& mid )
-{
-    // 最小要素に満たないものは葉ノードとして生成.  2つのノードがそれぞれ子供をもつので 2 * 2 = 4 が最小.
-    if ( count <= 4 )
-    { return false; }
-
-    auto bound = CreateMergedBox( count, ppShapes );
-
-    // バウンディングボックスを生成.
-    auto centroid = CreateCentroidBox( count, ppShapes );
-
-    // 分割軸を決めるためバウンディングボックスの最長軸を取得.
-    auto axis = GetLongestAxis( centroid );
-
-    if (centroid.maxi.a[axis] == centroid.mini.a[axis])
-    { return false; }
-
-    // SAH分割バケットの初期化処理.
-    Bucket bucket[BucketCount];
-    for (size_t i=0; i<count; ++i)
-    {
-        auto idx = static_cast<int>(BucketCount * CalcOffset( centroid, ppShapes[i]->GetCenter() ).a[axis]);
-
-        if ( idx == BucketCount ) 
-        { idx = BucketCount - 1; }
-        assert( 0 <= idx && idx < BucketCount );
-
-        bucket[idx].count++;
-        bucket[idx].box = BoundingBox::Merge( bucket[idx].box, ppShapes[i]->GetBox() );
-    }
-
-    // 分割後の各バケットに対するコストを計算する.
-    f32 cost[BucketCount - 1];
-    for (auto i=0; i<BucketCount - 1; ++i)
-    {
-        BoundingBox b0, b1;
-        int count0 = 0, count1 = 0;
-
-        for(auto j=0; j<=i; ++j)
-        {
-            b0 = BoundingBox::Merge(b0, bucket[j].box);
-            count0 += bucket[j].count;
-        }
-
-        for(auto j=i+1; j<BucketCount; ++j)
-        {
-            b1 = BoundingBox::Merge(b1, bucket[j].box);
-            count1 += bucket[j].count;
-        }
-
-        cost[i] = 1 + (count0 * SurfaceArea(b0) + count1 * SurfaceArea(b1)) / SurfaceArea(bound);
-    }
-
-    // 最小SAHで分割のためのバケットを求める.
-    f32 minCost = cost[0];
-    int minCostSplitBucket = 0;
-    for(auto i=1; i<BucketCount - 1; ++i)
-    {
-        if (cost[i] < minCost)
-        {
-            minCost = cost[i];
-            minCostSplitBucket = i;
-        }
-    }
-
-    // 選択されたSAHバケットにおいて葉ノードを生成するか，分割するかどうかを決定する.
-    f32 leafCost = static_cast<f32>(count);
-    if (minCost < leafCost)
-    {
-        auto pMid = std::partition(
-            &ppShapes[0],
-            &ppShapes[count - 1] + 1,
-            [=](const IShape* pShape)
-            {
-                auto idx = BucketCount * CalcOffset(centroid, pShape->GetCenter()).a[axis];
-                if ( idx == BucketCount )
-                { idx = BucketCount - 1; }
-                assert( 0 <= idx && idx < BucketCount );
-
-                return idx <= minCostSplitBucket;
-            });
-
-        mid = pMid - &ppShapes[0];
-    }
-    else
-    { return false; }
-
-    return true;
-}
+bool BVH4::SplitSAH( BVHBuilder& builder, size_t offset, size_t count, size_t& mid )
+{ return builder.SplitSAH( offset, count, 4, mid ); }
 
 //-------------------------------------------------------------------------------------------------
 //      中間分割します.
 //-------------------------------------------------------------------------------------------------
-bool BVH4::SplitMid( size_t count, IShape** ppShapes, size_t& mid )
-{
-    // 最小要素に満たないものは葉ノードとして生成.  2つのノードがそれぞれ子供をもつので 2 * 2 = 4 が最小.
-    if ( count <= 2 )
-    { return false; }
-
-    auto bound = CreateMergedBox( count, ppShapes );
-
-    // バウンディングボックスを生成.
-    auto centroid = CreateCentroidBox( count, ppShapes );
-
-    // 分割軸を決めるためバウンディングボックスの最長軸を取得.
-    auto axis = GetLongestAxis( centroid );
-
-    if (centroid.maxi.a[axis] == centroid.mini.a[axis])
-    { return false; }
-
-    mid = 0;
-    for (size_t i=0; i<count; ++i)
-    {
-        auto center = ppShapes[i]->GetBox().center;
-
-        if (center.a[axis] < centroid.center.a[axis])
-        {
-            auto pTemp = ppShapes[i];
-            ppShapes[i] = ppShapes[mid];
-            ppShapes[mid] = pTemp;
-            mid++;
-        }
-    }
-
-    if ( mid == 0 || mid == count )
-    { mid = count / 2; }
-
-    return true;
-}
+bool BVH4::SplitMid( BVHBuilder& builder, size_t offset, size_t count, size_t& mid )
+{ return builder.SplitMid( offset, count, mid ); }
 
 //-------------------------------------------------------------------------------------------------
 //      分割します.
 //-------------------------------------------------------------------------------------------------
-bool BVH4::Split(size_t count, IShape** ppShapes, size_t& mid)
+bool BVH4::Split( BVHBuilder& builder, size_t offset, size_t count, size_t& mid )
 {
 #if 1
     // SAHによる分割.
-    return SplitSAH(count, ppShapes, mid);
+    return SplitSAH( builder, offset, count, mid );
 #else
     // 中間値による分割.
-    return SplitMid(count, ppShapes, mid);
+    return SplitMid( builder, offset, count, mid );
 #endif
 }
 
@@ -383,11 +235,22 @@ bool BVH4::Split(size_t count, IShape** ppShapes, size_t& mid)
 //-------------------------------------------------------------------------------------------------
 IShape* BVH4::Create(size_t count, IShape** ppShapes)
 {
+    BVHBuilder builder( count, ppShapes );
+    return Create( builder, 0, count );
+}
+
+//-------------------------------------------------------------------------------------------------
+//      指定範囲の形状から生成処理を行います.
+//-------------------------------------------------------------------------------------------------
+IShape* BVH4::Create(BVHBuilder& builder, size_t offset, size_t count)
+{
+    auto ppShapes = builder.GetShapes( offset );
+
     if ( count <= 4 )
     { return CreateNode(count, ppShapes); }
 
     size_t mid = 0;
-    if ( !Split( count, ppShapes, mid ) )
+    if ( !Split( builder, offset, count, mid ) )
     { return CreateNode(count, ppShapes); }
 
     auto idxL = 0;
@@ -399,10 +262,10 @@ IShape* BVH4::Create(size_t count, IShape** ppShapes)
     size_t midL = 0;
     size_t midR = 0;
 
-    if ( !Split( countL, &ppShapes[idxL], midL ) )
+    if ( !Split( builder, offset + idxL, countL, midL ) )
     { return CreateNode(count, ppShapes); }
 
-    if ( !Split( countR, &ppShapes[idxR], midR ) )
+    if ( !Split( builder, offset + idxR, countR, midR ) )
     { return CreateNode(count, ppShapes); }
 
     auto idx0 = 0;
@@ -415,11 +278,23 @@ IShape* BVH4::Create(size_t count, IShape** ppShapes)
     auto count2 = idx3  - idx2;
     auto count3 = count - idx3;
 
-    return new BVH4(
-        BVH4::Create(count0, &ppShapes[idx0]),
-        BVH4::Create(count1, &ppShapes[idx1]),
-        BVH4::Create(count2, &ppShapes[idx2]),
-        BVH4::Create(count3, &ppShapes[idx3]) );
+    const size_t index [4] = { offset + idx0, offset + idx1, offset + idx2, offset + idx3 };
+    const size_t counts[4] = { count0, count1, count2, count3 };
+
+    // 大きな部分木は別タスクで構築する. 各部分木が触る形状の範囲は重ならない.
+    IShape* pChild[4] = {};
+    if ( BVHBuilder::IsParallel( count ) )
+    {
+        concurrency::parallel_for<size_t>( 0, 4, [&](size_t i)
+        { pChild[i] = BVH4::Create( builder, index[i], counts[i] ); });
+    }
+    else
+    {
+        for(size_t i=0; i<4; ++i)
+        { pChild[i] = BVH4::Create( builder, index[i], counts[i] ); }
+    }
+
+    return new BVH4( pChild[0], pChild[1], pChild[2], pChild[3] );
 }
 
 
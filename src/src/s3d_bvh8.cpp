@@ -10,84 +10,15 @@
 #include <s3d_bvh8.h>
 #include <s3d_bvh4.h>
 #include <s3d_bvh2.h>
-#include <s3d_bucket.h>
+#include <s3d_accel.h>
+#include <s3d_bvhbuilder.h>
 #include <s3d_leaf.h>
 #include <algorithm>
+#include <ppl.h>
 
 
 namespace /* anonymous */ {
 
-//-------------------------------------------------------------------------------------------------
-// Constant Values.
-//-------------------------------------------------------------------------------------------------
-constexpr int BucketCount = 16;     //!< バケット数です.
-
-//-------------------------------------------------------------------------------------------------
-//      マージしたバウンディングボックスを生成します.
-//-------------------------------------------------------------------------------------------------
-s3d::BoundingBox CreateMergedBox( size_t count, s3d::IShape** ppShapes )
-{
-    if ( count == 0 || ppShapes == nullptr )
-    { return s3d::BoundingBox(); }
-
-    s3d::BoundingBox box = ppShapes[0]->GetBox();
-
-    for( size_t i=1; i<count; ++i )
-    { box = s3d::BoundingBox::Merge( box, ppShapes[i]->GetBox() ); }
-
-    return box;
-}
-
-//-------------------------------------------------------------------------------------------------
-//      中心座標をもとにバウンディングボックスを生成します.
-//-------------------------------------------------------------------------------------------------
-s3d::BoundingBox CreateCentroidBox( size_t count, s3d::IShape** ppShapes )
-{
-    if ( count == 0 || ppShapes == nullptr )
-    { return s3d::BoundingBox(); }
-
-    s3d::BoundingBox box( ppShapes[0]->GetCenter() );
-
-    for( size_t i=1; i<count; ++i )
-    { box = s3d::BoundingBox::Merge( box, ppShapes[i]->GetCenter() ); }
-
-    return box;
-}
-
-//-------------------------------------------------------------------------------------------------
-//      最長軸を取得します.
-//-------------------------------------------------------------------------------------------------
-int GetLongestAxis( const s3d::BoundingBox& box )
-{
-    auto vec = box.maxi - box.mini;
-
-    if (vec.x > vec.y && vec.x > vec.z)
-    { return 0; }
-    else if (vec.y > vec.z)
-    { return 1; }
-    else
-    { return 2; }
-}
-
-//-------------------------------------------------------------------------------------------------
-//      オフセットを求めます.
-//-------------------------------------------------------------------------------------------------
-s3d::Vector3 CalcOffset( const s3d::BoundingBox& box, const s3d::Vector3& p )
-{
-    auto offset = p - box.mini;
-
-    if (box.maxi.x > box.mini.x)
-    { offset.x /= box.maxi.x - box.mini.x; }
-
-    if (box.maxi.y > box.mini.y)
-    { offset.y /= box.maxi.y - box.mini.y; }
-
-    if (box.maxi.z > box.mini.z)
-    { offset.z /= box.maxi.z - box.mini.z; }
-
-    return offset;
-}
-
 //-------------------------------------------------------------------------------------------------
 //      葉ノードを生成します.
 //-------------------------------------------------------------------------------------------------
@@ -190,21 +121,63 @@ u32 BVH8::GetCount() const
 //-------------------------------------------------------------------------------------------------
 bool BVH8::IsHit( const RaySet& raySet, HitRecord& record ) const
 {
-    s32 mask = 0;
-    if ( !m_Box.IsHit( raySet.ray8, mask ) )
+    auto nearest  = ( Accel::GetTraversalOrder() == TRAVERSAL_ORDER_NEAREST );
+    auto distance = ( nearest ) ? record.distance : F_HIT_MAX;
+
+    s32  mask = 0;
+    b256 tnear;
+    if ( !m_Box.IsHit( raySet, distance, mask, tnear ) )
     { return false; }
 
-    auto hit = false;
-    for (auto i=0; i<8; ++i)
+    S3D_ALIGN(32) f32 dist[8];
+    _mm256_store_ps( dist, tnear );
+
+    u32 order[8];
+    u32 count = 0;
+    for ( u32 i=0; i<8; ++i )
     {
         auto bit = 0x1 << i;
         if ( (mask & bit) == bit )
-        { hit |= m_pNode[i]->IsHit( raySet, record ); }
+        { order[count++] = i; }
+    }
+
+    if ( nearest )
+    { SortByDistance( count, order, dist ); }
+
+    auto hit = false;
+    for ( u32 i=0; i<count; ++i )
+    {
+        // 先に見つかった交差より遠い子ノードは判定しない.
+        if ( nearest && dist[order[i]] > record.distance )
+        { continue; }
+
+        hit |= m_pNode[order[i]]->IsHit( raySet, record );
     }
 
     return hit;
 }
 
+//-------------------------------------------------------------------------------------------------
+//      遮蔽判定を行います.
+//-------------------------------------------------------------------------------------------------
+bool BVH8::IsOccluded( const RaySet& raySet, f32 distance ) const
+{
+    s32  mask = 0;
+    b256 tnear;
+    if ( !m_Box.IsHit( raySet, distance, mask, tnear ) )
+    { return false; }
+
+    // 最近接である必要は無いので，並び替えずに見つかった時点で打ち切る.
+    for ( u32 i=0; i<8; ++i )
+    {
+        auto bit = 0x1 << i;
+        if ( (mask & bit) == bit && m_pNode[i]->IsOccluded( raySet, distance ) )
+        { return true; }
+    }
+
+    return false;
+}
+
 //-------------------------------------------------------------------------------------------------
 //      バウンディングボックスを取得します.
 //-------------------------------------------------------------------------------------------------
@@ -251,147 +224,26 @@ void BVH8::operator delete[] (void* ptr)
 //-------------------------------------------------------------------------------------------------
 //      SAH分割します.
 //-------------------------------------------------------------------------------------------------
-bool BVH8::SplitSAH( size_t count, IShape** ppShapes, size_t& mid )
-{
-    // 最小要素に満たないものは葉ノードとして生成
-    if ( count <= 8 )
-    { return false; }
-
-    auto bound = CreateMergedBox( count, ppShapes );
-
-    // バウンディングボックスを生成.
-    auto centroid = CreateCentroidBox( count, ppShapes );
-
-    // 分割軸を決めるためバウンディングボックスの最長軸を取得.
-    auto axis = GetLongestAxis( centroid );
-
-    if (centroid.maxi.a[axis] == centroid.mini.a[axis])
-    { return false; }
-
-    // SAH分割バケットの初期化処理.
-    Bucket bucket[BucketCount];
-    for (size_t i=0; i<count; ++i)
-    {
-        auto idx = static_cast<int>(BucketCount * CalcOffset( centroid, ppShapes[i]->GetCenter() ).a[axis]);
-
-        if ( idx == BucketCount ) 
-        { idx = BucketCount - 1; }
-        assert( 0 <= idx && idx < BucketCount );
-
-        bucket[idx].count++;
-        bucket[idx].box = BoundingBox::Merge( bucket[idx].box, ppShapes[i]->GetBox() );
-    }
-
-    // 分割後の各バケットに対するコストを計算する.
-    f32 cost[BucketCount - 1];
-    for (auto i=0; i<BucketCount - 1; ++i)
-    {
-        BoundingBox b0, b1;
-        int count0 = 0, count1 = 0;
-
-        for(auto j=0; j<=i; ++j)
-        {
-            b0 = BoundingBox::Merge(b0, bucket[j].box);
-            count0 += bucket[j].count;
-        }
-
-        for(auto j=i+1; j<BucketCount; ++j)
-        {
-            b1 = BoundingBox::Merge(b1, bucket[j].box);
-            count1 += bucket[j].count;
-        }
-
-        cost[i] = 1 + (count0 * SurfaceArea(b0) + count1 * SurfaceArea(b1)) / SurfaceArea(bound);
-    }
-
-    // 最小SAHで分割のためのバケットを求める.
-    f32 minCost = cost[0];
-    int minCostSplitBucket = 0;
-    for(auto i=1; i<BucketCount - 1; ++i)
-    {
-        if (cost[i] < minCost)
-        {
-            minCost = cost[i];
-            minCostSplitBucket = i;
-        }
-    }
-
-    // 選択されたSAHバケットにおいて葉ノードを生成するか，分割するかどうかを決定する.
-    f32 leafCost = static_cast<f32>(count);
-    if (minCost < leafCost)
-    {
-        auto pMid = std::partition(
-            &ppShapes[0],
-            &ppShapes[count - 1] + 1,
-            [=](const IShape* pShape)
-            {
-                auto idx = BucketCount * CalcOffset(centroid, pShape->GetCenter()).a[axis];
-                if ( idx == BucketCount )
-                { idx = BucketCount - 1; }
-                assert( 0 <= idx && idx < BucketCount );
-
-                return idx <= minCostSplitBucket;
-            });
-
-        mid = pMid - &ppShapes[0];
-    }
-    else
-    { return false; }
-
-    return true;
-}
+bool BVH8::SplitSAH( BVHBuilder& builder, size_t offset, size_t count, size_t& mid )
+{ return builder.SplitSAH( offset, count, 8, mid ); }
 
 //-------------------------------------------------------------------------------------------------
 //      中間分割します.
 //-------------------------------------------------------------------------------------------------
-bool BVH8::SplitMid( size_t count, IShape** ppShapes, size_t& mid )
-{
-    // 最小要素に満たないものは葉ノードとして生成.  2つのノードがそれぞれ子供をもつので 2 * 2 = 4 が最小.
-    if ( count <= 2 )
-    { return false; }
-
-    auto bound = CreateMergedBox( count, ppShapes );
-
-    // バウンディングボックスを生成.
-    auto centroid = CreateCentroidBox( count, ppShapes );
-
-    // 分割軸を決めるためバウンディングボックスの最長軸を取得.
-    auto axis = GetLongestAxis( centroid );
-
-    if (centroid.maxi.a[axis] == centroid.mini.a[axis])
-    { return false; }
-
-    mid = 0;
-    for (size_t i=0; i<count; ++i)
-    {
-        auto center = ppShapes[i]->GetBox().center;
-
-        if (center.a[axis] < centroid.center.a[axis])
-        {
-            auto pTemp = ppShapes[i];
-            ppShapes[i] = ppShapes[mid];
-            ppShapes[mid] = pTemp;
-            mid++;
-        }
-    }
-
-    if ( mid == 0 || mid == count )
-    { mid = count / 2; }
-
-    return true;
-}
+bool BVH8::SplitMid( BVHBuilder& builder, size_t offset, size_t count, size_t& mid )
+{ return builder.SplitMid( offset, count, mid ); }
 
 //------------------------------------------------------------------------------------------------
 //      分割します.
 //------------------------------------------------------------------------------------------------
-bool BVH8::Split( size_t count, IShape** ppShapes, size_t& mid )
+bool BVH8::Split( BVHBuilder& builder, size_t offset, size_t count, size_t& mid )
 {
 #if 1
     // SAHによる分割.
-    return SplitSAH( count, ppShapes, mid );
+    return SplitSAH( builder, offset, count, mid );
 #else
     // 中間値による分割.
-    return SplitMid( count, ppShapes, mid );
+    return SplitMid( builder, offset, count, mid );
 #endif
 }
 
@@ -400,11 +252,22 @@ bool BVH8::Split( size_t count, IShape** ppShapes, size_t& mid )
 //-------------------------------------------------------------------------------------------------
 IShape* BVH8::Create(size_t count, IShape** ppShapes)
 {
+    BVHBuilder builder( count, ppShapes );
+    return Create( builder, 0, count );
+}
+
+//-------------------------------------------------------------------------------------------------
+//      指定範囲の形状から生成処理を行います.
+//-------------------------------------------------------------------------------------------------
+IShape* BVH8::Create(BVHBuilder& builder, size_t offset, size_t count)
+{
+    auto ppShapes = builder.GetShapes( offset );
+
     if ( count <= 8 )
     { return CreateNode( count, ppShapes ); }
 
     size_t mid = 0;
-    if ( !Split( count, ppShapes, mid ) )
+    if ( !Split( builder, offset, count, mid ) )
     { return CreateNode( count, ppShapes ); }
 
     auto idxL = 0;
@@ -416,10 +279,10 @@ IShape* BVH8::Create(size_t count, IShape** ppShapes)
     size_t midL = 0;
     size_t midR = 0;
 
-    if ( !Split( countL, &ppShapes[idxL], midL ) )
+    if ( !Split( builder, offset + idxL, countL, midL ) )
     { return CreateNode( count, ppShapes ); }
 
-    if ( !Split( countR, &ppShapes[idxR], midR ) )
+    if ( !Split( builder, offset + idxR, countR, midR ) )
     { return CreateNode( count, ppShapes ); }
 
     auto idxA = 0;
@@ -437,16 +300,16 @@ IShape* BVH8::Create(size_t count, IShape** ppShapes)
     size_t mid2 = 0;
     size_t mid3 = 0;
 
-    if ( !Split( countA, &ppShapes[idxA], mid0 ) )
+    if ( !Split( builder, offset + idxA, countA, mid0 ) )
     { return CreateNode( count, ppShapes ); }
 
-    if ( !Split( countB, &ppShapes[idxB], mid1 ) )
+    if ( !Split( builder, offset + idxB, countB, mid1 ) )
     { return CreateNode( count, ppShapes ); }
 
-    if ( !Split( countC, &ppShapes[idxC], mid2 ) )
+    if ( !Split( builder, offset + idxC, countC, mid2 ) )
     { return CreateNode( count, ppShapes ); }
 
-    if ( !Split( countD, &ppShapes[idxD], mid3 ) )
+    if ( !Split( builder, offset + idxD, countD, mid3 ) )
     { return CreateNode( count, ppShapes ); }
 
     auto idx0 = 0;
@@ -467,15 +330,23 @@ IShape* BVH8::Create(size_t count, IShape** ppShapes)
     auto count6 = idx7  - idx6;
     auto count7 = count - idx7;
 
-    return new BVH8(
-        BVH8::Create(count0, &ppShapes[idx0]),
-        BVH8::Create(count1, &ppShapes[idx1]),
-        BVH8::Create(count2, &ppShapes[idx2]),
-        BVH8::Create(count3, &ppShapes[idx3]),
-        BVH8::Create(count4, &ppShapes[idx4]),
-        BVH8::Create(count5, &ppShapes[idx5]),
-        BVH8::Create(count6, &ppShapes[idx6]),
-        BVH8::Create(count7, &ppShapes[idx7]));
+    const size_t index [8] = { offset + idx0, offset + idx1, offset + idx2, offset + idx3, offset + idx4, offset + idx5, offset + idx6, offset + idx7 };
+    const size_t counts[8] = { count0, count1, count2, count3, count4, count5, count6, count7 };
+
+    // 大きな部分木は別タスクで構築する. 各部分木が触る形状の範囲は重ならない.
+    IShape* pChild[8] = {};
+    if ( BVHBuilder::IsParallel( count ) )
+    {
+        concurrency::parallel_for<size_t>( 0, 8, [&](size_t i)
+        { pChild[i] = BVH8::Create( builder, index[i], counts[i] ); });
+    }
+    else
+    {
+        for(size_t i=0; i<8; ++i)
+        { pChild[i] = BVH8::Create( builder, index[i], counts[i] ); }
+    }
+
+    return new BVH8( pChild[0], pChild[1], pChild[2], pChild[3], pChild[4], pChild[5], pChild[6], pChild[7] );
 }
 
 } // namespace s3d
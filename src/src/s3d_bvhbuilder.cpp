@@ -0,0 +1,1356 @@
+﻿//-------------------------------------------------------------------------------------------------
+// File : s3d_bvhbuilder.cpp
+// Desc : BVH Builder Module.
+// Copyright(c) Project Asura. All right reserved.
+//-------------------------------------------------------------------------------------------------
+
+//-------------------------------------------------------------------------------------------------
+// Includes
+//-------------------------------------------------------------------------------------------------
+#include <s3d_bvhbuilder.h>
+#include <s3d_bucket.h>
+#include <algorithm>
+#include <ppl.h>
+
+
+namespace /* anonymous */ {
+
+//-------------------------------------------------------------------------------------------------
+// Constant Values.
+//-------------------------------------------------------------------------------------------------
+constexpr size_t    ParallelBuildCount = 4096;      //!< 部分木の構築を別タスクに分ける最小形状数です.
+constexpr size_t    ParallelBinCount   = 65536;     //!< ビニングを並列化する最小形状数です.
+constexpr size_t    ChunkSize          = 16384;     //!< 並列処理で1タスクが担当する形状数です.
+constexpr s32       MinBucketCount     = 2;         //!< 最小バケット数です.
+constexpr s32       MaxBucketCount     = 32;        //!< 最大バケット数です.
+constexpr size_t    MortonSmallCount   = 65536;     //!< 30bitのモートン符号で十分とみなす形状数です.
+constexpr u32       RadixBits          = 8;         //!< 基数ソートの1パスで処理するビット数です.
+constexpr u32       RadixSize          = 1 << RadixBits;    //!< 基数ソートのバケット数です.
+constexpr u32       TreeletSize        = 7;         //!< 組み替える部分木の葉の数です.
+constexpr u32       TreeletSubsetCount = 1 << TreeletSize;  //!< 部分木の葉の組み合わせ数です.
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Bounds structure
+///////////////////////////////////////////////////////////////////////////////////////////////////
+struct Bounds
+{
+    f32     mini[3];        //!< バウンディングボックスの最小値です.
+    f32     maxi[3];        //!< バウンディングボックスの最大値です.
+    f32     cmin[3];        //!< 中心座標の最小値です.
+    f32     cmax[3];        //!< 中心座標の最大値です.
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      コンストラクタです.
+    //---------------------------------------------------------------------------------------------
+    Bounds()
+    {
+        for(auto i=0; i<3; ++i)
+        {
+            mini[i] = cmin[i] =  s3d::F_MAX;
+            maxi[i] = cmax[i] = -s3d::F_MAX;
+        }
+    }
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      マージします.
+    //---------------------------------------------------------------------------------------------
+    void Merge( const Bounds& value )
+    {
+        for(auto i=0; i<3; ++i)
+        {
+            mini[i] = s3d::Min( mini[i], value.mini[i] );
+            maxi[i] = s3d::Max( maxi[i], value.maxi[i] );
+            cmin[i] = s3d::Min( cmin[i], value.cmin[i] );
+            cmax[i] = s3d::Max( cmax[i], value.cmax[i] );
+        }
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Bin structure
+///////////////////////////////////////////////////////////////////////////////////////////////////
+struct Bin
+{
+    f32     mini[3];        //!< バウンディングボックスの最小値です.
+    f32     maxi[3];        //!< バウンディングボックスの最大値です.
+    u32     count;          //!< 形状数です.
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      コンストラクタです.
+    //---------------------------------------------------------------------------------------------
+    Bin()
+    : count( 0 )
+    {
+        for(auto i=0; i<3; ++i)
+        {
+            mini[i] =  s3d::F_MAX;
+            maxi[i] = -s3d::F_MAX;
+        }
+    }
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      マージします.
+    //---------------------------------------------------------------------------------------------
+    void Merge( const Bin& value )
+    {
+        for(auto i=0; i<3; ++i)
+        {
+            mini[i] = s3d::Min( mini[i], value.mini[i] );
+            maxi[i] = s3d::Max( maxi[i], value.maxi[i] );
+        }
+        count += value.count;
+    }
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      表面積を求めます.
+    //---------------------------------------------------------------------------------------------
+    f32 GetArea() const
+    {
+        if ( count == 0 )
+        { return 0.0f; }
+
+        auto x = maxi[0] - mini[0];
+        auto y = maxi[1] - mini[1];
+        auto z = maxi[2] - mini[2];
+        return 2.0f * ( x * y + y * z + z * x );
+    }
+};
+
+//-------------------------------------------------------------------------------------------------
+//      チャンク数を求めます.
+//-------------------------------------------------------------------------------------------------
+size_t GetChunkCount( size_t count )
+{ return ( count + ChunkSize - 1 ) / ChunkSize; }
+
+//-------------------------------------------------------------------------------------------------
+//      チャンク毎に並列処理した結果をマージします.
+//-------------------------------------------------------------------------------------------------
+template<typename Type, typename Func>
+Type ReduceParallel( size_t offset, size_t count, Func func )
+{
+    if ( count < ParallelBinCount )
+    {
+        Type result;
+        func( offset, count, result );
+        return result;
+    }
+
+    auto chunkCount = GetChunkCount( count );
+    std::vector<Type> values( chunkCount );
+
+    concurrency::parallel_for<size_t>( 0, chunkCount, [&](size_t i)
+    {
+        auto begin = i * ChunkSize;
+        auto size  = std::min( ChunkSize, count - begin );
+        func( offset + begin, size, values[i] );
+    });
+
+    // 最小値・最大値と個数のマージは順序に依存しないので逐次処理と同じ結果になる.
+    auto result = values[0];
+    for( size_t i=1; i<chunkCount; ++i )
+    { result.Merge( values[i] ); }
+
+    return result;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      最長軸を取得します.
+//-------------------------------------------------------------------------------------------------
+int GetLongestAxis( const s3d::BoundingBox& box )
+{
+    auto vec = box.maxi - box.mini;
+
+    if (vec.x > vec.y && vec.x > vec.z)
+    { return 0; }
+    else if (vec.y > vec.z)
+    { return 1; }
+    else
+    { return 2; }
+}
+
+//-------------------------------------------------------------------------------------------------
+//      中心座標からバケット番号を求めます.
+//-------------------------------------------------------------------------------------------------
+S3D_INLINE
+s32 GetBucket( f32 center, f32 mini, f32 scale, s32 bucketCount )
+{
+    auto idx = static_cast<s32>( ( center - mini ) * scale );
+    return s3d::Clamp( idx, 0, bucketCount - 1 );
+}
+
+//-------------------------------------------------------------------------------------------------
+//      10bitの値を3bit間隔に展開します.
+//-------------------------------------------------------------------------------------------------
+S3D_INLINE
+u64 ExpandBits10( u32 value )
+{
+    u64 x = value & 0x3ff;
+    x = ( x | ( x << 16 ) ) & 0x030000ff;
+    x = ( x | ( x <<  8 ) ) & 0x0300f00f;
+    x = ( x | ( x <<  4 ) ) & 0x030c30c3;
+    x = ( x | ( x <<  2 ) ) & 0x09249249;
+    return x;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      21bitの値を3bit間隔に展開します.
+//-------------------------------------------------------------------------------------------------
+S3D_INLINE
+u64 ExpandBits21( u32 value )
+{
+    u64 x = value & 0x1fffff;
+    x = ( x | ( x << 32 ) ) & 0x1f00000000ffffull;
+    x = ( x | ( x << 16 ) ) & 0x1f0000ff0000ffull;
+    x = ( x | ( x <<  8 ) ) & 0x100f00f00f00f00full;
+    x = ( x | ( x <<  4 ) ) & 0x10c30c30c30c30c3ull;
+    x = ( x | ( x <<  2 ) ) & 0x1249249249249249ull;
+    return x;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      先頭から連続する0のビット数を求めます.
+//-------------------------------------------------------------------------------------------------
+S3D_INLINE
+u32 CountLeadingZeros( u64 value )
+{
+    if ( value == 0 )
+    { return 64; }
+
+    u32 count = 0;
+    if ( ( value & 0xffffffff00000000ull ) == 0 ) { count += 32; value <<= 32; }
+    if ( ( value & 0xffff000000000000ull ) == 0 ) { count += 16; value <<= 16; }
+    if ( ( value & 0xff00000000000000ull ) == 0 ) { count +=  8; value <<=  8; }
+    if ( ( value & 0xf000000000000000ull ) == 0 ) { count +=  4; value <<=  4; }
+    if ( ( value & 0xc000000000000000ull ) == 0 ) { count +=  2; value <<=  2; }
+    if ( ( value & 0x8000000000000000ull ) == 0 ) { count +=  1; }
+    return count;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      キーと値の組をキーの昇順に並列基数ソートします.
+//-------------------------------------------------------------------------------------------------
+void RadixSort( std::vector<u64>& keys, std::vector<u32>& values, u32 bits )
+{
+    auto count      = keys.size();
+    auto chunkCount = GetChunkCount( count );
+
+    std::vector<u64> tempKeys  ( count );
+    std::vector<u32> tempValues( count );
+    std::vector<u32> histogram ( chunkCount * RadixSize );
+
+    for(u32 shift=0; shift<bits; shift+=RadixBits)
+    {
+        // チャンク毎にヒストグラムを求める.
+        concurrency::parallel_for<size_t>( 0, chunkCount, [&](size_t i)
+        {
+            auto pHist = &histogram[i * RadixSize];
+            std::fill( pHist, pHist + RadixSize, 0 );
+
+            auto begin = i * ChunkSize;
+            auto end   = std::min( begin + ChunkSize, count );
+            for(auto j=begin; j<end; ++j)
+            { pHist[ ( keys[j] >> shift ) & ( RadixSize - 1 ) ]++; }
+        });
+
+        // 桁の値，チャンクの順に並べた書き込み位置に変換する.
+        u32 offset = 0;
+        for(u32 digit=0; digit<RadixSize; ++digit)
+        {
+            for(size_t i=0; i<chunkCount; ++i)
+            {
+                auto value = histogram[i * RadixSize + digit];
+                histogram[i * RadixSize + digit] = offset;
+                offset += value;
+            }
+        }
+
+        // チャンク内の順序を保ったまま書き込むので安定ソートになる.
+        concurrency::parallel_for<size_t>( 0, chunkCount, [&](size_t i)
+        {
+            auto pHist = &histogram[i * RadixSize];
+
+            auto begin = i * ChunkSize;
+            auto end   = std::min( begin + ChunkSize, count );
+            for(auto j=begin; j<end; ++j)
+            {
+                auto dst = pHist[ ( keys[j] >> shift ) & ( RadixSize - 1 ) ]++;
+                tempKeys  [dst] = keys  [j];
+                tempValues[dst] = values[j];
+            }
+        });
+
+        keys  .swap( tempKeys );
+        values.swap( tempValues );
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+//      組み替えた部分木のノードを出力します.
+//-------------------------------------------------------------------------------------------------
+s32 EmitTreelet
+(
+    std::vector<s3d::BuildNode>&    nodes,
+    const s32*                      leaves,
+    const s32*                      internals,
+    const s3d::BoundingBox*         boxes,
+    const u32*                      partition,
+    u32                             set,
+    u32&                            used
+)
+{
+    // 葉が1つだけの集合は部分木の葉そのもの.
+    if ( ( set & ( set - 1 ) ) == 0 )
+    {
+        u32 leafIndex = 0;
+        while ( ( set >> leafIndex ) != 1 )
+        { leafIndex++; }
+        return leaves[leafIndex];
+    }
+
+    auto index = internals[used++];
+    auto left  = EmitTreelet( nodes, leaves, internals, boxes, partition, partition[set],       used );
+    auto right = EmitTreelet( nodes, leaves, internals, boxes, partition, set ^ partition[set], used );
+
+    auto& node = nodes[index];
+    node.box      = boxes[set];
+    node.child[0] = left;
+    node.child[1] = right;
+    // 組み替えた後の内部ノードの形状は連続した範囲にならないので，オフセットは無効にする.
+    node.offset   = ~0u;
+    node.count    = nodes[left].count + nodes[right].count;
+
+    return index;
+}
+
+} // namespace /* anonymous */
+
+
+namespace s3d {
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// BVHBuilder class
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------------------------------
+//      部分木の構築を並列化するかどうかを判定します.
+//-------------------------------------------------------------------------------------------------
+bool BVHBuilder::IsParallel( size_t count )
+{ return count >= ParallelBuildCount; }
+
+//-------------------------------------------------------------------------------------------------
+//      コンストラクタです.
+//-------------------------------------------------------------------------------------------------
+BVHBuilder::BVHBuilder( size_t count, IShape** ppShapes )
+: m_ppShapes( ppShapes )
+, m_Config  ( Accel::GetBuildConfig() )
+{
+    m_Config.bucketCount = Clamp( m_Config.bucketCount, MinBucketCount, MaxBucketCount );
+
+    for(auto i=0; i<3; ++i)
+    {
+        m_Mini  [i].resize( count );
+        m_Maxi  [i].resize( count );
+        m_Center[i].resize( count );
+    }
+
+    // 仮想関数の呼び出しは形状毎にここで1回ずつだけ行う.
+    auto fetch = [&](size_t begin, size_t size)
+    {
+        for(auto i=begin; i<begin + size; ++i)
+        {
+            auto box    = m_ppShapes[i]->GetBox();
+            auto center = m_ppShapes[i]->GetCenter();
+            for(auto j=0; j<3; ++j)
+            {
+                m_Mini  [j][i] = box.mini.a[j];
+                m_Maxi  [j][i] = box.maxi.a[j];
+                m_Center[j][i] = center.a[j];
+            }
+        }
+    };
+
+    if ( count < ParallelBinCount )
+    {
+        fetch( 0, count );
+        return;
+    }
+
+    concurrency::parallel_for<size_t>( 0, GetChunkCount( count ), [&](size_t i)
+    {
+        auto begin = i * ChunkSize;
+        fetch( begin, std::min( ChunkSize, count - begin ) );
+    });
+}
+
+//-------------------------------------------------------------------------------------------------
+//      形状配列を取得します.
+//-------------------------------------------------------------------------------------------------
+IShape** BVHBuilder::GetShapes( size_t offset ) const
+{ return &m_ppShapes[offset]; }
+
+//-------------------------------------------------------------------------------------------------
+//      指定範囲の形状をマージしたバウンディングボックスを取得します.
+//-------------------------------------------------------------------------------------------------
+BoundingBox BVHBuilder::GetBox( size_t offset, size_t count ) const
+{
+    BoundingBox bound;
+    BoundingBox centroid;
+    CalcBounds( offset, count, bound, centroid );
+    return bound;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      指定範囲のバウンディングボックスと中心座標のバウンディングボックスを求めます.
+//-------------------------------------------------------------------------------------------------
+void BVHBuilder::CalcBounds( size_t offset, size_t count, BoundingBox& bound, BoundingBox& centroid ) const
+{
+    if ( count == 0 )
+    {
+        bound    = BoundingBox();
+        centroid = BoundingBox();
+        return;
+    }
+
+    auto result = ReduceParallel<Bounds>( offset, count, [&](size_t begin, size_t size, Bounds& value)
+    {
+        for(auto i=begin; i<begin + size; ++i)
+        {
+            for(auto j=0; j<3; ++j)
+            {
+                value.mini[j] = Min( value.mini[j], m_Mini  [j][i] );
+                value.maxi[j] = Max( value.maxi[j], m_Maxi  [j][i] );
+                value.cmin[j] = Min( value.cmin[j], m_Center[j][i] );
+                value.cmax[j] = Max( value.cmax[j], m_Center[j][i] );
+            }
+        }
+    });
+
+    bound = BoundingBox(
+        Vector3( result.mini[0], result.mini[1], result.mini[2] ),
+        Vector3( result.maxi[0], result.maxi[1], result.maxi[2] ) );
+
+    centroid = BoundingBox(
+        Vector3( result.cmin[0], result.cmin[1], result.cmin[2] ),
+        Vector3( result.cmax[0], result.cmax[1], result.cmax[2] ) );
+}
+
+//-------------------------------------------------------------------------------------------------
+//      形状とキャッシュした値を入れ替えます.
+//-------------------------------------------------------------------------------------------------
+void BVHBuilder::Swap( size_t a, size_t b )
+{
+    std::swap( m_ppShapes[a], m_ppShapes[b] );
+    for(auto i=0; i<3; ++i)
+    {
+        std::swap( m_Mini  [i][a], m_Mini  [i][b] );
+        std::swap( m_Maxi  [i][a], m_Maxi  [i][b] );
+        std::swap( m_Center[i][a], m_Center[i][b] );
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+//      3軸すべてのビンを評価してSAH分割します.
+//-------------------------------------------------------------------------------------------------
+bool BVHBuilder::SplitSAH( size_t offset, size_t count, size_t leafCount, size_t& mid )
+{
+    // 最小要素に満たないものは葉ノードとして生成
+    if ( count <= leafCount )
+    { return false; }
+
+    BoundingBox bound;
+    BoundingBox centroid;
+    CalcBounds( offset, count, bound, centroid );
+
+    const auto bucketCount = m_Config.bucketCount;
+
+    // 中心座標が1点に縮退している軸はビンに分けられないので評価しない.
+    f32  scale[3];
+    auto valid = false;
+    for(auto i=0; i<3; ++i)
+    {
+        auto extent = centroid.maxi.a[i] - centroid.mini.a[i];
+        scale[i] = ( extent > 0.0f ) ? bucketCount / extent : 0.0f;
+        valid |= ( extent > 0.0f );
+    }
+
+    if ( !valid )
+    { return false; }
+
+    // 3軸分のビンに同時に振り分ける.
+    struct Bins
+    {
+        Bin bin[3][MaxBucketCount];
+
+        void Merge( const Bins& value )
+        {
+            for(auto i=0; i<3; ++i)
+            {
+                for(auto j=0; j<MaxBucketCount; ++j)
+                { bin[i][j].Merge( value.bin[i][j] ); }
+            }
+        }
+    };
+
+    auto bins = ReduceParallel<Bins>( offset, count, [&](size_t begin, size_t size, Bins& value)
+    {
+        for(auto i=begin; i<begin + size; ++i)
+        {
+            for(auto axis=0; axis<3; ++axis)
+            {
+                auto idx = GetBucket( m_Center[axis][i], centroid.mini.a[axis], scale[axis], bucketCount );
+                auto& bin = value.bin[axis][idx];
+                bin.count++;
+                for(auto j=0; j<3; ++j)
+                {
+                    bin.mini[j] = Min( bin.mini[j], m_Mini[j][i] );
+                    bin.maxi[j] = Max( bin.maxi[j], m_Maxi[j][i] );
+                }
+            }
+        }
+    });
+
+    auto area    = SurfaceArea( bound );
+    auto invArea = ( area > 0.0f ) ? 1.0f / area : 0.0f;
+
+    // 右側からの累積で各分割位置の右側の表面積と形状数を求め，左側からの累積でコストを評価する.
+    f32 minCost   = F_MAX;
+    s32 bestAxis  = -1;
+    s32 bestSplit = -1;
+    for(auto axis=0; axis<3; ++axis)
+    {
+        if ( scale[axis] == 0.0f )
+        { continue; }
+
+        const auto& bin = bins.bin[axis];
+
+        f32 rightArea [MaxBucketCount];
+        u32 rightCount[MaxBucketCount];
+
+        Bin right;
+        for(auto i=bucketCount - 1; i>0; --i)
+        {
+            right.Merge( bin[i] );
+            rightArea [i] = right.GetArea();
+            rightCount[i] = right.count;
+        }
+
+        Bin left;
+        for(auto i=0; i<bucketCount - 1; ++i)
+        {
+            left.Merge( bin[i] );
+
+            if ( left.count == 0 || rightCount[i + 1] == 0 )
+            { continue; }
+
+            auto cost = m_Config.costTraversal + m_Config.costIntersect
+                      * ( left.count * left.GetArea() + rightCount[i + 1] * rightArea[i + 1] ) * invArea;
+
+            if ( cost < minCost )
+            {
+                minCost   = cost;
+                bestAxis  = axis;
+                bestSplit = i;
+            }
+        }
+    }
+
+    // 選択された分割において葉ノードを生成するか，分割するかどうかを決定する.
+    auto leafCost = m_Config.costIntersect * count;
+    if ( bestAxis < 0 || minCost >= leafCost )
+    { return false; }
+
+    // ビニングと同じ式でバケット番号を求めて分割する.
+    auto i = offset;
+    auto j = offset + count;
+    while ( i < j )
+    {
+        auto idx = GetBucket( m_Center[bestAxis][i], centroid.mini.a[bestAxis], scale[bestAxis], bucketCount );
+        if ( idx <= bestSplit )
+        { ++i; }
+        else
+        { Swap( i, --j ); }
+    }
+
+    mid = i - offset;
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      中間分割します.
+//-------------------------------------------------------------------------------------------------
+bool BVHBuilder::SplitMid( size_t offset, size_t count, size_t& mid )
+{
+    // 最小要素に満たないものは葉ノードとして生成.  2つのノードがそれぞれ子供をもつので 2 * 2 = 4 が最小.
+    if ( count <= 2 )
+    { return false; }
+
+    BoundingBox bound;
+    BoundingBox centroid;
+    CalcBounds( offset, count, bound, centroid );
+
+    // 分割軸を決めるためバウンディングボックスの最長軸を取得.
+    auto axis = GetLongestAxis( centroid );
+
+    if (centroid.maxi.a[axis] == centroid.mini.a[axis])
+    { return false; }
+
+    auto pivot = centroid.center.a[axis];
+
+    auto i = offset;
+    auto j = offset + count;
+    while ( i < j )
+    {
+        auto center = ( m_Mini[axis][i] + m_Maxi[axis][i] ) * 0.5f;
+        if ( center < pivot )
+        { ++i; }
+        else
+        { Swap( i, --j ); }
+    }
+
+    mid = i - offset;
+    if ( mid == 0 || mid == count )
+    { mid = count / 2; }
+
+    return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// SpatialBuilder::Split structure
+///////////////////////////////////////////////////////////////////////////////////////////////////
+struct SpatialBuilder::Split
+{
+    f32             cost;           //!< SAHコストです.
+    s32             axis;           //!< 分割軸です.
+    s32             bucket;         //!< 形状単位の分割で左側に含める最後のバケット番号です.
+    f32             position;       //!< 空間分割の平面の位置です.
+    f32             scale;          //!< 形状単位の分割でバケット番号を求める係数です.
+    f32             mini;           //!< 形状単位の分割でバケット番号を求める基準位置です.
+    BoundingBox     left;           //!< 左側のバウンディングボックスです.
+    BoundingBox     right;          //!< 右側のバウンディングボックスです.
+    u32             leftCount;      //!< 左側の参照数です.
+    u32             rightCount;     //!< 右側の参照数です.
+
+    //---------------------------------------------------------------------------------------------
+    //! @brief      コンストラクタです.
+    //---------------------------------------------------------------------------------------------
+    Split()
+    : cost      ( F_MAX )
+    , axis      ( -1 )
+    , bucket    ( -1 )
+    , position  ( 0.0f )
+    , scale     ( 0.0f )
+    , mini      ( 0.0f )
+    , left      ()
+    , right     ()
+    , leftCount ( 0 )
+    , rightCount( 0 )
+    { /* DO_NOTHING */ }
+};
+
+//-------------------------------------------------------------------------------------------------
+//      コンストラクタです.
+//-------------------------------------------------------------------------------------------------
+SpatialBuilder::SpatialBuilder( size_t count, IShape** ppShapes )
+: m_Config  ( Accel::GetBuildConfig() )
+, m_Budget  ( 0 )
+, m_RootArea( 0.0f )
+{
+    m_Config.bucketCount = Clamp( m_Config.bucketCount, MinBucketCount, MaxBucketCount );
+
+    m_Input.resize( count );
+    for(size_t i=0; i<count; ++i)
+    {
+        m_Input[i].pShape = ppShapes[i];
+        m_Input[i].box    = ppShapes[i]->GetBox();
+    }
+
+    m_Budget = static_cast<size_t>( count * Max( m_Config.spatialBudget, 0.0f ) );
+}
+
+//-------------------------------------------------------------------------------------------------
+//      空間分割を併用して二分木を構築します.
+//-------------------------------------------------------------------------------------------------
+s32 SpatialBuilder::Build( size_t leafSize, std::vector<BuildNode>& nodes )
+{
+    BoundingBox box;
+    for(size_t i=0; i<m_Input.size(); ++i)
+    { box = BoundingBox::Merge( box, m_Input[i].box ); }
+
+    m_RootArea = SurfaceArea( box );
+
+    nodes.clear();
+    m_Shapes.clear();
+    m_Boxes .clear();
+    m_Shapes.reserve( m_Input.size() + m_Budget );
+    m_Boxes .reserve( m_Input.size() + m_Budget );
+
+    return BuildRecursive( m_Input, box, leafSize, nodes );
+}
+
+//-------------------------------------------------------------------------------------------------
+//      葉ノードの順に並べた参照先の形状を取得します.
+//-------------------------------------------------------------------------------------------------
+const std::vector<IShape*>& SpatialBuilder::GetShapes() const
+{ return m_Shapes; }
+
+//-------------------------------------------------------------------------------------------------
+//      葉ノードの順に並べた参照のバウンディングボックスを取得します.
+//-------------------------------------------------------------------------------------------------
+const std::vector<BoundingBox>& SpatialBuilder::GetBoxes() const
+{ return m_Boxes; }
+
+//-------------------------------------------------------------------------------------------------
+//      ノードを再帰的に構築します.
+//-------------------------------------------------------------------------------------------------
+s32 SpatialBuilder::BuildRecursive
+(
+    std::vector<Reference>& refs,
+    const BoundingBox&      box,
+    size_t                  leafSize,
+    std::vector<BuildNode>& nodes
+)
+{
+    auto index = static_cast<s32>( nodes.size() );
+
+    BuildNode node;
+    node.box      = box;
+    node.child[0] = -1;
+    node.child[1] = -1;
+    node.offset   = static_cast<u32>( m_Shapes.size() );
+    node.count    = static_cast<u32>( refs.size() );
+    nodes.push_back( node );
+
+    if ( refs.size() <= leafSize )
+    {
+        for(size_t i=0; i<refs.size(); ++i)
+        {
+            m_Shapes.push_back( refs[i].pShape );
+            m_Boxes .push_back( refs[i].box );
+        }
+        return index;
+    }
+
+    std::vector<Reference> left;
+    std::vector<Reference> right;
+
+    Split objectSplit;
+    auto validObject = FindObjectSplit( refs, box, objectSplit );
+
+    // 子ノードの重なりが大きい場合のみ空間分割を試す.
+    Split spatialSplit;
+    auto validSpatial = false;
+    if ( m_Budget > 0 && m_RootArea > 0.0f )
+    {
+        auto overlap = BoundingBox::Intersect( objectSplit.left, objectSplit.right );
+        if ( !validObject || SurfaceArea( overlap ) / m_RootArea > m_Config.spatialAlpha )
+        { validSpatial = FindSpatialSplit( refs, box, spatialSplit ); }
+    }
+
+    auto count = refs.size();
+    if ( validSpatial && spatialSplit.cost < objectSplit.cost
+      && spatialSplit.leftCount + spatialSplit.rightCount - count <= m_Budget )
+    {
+        const auto axis = spatialSplit.axis;
+        const auto pos  = spatialSplit.position;
+
+        for(size_t i=0; i<count; ++i)
+        {
+            const auto& ref = refs[i];
+            if ( ref.box.maxi.a[axis] <= pos )
+            { left.push_back( ref ); }
+            else if ( ref.box.mini.a[axis] >= pos )
+            { right.push_back( ref ); }
+            else
+            {
+                // 分割平面をまたぐ参照は形状に沿って切り分けて両側に登録する.
+                Reference l = { ref.pShape, BoundingBox() };
+                Reference r = { ref.pShape, BoundingBox() };
+                ref.pShape->SplitBox( axis, pos, ref.box, &l.box, &r.box );
+
+                if ( !l.box.empty )
+                { left.push_back( l ); }
+
+                if ( !r.box.empty )
+                { right.push_back( r ); }
+            }
+        }
+
+        // 参照数が減らない場合は形状単位の分割に切り替える.
+        if ( left.empty() || right.empty() || left.size() >= count || right.size() >= count )
+        {
+            left .clear();
+            right.clear();
+        }
+        else
+        {
+            auto duplicated = left.size() + right.size() - count;
+            m_Budget -= Min( duplicated, m_Budget );
+        }
+    }
+
+    if ( left.empty() )
+    {
+        if ( validObject )
+        {
+            const auto axis = objectSplit.axis;
+            for(size_t i=0; i<count; ++i)
+            {
+                auto idx = GetBucket( refs[i].box.center.a[axis], objectSplit.mini, objectSplit.scale, m_Config.bucketCount );
+                if ( idx <= objectSplit.bucket )
+                { left.push_back( refs[i] ); }
+                else
+                { right.push_back( refs[i] ); }
+            }
+        }
+
+        // 分割できない場合も葉ノードの要素数を超えないように半分に分ける.
+        if ( left.empty() || right.empty() )
+        {
+            left .assign( refs.begin(), refs.begin() + count / 2 );
+            right.assign( refs.begin() + count / 2, refs.end() );
+        }
+    }
+
+    // 子ノードの構築中に参照配列を保持しないように解放する.
+    std::vector<Reference>().swap( refs );
+
+    BoundingBox leftBox;
+    for(size_t i=0; i<left.size(); ++i)
+    { leftBox = BoundingBox::Merge( leftBox, left[i].box ); }
+
+    BoundingBox rightBox;
+    for(size_t i=0; i<right.size(); ++i)
+    { rightBox = BoundingBox::Merge( rightBox, right[i].box ); }
+
+    auto childL = BuildRecursive( left,  leftBox,  leafSize, nodes );
+    auto childR = BuildRecursive( right, rightBox, leafSize, nodes );
+
+    nodes[index].child[0] = childL;
+    nodes[index].child[1] = childR;
+    nodes[index].count    = static_cast<u32>( m_Shapes.size() ) - nodes[index].offset;
+
+    return index;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      形状単位の分割を探索します.
+//-------------------------------------------------------------------------------------------------
+bool SpatialBuilder::FindObjectSplit( const std::vector<Reference>& refs, const BoundingBox& box, Split& result ) const
+{
+    const auto bucketCount = m_Config.bucketCount;
+
+    BoundingBox centroid;
+    for(size_t i=0; i<refs.size(); ++i)
+    { centroid = BoundingBox::Merge( centroid, refs[i].box.center ); }
+
+    auto area    = SurfaceArea( box );
+    auto invArea = ( area > 0.0f ) ? 1.0f / area : 0.0f;
+
+    for(auto axis=0; axis<3; ++axis)
+    {
+        auto extent = centroid.maxi.a[axis] - centroid.mini.a[axis];
+        if ( extent <= 0.0f )
+        { continue; }
+
+        auto scale = bucketCount / extent;
+
+        Bucket bucket[MaxBucketCount];
+        for(size_t i=0; i<refs.size(); ++i)
+        {
+            auto idx = GetBucket( refs[i].box.center.a[axis], centroid.mini.a[axis], scale, bucketCount );
+            bucket[idx].count++;
+            bucket[idx].box = BoundingBox::Merge( bucket[idx].box, refs[i].box );
+        }
+
+        BoundingBox rightBox  [MaxBucketCount];
+        u32         rightCount[MaxBucketCount];
+
+        Bucket right;
+        for(auto i=bucketCount - 1; i>0; --i)
+        {
+            right.count += bucket[i].count;
+            right.box    = BoundingBox::Merge( right.box, bucket[i].box );
+            rightBox  [i] = right.box;
+            rightCount[i] = right.count;
+        }
+
+        Bucket left;
+        for(auto i=0; i<bucketCount - 1; ++i)
+        {
+            left.count += bucket[i].count;
+            left.box    = BoundingBox::Merge( left.box, bucket[i].box );
+
+            if ( left.count == 0 || rightCount[i + 1] == 0 )
+            { continue; }
+
+            auto cost = m_Config.costTraversal + m_Config.costIntersect
+                      * ( left.count * SurfaceArea( left.box ) + rightCount[i + 1] * SurfaceArea( rightBox[i + 1] ) ) * invArea;
+
+            if ( cost < result.cost )
+            {
+                result.cost       = cost;
+                result.axis       = axis;
+                result.bucket     = i;
+                result.scale      = scale;
+                result.mini       = centroid.mini.a[axis];
+                result.left       = left.box;
+                result.right      = rightBox[i + 1];
+                result.leftCount  = left.count;
+                result.rightCount = rightCount[i + 1];
+            }
+        }
+    }
+
+    return result.axis >= 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      空間分割を探索します.
+//-------------------------------------------------------------------------------------------------
+bool SpatialBuilder::FindSpatialSplit( const std::vector<Reference>& refs, const BoundingBox& box, Split& result ) const
+{
+    const auto bucketCount = m_Config.bucketCount;
+
+    auto area    = SurfaceArea( box );
+    auto invArea = ( area > 0.0f ) ? 1.0f / area : 0.0f;
+
+    for(auto axis=0; axis<3; ++axis)
+    {
+        auto extent = box.maxi.a[axis] - box.mini.a[axis];
+        if ( extent <= 0.0f )
+        { continue; }
+
+        auto origin = box.mini.a[axis];
+        auto width  = extent / bucketCount;
+        auto scale  = bucketCount / extent;
+
+        // 参照が入るバケットと出るバケットを数え，またがるバケットには切り分けた範囲をマージする.
+        Bucket bucket[MaxBucketCount];
+        u32    enter [MaxBucketCount] = {};
+        u32    exit  [MaxBucketCount] = {};
+
+        for(size_t i=0; i<refs.size(); ++i)
+        {
+            const auto& ref = refs[i];
+            auto first = GetBucket( ref.box.mini.a[axis], origin, scale, bucketCount );
+            auto last  = GetBucket( ref.box.maxi.a[axis], origin, scale, bucketCount );
+
+            enter[first]++;
+            exit [last ]++;
+
+            auto piece = ref.box;
+            for(auto j=first; j<last; ++j)
+            {
+                BoundingBox l;
+                BoundingBox r;
+                ref.pShape->SplitBox( axis, origin + width * ( j + 1 ), piece, &l, &r );
+
+                bucket[j].box = BoundingBox::Merge( bucket[j].box, l );
+                piece = r;
+            }
+
+            bucket[last].box = BoundingBox::Merge( bucket[last].box, piece );
+        }
+
+        BoundingBox rightBox  [MaxBucketCount];
+        u32         rightCount[MaxBucketCount];
+
+        Bucket right;
+        for(auto i=bucketCount - 1; i>0; --i)
+        {
+            right.count += exit[i];
+            right.box    = BoundingBox::Merge( right.box, bucket[i].box );
+            rightBox  [i] = right.box;
+            rightCount[i] = right.count;
+        }
+
+        Bucket left;
+        for(auto i=0; i<bucketCount - 1; ++i)
+        {
+            left.count += enter[i];
+            left.box    = BoundingBox::Merge( left.box, bucket[i].box );
+
+            if ( left.count == 0 || rightCount[i + 1] == 0 )
+            { continue; }
+
+            auto cost = m_Config.costTraversal + m_Config.costIntersect
+                      * ( left.count * SurfaceArea( left.box ) + rightCount[i + 1] * SurfaceArea( rightBox[i + 1] ) ) * invArea;
+
+            if ( cost < result.cost )
+            {
+                result.cost       = cost;
+                result.axis       = axis;
+                result.position   = origin + width * ( i + 1 );
+                result.left       = left.box;
+                result.right      = rightBox[i + 1];
+                result.leftCount  = left.count;
+                result.rightCount = rightCount[i + 1];
+            }
+        }
+    }
+
+    return result.axis >= 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// LinearBuilder class
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------------------------------
+//      コンストラクタです.
+//-------------------------------------------------------------------------------------------------
+LinearBuilder::LinearBuilder( size_t count, IShape** ppShapes )
+: m_ppShapes ( ppShapes )
+, m_Count    ( count )
+, m_NodeCount( 0 )
+{ /* DO_NOTHING */ }
+
+//-------------------------------------------------------------------------------------------------
+//      中心座標のモートン符号から二分木を構築します.
+//-------------------------------------------------------------------------------------------------
+s32 LinearBuilder::Build( size_t leafSize, std::vector<BuildNode>& nodes )
+{
+    auto count = m_Count;
+
+    std::vector<BoundingBox> boxes  ( count );
+    std::vector<Vector3>     centers( count );
+
+    // 仮想関数の呼び出しは形状毎にここで1回ずつだけ行う.
+    concurrency::parallel_for<size_t>( 0, GetChunkCount( count ), [&](size_t i)
+    {
+        auto begin = i * ChunkSize;
+        auto end   = std::min( begin + ChunkSize, count );
+        for(auto j=begin; j<end; ++j)
+        {
+            boxes  [j] = m_ppShapes[j]->GetBox();
+            centers[j] = m_ppShapes[j]->GetCenter();
+        }
+    });
+
+    auto centroid = ReduceParallel<Bounds>( 0, count, [&](size_t begin, size_t size, Bounds& value)
+    {
+        for(auto i=begin; i<begin + size; ++i)
+        {
+            for(auto j=0; j<3; ++j)
+            {
+                value.cmin[j] = Min( value.cmin[j], centers[i].a[j] );
+                value.cmax[j] = Max( value.cmax[j], centers[i].a[j] );
+            }
+        }
+    });
+
+    // 形状数が少なければ30bit，多ければ63bitのモートン符号を使う.
+    auto axisBits = ( count <= MortonSmallCount ) ? 10u : 21u;
+    auto gridSize = static_cast<f32>( 1u << axisBits );
+
+    f32 scale[3];
+    for(auto i=0; i<3; ++i)
+    {
+        auto extent = centroid.cmax[i] - centroid.cmin[i];
+        scale[i] = ( extent > 0.0f ) ? gridSize / extent : 0.0f;
+    }
+
+    std::vector<u64> codes  ( count );
+    std::vector<u32> indices( count );
+
+    concurrency::parallel_for<size_t>( 0, GetChunkCount( count ), [&](size_t i)
+    {
+        auto begin = i * ChunkSize;
+        auto end   = std::min( begin + ChunkSize, count );
+        for(auto j=begin; j<end; ++j)
+        {
+            u32 q[3];
+            for(auto k=0; k<3; ++k)
+            {
+                auto value = static_cast<s32>( ( centers[j].a[k] - centroid.cmin[k] ) * scale[k] );
+                q[k] = static_cast<u32>( Clamp( value, 0, static_cast<s32>( ( 1u << axisBits ) - 1 ) ) );
+            }
+
+            codes[j] = ( axisBits == 10 )
+                ? ( ExpandBits10( q[0] ) << 2 ) | ( ExpandBits10( q[1] ) << 1 ) | ExpandBits10( q[2] )
+                : ( ExpandBits21( q[0] ) << 2 ) | ( ExpandBits21( q[1] ) << 1 ) | ExpandBits21( q[2] );
+            indices[j] = static_cast<u32>( j );
+        }
+    });
+
+    RadixSort( codes, indices, axisBits * 3 );
+
+    // 形状とバウンディングボックスをモートン符号順に並べる.
+    std::vector<IShape*> shapes( m_ppShapes, m_ppShapes + count );
+    m_Boxes.resize( count );
+    for(size_t i=0; i<count; ++i)
+    {
+        m_ppShapes[i] = shapes[indices[i]];
+        m_Boxes   [i] = boxes [indices[i]];
+    }
+    m_Codes.swap( codes );
+
+    // 部分木を並列に構築するため，二分木のノード数の上限 2N-1 個を先に確保しておく.
+    nodes.resize( count * 2 );
+    m_NodeCount = 0;
+    auto root = BuildRecursive( 0, count, leafSize, nodes );
+    nodes.resize( m_NodeCount );
+
+    return root;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      ノードを再帰的に構築します.
+//-------------------------------------------------------------------------------------------------
+s32 LinearBuilder::BuildRecursive( size_t offset, size_t count, size_t leafSize, std::vector<BuildNode>& nodes )
+{
+    auto index = m_NodeCount++;
+
+    auto& node = nodes[index];
+    node.child[0] = -1;
+    node.child[1] = -1;
+    node.offset   = static_cast<u32>( offset );
+    node.count    = static_cast<u32>( count );
+
+    if ( count <= leafSize )
+    {
+        BoundingBox box;
+        for(auto i=offset; i<offset + count; ++i)
+        { box = BoundingBox::Merge( box, m_Boxes[i] ); }
+
+        node.box = box;
+        return index;
+    }
+
+    auto first = offset;
+    auto last  = offset + count - 1;
+
+    // 最上位の異なるビットで分かれる位置を二分探索する. 符号が全て同じなら半分に分ける.
+    auto mid = count / 2;
+    if ( m_Codes[first] != m_Codes[last] )
+    {
+        auto prefix = CountLeadingZeros( m_Codes[first] ^ m_Codes[last] );
+        auto split  = first;
+        auto step   = count - 1;
+        do
+        {
+            step = ( step + 1 ) >> 1;
+            auto next = split + step;
+            if ( next < last && CountLeadingZeros( m_Codes[first] ^ m_Codes[next] ) > prefix )
+            { split = next; }
+        }
+        while ( step > 1 );
+
+        mid = split - first + 1;
+    }
+
+    s32 left  = -1;
+    s32 right = -1;
+    if ( BVHBuilder::IsParallel( count ) )
+    {
+        concurrency::parallel_invoke(
+            [&] { left  = BuildRecursive( offset,       mid,         leafSize, nodes ); },
+            [&] { right = BuildRecursive( offset + mid, count - mid, leafSize, nodes ); });
+    }
+    else
+    {
+        left  = BuildRecursive( offset,       mid,         leafSize, nodes );
+        right = BuildRecursive( offset + mid, count - mid, leafSize, nodes );
+    }
+
+    node.child[0] = left;
+    node.child[1] = right;
+    node.box      = BoundingBox::Merge( nodes[left].box, nodes[right].box );
+
+    return index;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// TreeletOptimizer class
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------------------------------
+//      コンストラクタです.
+//-------------------------------------------------------------------------------------------------
+TreeletOptimizer::TreeletOptimizer()
+: m_Config( Accel::GetBuildConfig() )
+{ /* DO_NOTHING */ }
+
+//-------------------------------------------------------------------------------------------------
+//      二分木のSAHコストを求めます.
+//-------------------------------------------------------------------------------------------------
+f32 TreeletOptimizer::GetCost( const std::vector<BuildNode>& nodes, s32 root ) const
+{
+    auto rootArea = SurfaceArea( nodes[root].box );
+    if ( rootArea <= 0.0f )
+    { return 0.0f; }
+
+    f32 nodeArea = 0.0f;
+    f32 leafArea = 0.0f;
+
+    std::vector<s32> stack;
+    stack.push_back( root );
+
+    while ( !stack.empty() )
+    {
+        const auto& node = nodes[stack.back()];
+        stack.pop_back();
+
+        if ( node.child[0] < 0 )
+        {
+            leafArea += SurfaceArea( node.box ) * node.count;
+            continue;
+        }
+
+        nodeArea += SurfaceArea( node.box );
+        stack.push_back( node.child[0] );
+        stack.push_back( node.child[1] );
+    }
+
+    return ( m_Config.costTraversal * nodeArea + m_Config.costIntersect * leafArea ) / rootArea;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      部分木の組み替えによって二分木のSAHコストを下げます.
+//-------------------------------------------------------------------------------------------------
+void TreeletOptimizer::Optimize( std::vector<BuildNode>& nodes, s32 root, s32 iterationCount )
+{
+    for(auto i=0; i<iterationCount; ++i)
+    { OptimizeRecursive( nodes, root ); }
+}
+
+//-------------------------------------------------------------------------------------------------
+//      葉から根に向かって部分木を組み替えます.
+//-------------------------------------------------------------------------------------------------
+void TreeletOptimizer::OptimizeRecursive( std::vector<BuildNode>& nodes, s32 index )
+{
+    auto& node = nodes[index];
+    if ( node.child[0] < 0 )
+    { return; }
+
+    // 組み替えは指定ノードの部分木の中で閉じるので，兄弟の部分木は並列に処理できる.
+    auto left  = node.child[0];
+    auto right = node.child[1];
+    if ( BVHBuilder::IsParallel( node.count ) )
+    {
+        concurrency::parallel_invoke(
+            [&] { OptimizeRecursive( nodes, left  ); },
+            [&] { OptimizeRecursive( nodes, right ); });
+    }
+    else
+    {
+        OptimizeRecursive( nodes, left  );
+        OptimizeRecursive( nodes, right );
+    }
+
+    Restructure( nodes, index );
+}
+
+//-------------------------------------------------------------------------------------------------
+//      指定ノードを根とする部分木を最適な形に組み替えます.
+//-------------------------------------------------------------------------------------------------
+void TreeletOptimizer::Restructure( std::vector<BuildNode>& nodes, s32 index )
+{
+    s32 leaves   [TreeletSize];
+    s32 internals[TreeletSize - 1];
+    u32 leafCount     = 0;
+    u32 internalCount = 0;
+
+    internals[internalCount++] = index;
+    leaves[leafCount++] = nodes[index].child[0];
+    leaves[leafCount++] = nodes[index].child[1];
+
+    // 表面積が最大の内部ノードを展開して部分木の葉を増やします.
+    while ( leafCount < TreeletSize )
+    {
+        s32 best     = -1;
+        f32 bestArea = -1.0f;
+
+        for(u32 i=0; i<leafCount; ++i)
+        {
+            const auto& leaf = nodes[leaves[i]];
+            if ( leaf.child[0] < 0 )
+            { continue; }
+
+            auto area = SurfaceArea( leaf.box );
+            if ( area > bestArea )
+            {
+                bestArea = area;
+                best     = i;
+            }
+        }
+
+        if ( best < 0 )
+        { break; }
+
+        auto expand = leaves[best];
+        internals[internalCount++] = expand;
+        leaves[best]        = nodes[expand].child[0];
+        leaves[leafCount++] = nodes[expand].child[1];
+    }
+
+    // 2つの葉しか無い場合は組み替えようがない.
+    if ( leafCount < 3 )
+    { return; }
+
+    // 現在の形の内部ノードのコストです. 部分木の葉より下のコストは形によらないので含めない.
+    f32 currentCost = 0.0f;
+    for(u32 i=0; i<internalCount; ++i)
+    { currentCost += m_Config.costTraversal * SurfaceArea( nodes[internals[i]].box ); }
+
+    // 葉の全ての組み合わせについて最適な分け方を動的計画法で求めます.
+    BoundingBox boxes    [TreeletSubsetCount];
+    f32         costs    [TreeletSubsetCount];
+    u32         partition[TreeletSubsetCount];
+
+    auto fullSet = ( 1u << leafCount ) - 1;
+    for(u32 set=1; set<=fullSet; ++set)
+    {
+        // 最下位ビットの葉とそれ以外に分けてバウンディングボックスを求める.
+        auto lowest = set & ( ~set + 1 );
+        auto rest   = set ^ lowest;
+
+        u32 leafIndex = 0;
+        while ( ( lowest >> leafIndex ) != 1 )
+        { leafIndex++; }
+
+        if ( rest == 0 )
+        {
+            boxes[set]     = nodes[leaves[leafIndex]].box;
+            costs[set]     = 0.0f;
+            partition[set] = 0;
+            continue;
+        }
+
+        boxes[set] = BoundingBox::Merge( boxes[rest], nodes[leaves[leafIndex]].box );
+
+        // 左右を入れ替えた分け方は同じなので，最下位ビットの葉を含む側だけ列挙する.
+        auto bestCost = s3d::F_MAX;
+        u32  bestPart = lowest;
+        for(auto part = ( rest - 1 ) & rest; ; part = ( part - 1 ) & rest)
+        {
+            auto left = part | lowest;
+            if ( left != set )
+            {
+                auto cost = costs[left] + costs[set ^ left];
+                if ( cost < bestCost )
+                {
+                    bestCost = cost;
+                    bestPart = left;
+                }
+            }
+
+            if ( part == 0 )
+            { break; }
+        }
+
+        costs[set]     = m_Config.costTraversal * SurfaceArea( boxes[set] ) + bestCost;
+        partition[set] = bestPart;
+    }
+
+    // 誤差で組み替えを繰り返さないよう，明確に改善する場合のみ組み替える.
+    if ( costs[fullSet] >= currentCost * 0.9999f )
+    { return; }
+
+    // 根のノード番号を保ったまま，既存の内部ノードを再利用して組み替える.
+    u32 used = 0;
+    EmitTreelet( nodes, leaves, internals, boxes, partition, fullSet, used );
+}
+
+} // namespace s3d
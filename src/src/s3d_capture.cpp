@@ -0,0 +1,162 @@
+﻿//-------------------------------------------------------------------------------------------------
+// File : s3d_capture.cpp
+// Desc : Capture Module.
+// Copyright(c) Project Asura. All right reserved.
+//-------------------------------------------------------------------------------------------------
+
+//-------------------------------------------------------------------------------------------------
+// Includes
+//-------------------------------------------------------------------------------------------------
+#include <s3d_capture.h>
+#include <s3d_logger.h>
+#include <algorithm>
+#include <ppl.h>
+#include <stb_image_write.h>
+
+using namespace concurrency;
+
+
+namespace s3d {
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// CaptureWriter class
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------------------------------
+//      コンストラクタです.
+//-------------------------------------------------------------------------------------------------
+CaptureWriter::CaptureWriter()
+: m_Width   ( 0 )
+, m_Height  ( 0 )
+, m_Type    ( TONE_MAPPING_ACES_FILMIC )
+, m_Pending ( false )
+, m_Exit    ( false )
+{ /* DO_NOTHING */ }
+
+//-------------------------------------------------------------------------------------------------
+//      デストラクタです.
+//-------------------------------------------------------------------------------------------------
+CaptureWriter::~CaptureWriter()
+{ Term(); }
+
+//-------------------------------------------------------------------------------------------------
+//      初期化処理を行います.
+//-------------------------------------------------------------------------------------------------
+bool CaptureWriter::Init( s32 width, s32 height, TONE_MAPPING_TYPE type )
+{
+    Term();
+
+    if ( width <= 0 || height <= 0 )
+    { return false; }
+
+    auto size = width * height;
+
+    m_Width   = width;
+    m_Height  = height;
+    m_Type    = type;
+    m_Pending = false;
+    m_Exit    = false;
+
+    // 出力中に確保しないよう先に確保しておく.
+    for( auto& snapshot : m_Snapshot )
+    {
+        snapshot.radiance   .resize( size );
+        snapshot.sampleCount.resize( size );
+    }
+    m_Red    .resize( size );
+    m_Green  .resize( size );
+    m_Blue   .resize( size );
+    m_Outputs.resize( size * 3 );
+
+    m_Thread = std::thread( &CaptureWriter::WriterMain, this );
+
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      終了処理を行います.
+//-------------------------------------------------------------------------------------------------
+void CaptureWriter::Term()
+{
+    if ( !m_Thread.joinable() )
+    { return; }
+
+    {
+        std::lock_guard<std::mutex> locker( m_Mutex );
+        m_Exit = true;
+    }
+    m_Cond.notify_all();
+
+    m_Thread.join();
+}
+
+//-------------------------------------------------------------------------------------------------
+//      蓄積結果のスナップショットを取り，キャプチャーを依頼します.
+//-------------------------------------------------------------------------------------------------
+void CaptureWriter::Request( const char* filename, const Color3* pRadiance, const u32* pSampleCounts )
+{
+    if ( !m_Thread.joinable() )
+    { return; }
+
+    auto size = m_Width * m_Height;
+
+    {
+        // 出力スレッドは m_Snapshot[1] しか触らないので，依頼用のバッファに写すだけで済む.
+        std::lock_guard<std::mutex> locker( m_Mutex );
+        auto& snapshot = m_Snapshot[0];
+        snapshot.filename = filename;
+        std::copy( pRadiance,     pRadiance     + size, snapshot.radiance   .begin() );
+        std::copy( pSampleCounts, pSampleCounts + size, snapshot.sampleCount.begin() );
+        m_Pending = true;
+    }
+    m_Cond.notify_all();
+}
+
+//-------------------------------------------------------------------------------------------------
+//      出力スレッドのメイン関数です.
+//-------------------------------------------------------------------------------------------------
+void CaptureWriter::WriterMain()
+{
+    for(;;)
+    {
+        {
+            std::unique_lock<std::mutex> locker( m_Mutex );
+            m_Cond.wait( locker, [&]{ return m_Exit || m_Pending; } );
+
+            // 依頼済みのものは出力してから終了する.
+            if ( !m_Pending )
+            { return; }
+
+            std::swap( m_Snapshot[0], m_Snapshot[1] );
+            m_Pending = false;
+        }
+
+        Write( m_Snapshot[1] );
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+//      スナップショットをトーンマッピングしてPNGファイルに出力します.
+//-------------------------------------------------------------------------------------------------
+void CaptureWriter::Write( const Snapshot& snapshot )
+{
+    auto size = m_Width * m_Height;
+
+    // ピクセル毎にサンプル数が異なるので平均を求め，チャンネル毎に並べる.
+    parallel_for<size_t>(0, size, [&](size_t i)
+    {
+        auto count = static_cast<f32>( s3d::Max( snapshot.sampleCount[i], 1u ) );
+        m_Red  [i] = snapshot.radiance[i].x / count;
+        m_Green[i] = snapshot.radiance[i].y / count;
+        m_Blue [i] = snapshot.radiance[i].z / count;
+    });
+
+    // トーンマッピングからsRGB変換，8bit量子化までまとめて行う.
+    ToneMapper::MapToRGB8( m_Type, m_Width, m_Height, m_Red.data(), m_Green.data(), m_Blue.data(), m_Outputs.data() );
+
+    // PNG出力.
+    if ( !stbi_write_png( snapshot.filename.c_str(), m_Width, m_Height, 3, m_Outputs.data(), 0 ) )
+    { ELOG( "Error : stbi_write_png() Failed. filename = %s", snapshot.filename.c_str() ); }
+}
+
+} // namespace s3d
@@ -0,0 +1,230 @@
+﻿//-------------------------------------------------------------------------------------------------
+// File : s3d_checkpoint.cpp
+// Desc : Checkpoint Module.
+// Copyright(c) Project Asura. All right reserved.
+//-------------------------------------------------------------------------------------------------
+
+//-------------------------------------------------------------------------------------------------
+// Includes
+//-------------------------------------------------------------------------------------------------
+#include <s3d_checkpoint.h>
+#include <s3d_logger.h>
+#include <cstdio>
+#include <Windows.h>
+
+
+namespace /* anonymous */ {
+
+//-------------------------------------------------------------------------------------------------
+// Constant Values.
+//-------------------------------------------------------------------------------------------------
+const u32 CheckpointMagic   = 0x43443353;   // 'S3DC'
+const u32 CheckpointVersion = 1;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// CHECKPOINT_HEADER structure
+///////////////////////////////////////////////////////////////////////////////////////////////////
+struct CHECKPOINT_HEADER
+{
+    u32     Magic;          //!< ファイル識別子です.
+    u32     Version;        //!< ファイルバージョンです.
+    s32     Width;          //!< レンダーターゲットの横幅です.
+    s32     Height;         //!< レンダーターゲットの縦幅です.
+    u32     SamplerType;    //!< サンプラーの種類です.
+    f32     Threshold;      //!< 適応サンプリングの現在の閾値です.
+};
+
+} // namespace /* anonymous */
+
+
+namespace s3d {
+
+//-------------------------------------------------------------------------------------------------
+//      チェックポイントをファイルに保存します.
+//-------------------------------------------------------------------------------------------------
+bool SaveCheckpoint( const char* filename, const Checkpoint& checkpoint )
+{
+    size_t size = checkpoint.Width * checkpoint.Height;
+    if ( checkpoint.Radiance    .size() != size
+      || checkpoint.SampleCounts.size() != size
+      || checkpoint.Moments     .size() != size )
+    { return false; }
+
+    std::string temp = filename;
+    temp += ".tmp";
+
+    FILE* pFile;
+    errno_t err = fopen_s( &pFile, temp.c_str(), "wb" );
+    if ( err != 0 )
+    { return false; }
+
+    CHECKPOINT_HEADER header;
+    header.Magic       = CheckpointMagic;
+    header.Version     = CheckpointVersion;
+    header.Width       = checkpoint.Width;
+    header.Height      = checkpoint.Height;
+    header.SamplerType = checkpoint.SamplerType;
+    header.Threshold   = checkpoint.Threshold;
+
+    auto succeeded = ( fwrite( &header, sizeof(header), 1, pFile ) == 1 )
+                  && ( fwrite( checkpoint.Radiance    .data(), sizeof(Color3), size, pFile ) == size )
+                  && ( fwrite( checkpoint.SampleCounts.data(), sizeof(u32),    size, pFile ) == size )
+                  && ( fwrite( checkpoint.Moments     .data(), sizeof(f32),    size, pFile ) == size );
+
+    succeeded = ( fclose( pFile ) == 0 ) && succeeded;
+    if ( !succeeded )
+    {
+        remove( temp.c_str() );
+        return false;
+    }
+
+    // 書き終えてから置き換える. 置き換えは不可分なので，常にどちらかのチェックポイントが残る.
+    if ( !MoveFileExA( temp.c_str(), filename, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH ) )
+    {
+        remove( temp.c_str() );
+        return false;
+    }
+
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      チェックポイントをファイルから読み込みます.
+//-------------------------------------------------------------------------------------------------
+bool LoadCheckpoint( const char* filename, Checkpoint& checkpoint )
+{
+    FILE* pFile;
+    errno_t err = fopen_s( &pFile, filename, "rb" );
+    if ( err != 0 )
+    { return false; }
+
+    CHECKPOINT_HEADER header;
+    if ( fread( &header, sizeof(header), 1, pFile ) != 1
+      || header.Magic   != CheckpointMagic
+      || header.Version != CheckpointVersion
+      || header.Width   <= 0
+      || header.Height  <= 0 )
+    {
+        fclose( pFile );
+        return false;
+    }
+
+    size_t size = header.Width * header.Height;
+    checkpoint.Width       = header.Width;
+    checkpoint.Height      = header.Height;
+    checkpoint.SamplerType = header.SamplerType;
+    checkpoint.Threshold   = header.Threshold;
+    checkpoint.Radiance    .resize( size );
+    checkpoint.SampleCounts.resize( size );
+    checkpoint.Moments     .resize( size );
+
+    auto succeeded = ( fread( checkpoint.Radiance    .data(), sizeof(Color3), size, pFile ) == size )
+                  && ( fread( checkpoint.SampleCounts.data(), sizeof(u32),    size, pFile ) == size )
+                  && ( fread( checkpoint.Moments     .data(), sizeof(f32),    size, pFile ) == size );
+
+    fclose( pFile );
+    return succeeded;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// CheckpointWriter class
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------------------------------
+//      コンストラクタです.
+//-------------------------------------------------------------------------------------------------
+CheckpointWriter::CheckpointWriter()
+: m_Busy( false )
+, m_Exit( false )
+{ /* DO_NOTHING */ }
+
+//-------------------------------------------------------------------------------------------------
+//      デストラクタです.
+//-------------------------------------------------------------------------------------------------
+CheckpointWriter::~CheckpointWriter()
+{ Term(); }
+
+//-------------------------------------------------------------------------------------------------
+//      初期化処理を行います.
+//-------------------------------------------------------------------------------------------------
+bool CheckpointWriter::Init( const char* filename )
+{
+    Term();
+
+    if ( filename == nullptr )
+    { return false; }
+
+    m_FileName = filename;
+    m_Busy     = false;
+    m_Exit     = false;
+    m_Thread   = std::thread( &CheckpointWriter::WriterMain, this );
+
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      終了処理を行います.
+//-------------------------------------------------------------------------------------------------
+void CheckpointWriter::Term()
+{
+    if ( !m_Thread.joinable() )
+    { return; }
+
+    {
+        std::lock_guard<std::mutex> locker( m_Mutex );
+        m_Exit = true;
+    }
+    m_Cond.notify_all();
+
+    m_Thread.join();
+}
+
+//-------------------------------------------------------------------------------------------------
+//      書き出し中かどうかチェックします.
+//-------------------------------------------------------------------------------------------------
+bool CheckpointWriter::IsBusy() const
+{ return m_Busy; }
+
+//-------------------------------------------------------------------------------------------------
+//      チェックポイントの書き出しを依頼します.
+//-------------------------------------------------------------------------------------------------
+bool CheckpointWriter::Request( Checkpoint& checkpoint )
+{
+    if ( !m_Thread.joinable() || m_Busy )
+    { return false; }
+
+    {
+        std::lock_guard<std::mutex> locker( m_Mutex );
+        std::swap( m_Data, checkpoint );
+        m_Busy = true;
+    }
+    m_Cond.notify_all();
+
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      書き出しスレッドのメイン関数です.
+//-------------------------------------------------------------------------------------------------
+void CheckpointWriter::WriterMain()
+{
+    for(;;)
+    {
+        {
+            std::unique_lock<std::mutex> locker( m_Mutex );
+            m_Cond.wait( locker, [&]{ return m_Exit || m_Busy; } );
+
+            // 依頼済みのものは書き出してから終了する.
+            if ( !m_Busy )
+            { return; }
+        }
+
+        if ( !SaveCheckpoint( m_FileName.c_str(), m_Data ) )
+        { ELOG( "Error : SaveCheckpoint() Failed. filename = %s", m_FileName.c_str() ); }
+
+        m_Busy = false;
+    }
+}
+
+} // namespace s3d
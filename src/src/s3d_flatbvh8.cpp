@@ -0,0 +1,846 @@
+﻿//-------------------------------------------------------------------------------------------------
+// File : s3d_flatbvh8.cpp
+// Desc : Flat Oct BVH.
+// Copyright(c) Project Asura. All right reserved.
+//-------------------------------------------------------------------------------------------------
+
+//-------------------------------------------------------------------------------------------------
+// Includes
+//-------------------------------------------------------------------------------------------------
+#include <s3d_flatbvh8.h>
+#include <s3d_bvh8.h>
+#include <s3d_bvhbuilder.h>
+#include <s3d_accel.h>
+#include <s3d_logger.h>
+#include <ppl.h>
+
+
+namespace /* anonymous */ {
+
+//-------------------------------------------------------------------------------------------------
+// Constant Values.
+//-------------------------------------------------------------------------------------------------
+constexpr size_t    MaxLeafSize   = 8;      //!< 葉ノードに格納する最大要素数です.
+constexpr u32       LeafShift     = 4;      //!< 葉ノードのオフセットのシフト量です.
+constexpr u32       LeafMask      = 0xf;    //!< 葉ノードの要素数のマスクです.
+constexpr u32       StackSize     = 256;    //!< 走査スタックのサイズです.
+constexpr u32       PacketMinLane = 3;      //!< パケットで走査を続ける最小レーン数です.
+
+//-------------------------------------------------------------------------------------------------
+//      マージしたバウンディングボックスを生成します.
+//-------------------------------------------------------------------------------------------------
+s3d::BoundingBox CreateMergedBox( size_t count, s3d::IShape** ppShapes )
+{
+    if ( count == 0 || ppShapes == nullptr )
+    { return s3d::BoundingBox(); }
+
+    s3d::BoundingBox box = ppShapes[0]->GetBox();
+
+    for( size_t i=1; i<count; ++i )
+    { box = s3d::BoundingBox::Merge( box, ppShapes[i]->GetBox() ); }
+
+    return box;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      葉ノードの子番号を生成します.
+//-------------------------------------------------------------------------------------------------
+S3D_INLINE
+s32 EncodeLeaf( u32 offset, u32 count )
+{ return ~static_cast<s32>( ( offset << LeafShift ) | count ); }
+
+//-------------------------------------------------------------------------------------------------
+//      葉ノードの子番号を分解します.
+//-------------------------------------------------------------------------------------------------
+S3D_INLINE
+void DecodeLeaf( s32 child, u32& offset, u32& count )
+{
+    auto value = static_cast<u32>( ~child );
+    offset = value >> LeafShift;
+    count  = value &  LeafMask;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      有効なレーン数を数えます.
+//-------------------------------------------------------------------------------------------------
+S3D_INLINE
+u32 CountLane( u32 mask )
+{
+    u32 count = 0;
+    for( ; mask != 0; mask &= mask - 1 )
+    { count++; }
+    return count;
+}
+
+} // namespace /* anonymous */
+
+
+namespace s3d {
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// FlatBVH8 class
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------------------------------
+//      コンストラクタです.
+//-------------------------------------------------------------------------------------------------
+FlatBVH8::FlatBVH8()
+: m_Count     (1)
+, m_pNodes    (nullptr)
+, m_NodeCount (0)
+, m_LeafSize  (0)
+, m_BuildCost (0.0f)
+, m_Mode      (BUILD_MODE_OBJECT)
+, m_pBlocks   (nullptr)
+, m_BlockCount(0)
+, m_pBlockOffsets(nullptr)
+{ /* DO_NOTHING */ }
+
+//-------------------------------------------------------------------------------------------------
+//      デストラクタです.
+//-------------------------------------------------------------------------------------------------
+FlatBVH8::~FlatBVH8()
+{
+    Term();
+    m_Arena.Term();
+
+    for(size_t i=0; i<m_Shapes.size(); ++i)
+    { SafeRelease( m_Shapes[i] ); }
+
+    m_Shapes.clear();
+    m_Shapes.shrink_to_fit();
+}
+
+//-------------------------------------------------------------------------------------------------
+//      参照カウントを増やします.
+//-------------------------------------------------------------------------------------------------
+void FlatBVH8::AddRef()
+{ m_Count++; }
+
+//-------------------------------------------------------------------------------------------------
+//      解放処理を行います.
+//-------------------------------------------------------------------------------------------------
+void FlatBVH8::Release()
+{
+    m_Count--;
+    if ( m_Count == 0 )
+    { delete this; }
+}
+
+//-------------------------------------------------------------------------------------------------
+//      参照カウントを取得します.
+//-------------------------------------------------------------------------------------------------
+u32 FlatBVH8::GetCount() const
+{ return m_Count; }
+
+//-------------------------------------------------------------------------------------------------
+//      初期化処理を行います.
+//-------------------------------------------------------------------------------------------------
+bool FlatBVH8::Init(size_t count, IShape** ppShapes, size_t leafSize, BUILD_MODE mode)
+{
+    if ( count == 0 || ppShapes == nullptr )
+    { return false; }
+
+    if ( leafSize == 0 || leafSize > MaxLeafSize )
+    {
+        ELOG( "Error : Invalid Argument. leafSize = %zu", leafSize );
+        return false;
+    }
+
+    if ( count > ( U32_MAX >> LeafShift ) )
+    {
+        ELOG( "Error : Too many shapes. count = %zu", count );
+        return false;
+    }
+
+    // 葉ノードが参照する形状は並び替えるため複製して保持します.
+    m_Shapes.resize( count );
+    for(size_t i=0; i<count; ++i)
+    {
+        m_Shapes[i] = ppShapes[i];
+        m_Shapes[i]->AddRef();
+    }
+
+    m_LeafSize = static_cast<u32>( leafSize );
+    m_Mode     = mode;
+
+    return Build();
+}
+
+//-------------------------------------------------------------------------------------------------
+//      保持している形状から木を構築します.
+//-------------------------------------------------------------------------------------------------
+bool FlatBVH8::Build()
+{
+    Term();
+
+    std::vector<BuildNode> nodes;
+    s32 root = 0;
+
+    if ( m_Mode == BUILD_MODE_SPATIAL )
+    {
+        // 空間分割を併用して二分木を構築します.
+        SpatialBuilder builder( m_Shapes.size(), m_Shapes.data() );
+        root = builder.Build( m_LeafSize, nodes );
+
+        // 葉ノードが参照する形状を，複製された参照を含む並びに置き換えます.
+        const auto& shapes = builder.GetShapes();
+        if ( shapes.size() > ( U32_MAX >> LeafShift ) )
+        {
+            ELOG( "Error : Too many references. count = %zu", shapes.size() );
+            return false;
+        }
+
+        for(size_t i=0; i<shapes.size(); ++i)
+        { shapes[i]->AddRef(); }
+
+        for(size_t i=0; i<m_Shapes.size(); ++i)
+        { SafeRelease( m_Shapes[i] ); }
+
+        m_Shapes = shapes;
+        m_Boxes  = builder.GetBoxes();
+    }
+    else if ( m_Mode == BUILD_MODE_LINEAR )
+    {
+        // モートン符号順に並べて二分木を構築します.
+        LinearBuilder builder( m_Shapes.size(), m_Shapes.data() );
+        root = builder.Build( m_LeafSize, nodes );
+    }
+    else
+    {
+        // BVH8 と同じSAH分割で二分木を構築します.
+        // 部分木を並列に構築するため，二分木のノード数の上限 2N-1 個を先に確保しておく.
+        nodes.resize( m_Shapes.size() * 2 );
+        std::atomic<s32> nodeCount( 0 );
+        BVHBuilder builder( m_Shapes.size(), m_Shapes.data() );
+        root = BuildBinary( builder, nodes, nodeCount, 0, m_Shapes.size(), m_LeafSize );
+        nodes.resize( nodeCount );
+    }
+
+    // 長時間のレンダリング向けに，構築後に木を組み替えて走査コストを下げます.
+    const auto& config = Accel::GetBuildConfig();
+    if ( config.treeletIterations > 0 )
+    {
+        TreeletOptimizer optimizer;
+        auto before = optimizer.GetCost( nodes, root );
+        optimizer.Optimize( nodes, root, config.treeletIterations );
+        auto after  = optimizer.GetCost( nodes, root );
+        ILOG( "Info : Treelet optimization. SAH cost = %f -> %f", before, after );
+    }
+
+    m_Box = nodes[root].box;
+
+    // 1つの8分木ノードは少なくとも1つの内部ノードを吸収するので，内部ノード数で上限が決まる.
+    size_t capacity  = 1;
+    size_t leafCount = 0;
+    for(size_t i=0; i<nodes.size(); ++i)
+    {
+        if ( nodes[i].child[0] >= 0 )
+        { capacity++; }
+        else
+        { leafCount++; }
+    }
+
+    // 全て三角形であれば，葉ノード毎にSoA形式に詰めてまとめて判定します.
+    auto packed = true;
+    for(size_t i=0; i<m_Shapes.size() && packed; ++i)
+    {
+        Vector3 triangle[3];
+        const IMaterial* pMaterial = nullptr;
+        packed = m_Shapes[i]->GetTriangle( triangle, &pMaterial );
+    }
+
+    // ノードと三角形ブロックは構築順に連続したメモリに配置します.
+    auto blockSize = ( packed ) ? ( sizeof(Triangle8) + sizeof(u32) ) * leafCount : 0;
+    m_Arena.Reserve( sizeof(Node) * capacity + blockSize + alignof(Triangle8) * 2 );
+
+    m_pNodes = m_Arena.Alloc<Node>( capacity );
+    if ( m_pNodes == nullptr )
+    {
+        ELOG( "Error : Out of memory." );
+        return false;
+    }
+
+    if ( packed )
+    {
+        m_pBlocks       = m_Arena.Alloc<Triangle8>( leafCount );
+        m_pBlockOffsets = m_Arena.Alloc<u32>( leafCount );
+        if ( m_pBlocks == nullptr || m_pBlockOffsets == nullptr )
+        {
+            ELOG( "Error : Out of memory." );
+            return false;
+        }
+    }
+
+    u32 maxDepth = 0;
+    Collapse( nodes, root, 1, maxDepth );
+
+    // 1階層あたり最大7個のノードがスタックに積まれる.
+    if ( maxDepth * 7 + 1 > StackSize )
+    {
+        ELOG( "Error : BVH is too deep. depth = %u", maxDepth );
+        return false;
+    }
+
+    // 再構築を判断するための基準コストです.
+    m_BuildCost = Refit();
+
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      木構造を保ったままバウンディングボックスを再計算します.
+//-------------------------------------------------------------------------------------------------
+f32 FlatBVH8::Refit()
+{
+    f32 nodeArea = 0.0f;
+    f32 leafArea = 0.0f;
+
+    // 子ノードは必ず親ノードより後ろに格納されているので，逆順に処理すると葉から根に向かって更新できる.
+    for(auto i=static_cast<s32>(m_NodeCount) - 1; i>=0; --i)
+    {
+        auto& node = m_pNodes[i];
+
+        BoundingBox box[8];
+        BoundingBox merged;
+
+        for(auto j=0; j<8; ++j)
+        {
+            auto bit = 0x1u << j;
+            if ( (node.mask & bit) != bit )
+            { continue; }
+
+            auto child = node.child[j];
+            if ( child >= 0 )
+            { box[j] = m_pNodes[child].box.GetBox(); }
+            else
+            {
+                u32 offset = 0;
+                u32 count  = 0;
+                DecodeLeaf( child, offset, count );
+
+                if ( m_pBlocks != nullptr )
+                { offset = m_pBlockOffsets[offset]; }
+
+                // 空間分割した参照は切り取られた範囲を使う.
+                if ( m_Boxes.empty() )
+                { box[j] = CreateMergedBox( count, &m_Shapes[offset] ); }
+                else
+                {
+                    for(u32 k=0; k<count; ++k)
+                    { box[j] = BoundingBox::Merge( box[j], m_Boxes[offset + k] ); }
+                }
+
+                leafArea += SurfaceArea( box[j] ) * count;
+            }
+
+            merged = BoundingBox::Merge( merged, box[j] );
+        }
+
+        node.box  = BoundingBox8( box );
+        nodeArea += SurfaceArea( merged );
+    }
+
+    m_Box = m_pNodes[0].box.GetBox();
+
+    auto rootArea = SurfaceArea( m_Box );
+    if ( rootArea <= 0.0f )
+    { return 0.0f; }
+
+    const auto& config = Accel::GetBuildConfig();
+    return ( config.costTraversal * nodeArea + config.costIntersect * leafArea ) / rootArea;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      形状の移動に追従して更新します.
+//-------------------------------------------------------------------------------------------------
+bool FlatBVH8::Update(f32 threshold)
+{
+    auto cost = Refit();
+
+    // 空間分割した木は参照を複製しているので再構築しない.
+    if ( m_Mode == BUILD_MODE_SPATIAL )
+    { return false; }
+
+    // 品質の劣化が閾値以内であれば再分割しない.
+    if ( cost <= m_BuildCost * threshold )
+    { return false; }
+
+    DLOG( "Info : Rebuild BVH. cost = %f, build cost = %f", cost, m_BuildCost );
+    return Build();
+}
+
+//-------------------------------------------------------------------------------------------------
+//      二分木を構築します.
+//-------------------------------------------------------------------------------------------------
+s32 FlatBVH8::BuildBinary
+(
+    BVHBuilder&             builder,
+    std::vector<BuildNode>& nodes,
+    std::atomic<s32>&       nodeCount,
+    size_t                  offset,
+    size_t                  count,
+    size_t                  leafSize
+)
+{
+    // ノード番号は確保順で決まるが，8分木への変換は親子関係のみを辿るので結果は並列化の有無によらない.
+    auto index = nodeCount++;
+
+    auto& node = nodes[index];
+    node.box      = builder.GetBox( offset, count );
+    node.child[0] = -1;
+    node.child[1] = -1;
+    node.offset   = static_cast<u32>( offset );
+    node.count    = static_cast<u32>( count );
+
+    if ( count <= leafSize )
+    { return index; }
+
+    // SAHで分割できない場合も葉ノードの要素数を超えないように中間分割します.
+    size_t mid = 0;
+    if ( !BVH8::Split( builder, offset, count, mid ) )
+    {
+        if ( !BVH8::SplitMid( builder, offset, count, mid ) )
+        { mid = count / 2; }
+    }
+
+    if ( mid == 0 || mid >= count )
+    { mid = count / 2; }
+
+    s32 left  = -1;
+    s32 right = -1;
+    if ( BVHBuilder::IsParallel( count ) )
+    {
+        concurrency::parallel_invoke(
+            [&] { left  = BuildBinary( builder, nodes, nodeCount, offset,       mid,         leafSize ); },
+            [&] { right = BuildBinary( builder, nodes, nodeCount, offset + mid, count - mid, leafSize ); });
+    }
+    else
+    {
+        left  = BuildBinary( builder, nodes, nodeCount, offset,       mid,         leafSize );
+        right = BuildBinary( builder, nodes, nodeCount, offset + mid, count - mid, leafSize );
+    }
+
+    node.child[0] = left;
+    node.child[1] = right;
+
+    return index;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      ノード配列と三角形ブロックを破棄します.
+//-------------------------------------------------------------------------------------------------
+void FlatBVH8::Term()
+{
+    m_pNodes        = nullptr;
+    m_pBlocks       = nullptr;
+    m_pBlockOffsets = nullptr;
+    m_NodeCount     = 0;
+    m_BlockCount    = 0;
+
+    // 再構築時は前回と同じサイズを1回の確保で賄えるようにまとめ直す.
+    m_Arena.Reset();
+}
+
+//-------------------------------------------------------------------------------------------------
+//      二分木を8分木に変換してノード配列に格納します.
+//-------------------------------------------------------------------------------------------------
+u32 FlatBVH8::Collapse(const std::vector<BuildNode>& nodes, s32 index, u32 depth, u32& maxDepth)
+{
+    maxDepth = Max( maxDepth, depth );
+
+    auto nodeIndex = m_NodeCount++;
+
+    s32 children[8];
+    u32 childCount = 0;
+
+    if ( nodes[index].child[0] < 0 )
+    { children[childCount++] = index; }
+    else
+    {
+        children[childCount++] = nodes[index].child[0];
+        children[childCount++] = nodes[index].child[1];
+    }
+
+    // 表面積が最大の内部ノードを展開して子ノードを増やします.
+    while ( childCount < 8 )
+    {
+        s32 best     = -1;
+        f32 bestArea = -1.0f;
+
+        for(u32 i=0; i<childCount; ++i)
+        {
+            const auto& child = nodes[children[i]];
+            if ( child.child[0] < 0 )
+            { continue; }
+
+            auto area = SurfaceArea( child.box );
+            if ( area > bestArea )
+            {
+                bestArea = area;
+                best     = i;
+            }
+        }
+
+        if ( best < 0 )
+        { break; }
+
+        auto open = children[best];
+        children[best]         = nodes[open].child[0];
+        children[childCount++] = nodes[open].child[1];
+    }
+
+    BoundingBox box[8];
+    s32         child[8] = {};
+    u32         mask     = 0;
+
+    for(u32 i=0; i<childCount; ++i)
+    {
+        const auto& node = nodes[children[i]];
+
+        box[i] = node.box;
+        mask  |= 0x1 << i;
+
+        if ( node.child[0] < 0 && m_pBlocks != nullptr )
+        {
+            // 葉ノードの番号は三角形ブロックの番号とし，形状のオフセットは別に保持する.
+            auto block = m_BlockCount++;
+            Triangle8::Pack( node.count, &m_Shapes[node.offset], m_pBlocks[block] );
+            m_pBlockOffsets[block] = node.offset;
+            child[i] = EncodeLeaf( block, node.count );
+        }
+        else if ( node.child[0] < 0 )
+        { child[i] = EncodeLeaf( node.offset, node.count ); }
+        else
+        { child[i] = static_cast<s32>( Collapse( nodes, children[i], depth + 1, maxDepth ) ); }
+    }
+
+    auto& result = m_pNodes[nodeIndex];
+    result.box  = BoundingBox8( box );
+    result.mask = mask;
+    for(auto i=0; i<8; ++i)
+    { result.child[i] = child[i]; }
+
+    return nodeIndex;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      交差判定を行います.
+//-------------------------------------------------------------------------------------------------
+bool FlatBVH8::IsHit(const RaySet& raySet, HitRecord& record) const
+{ return Traverse( 0, raySet, record ); }
+
+//-------------------------------------------------------------------------------------------------
+//      指定ノード以下を1本のレイで走査します.
+//-------------------------------------------------------------------------------------------------
+bool FlatBVH8::Traverse(s32 root, const RaySet& raySet, HitRecord& record) const
+{
+    auto nearest = ( Accel::GetTraversalOrder() == TRAVERSAL_ORDER_NEAREST );
+
+    s32 stack[StackSize];
+    f32 stackDist[StackSize];
+    u32 top = 0;
+
+    stack    [top] = root;
+    stackDist[top] = 0.0f;
+    top++;
+
+    auto hit = false;
+    while ( top > 0 )
+    {
+        --top;
+
+        // 積んだ後に見つかった交差より遠いものは判定しない.
+        if ( nearest && stackDist[top] > record.distance )
+        { continue; }
+
+        auto child = stack[top];
+        if ( child < 0 )
+        {
+            u32 offset = 0;
+            u32 count  = 0;
+            DecodeLeaf( child, offset, count );
+
+            if ( m_pBlocks != nullptr )
+            {
+                hit |= m_pBlocks[offset].IsHit( raySet, record );
+                continue;
+            }
+
+            for(u32 j=0; j<count; ++j)
+            { hit |= m_Shapes[offset + j]->IsHit( raySet, record ); }
+
+            continue;
+        }
+
+        const auto& node = m_pNodes[child];
+        auto distance = ( nearest ) ? record.distance : F_HIT_MAX;
+
+        s32  mask = 0;
+        b256 tnear;
+        if ( !node.box.IsHit( raySet, distance, mask, tnear ) )
+        { continue; }
+
+        mask &= node.mask;
+
+        S3D_ALIGN(32) f32 dist[8];
+        _mm256_store_ps( dist, tnear );
+
+        u32 order[8];
+        u32 count = 0;
+        for (u32 i=0; i<8; ++i)
+        {
+            auto bit = 0x1 << i;
+            if ( (mask & bit) == bit )
+            { order[count++] = i; }
+        }
+
+        if ( nearest )
+        { SortByDistance( count, order, dist ); }
+
+        // 先頭の子ノードから処理されるように逆順に積みます.
+        for (auto i=static_cast<s32>(count) - 1; i>=0; --i)
+        {
+            stack    [top] = node.child[order[i]];
+            stackDist[top] = dist[order[i]];
+            top++;
+        }
+    }
+
+    return hit;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      遮蔽判定を行います.
+//-------------------------------------------------------------------------------------------------
+bool FlatBVH8::IsOccluded(const RaySet& raySet, f32 distance) const
+{
+    s32 stack[StackSize];
+    u32 top = 0;
+
+    stack[top++] = 0;
+
+    // 最近接である必要は無いので，子ノードを並び替えずに最初の遮蔽物で打ち切る.
+    while ( top > 0 )
+    {
+        auto child = stack[--top];
+        if ( child < 0 )
+        {
+            u32 offset = 0;
+            u32 count  = 0;
+            DecodeLeaf( child, offset, count );
+
+            if ( m_pBlocks != nullptr )
+            {
+                if ( m_pBlocks[offset].IsOccluded( raySet, distance ) )
+                { return true; }
+
+                continue;
+            }
+
+            for(u32 j=0; j<count; ++j)
+            {
+                if ( m_Shapes[offset + j]->IsOccluded( raySet, distance ) )
+                { return true; }
+            }
+
+            continue;
+        }
+
+        const auto& node = m_pNodes[child];
+
+        s32  mask = 0;
+        b256 tnear;
+        if ( !node.box.IsHit( raySet, distance, mask, tnear ) )
+        { continue; }
+
+        mask &= node.mask;
+        for (auto i=7; i>=0; --i)
+        {
+            auto bit = 0x1 << i;
+            if ( (mask & bit) == bit )
+            { stack[top++] = node.child[i]; }
+        }
+    }
+
+    return false;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      パケットにまとめたレイの交差判定を行います.
+//-------------------------------------------------------------------------------------------------
+u32 FlatBVH8::IsHit8(const RayPacket8& packet, u32 mask, HitRecord* pRecords) const
+{
+    auto nearest = ( Accel::GetTraversalOrder() == TRAVERSAL_ORDER_NEAREST );
+
+    s32  stack    [StackSize];
+    u32  stackMask[StackSize];
+    b256 stackDist[StackSize];
+    u32  top = 0;
+
+    stack    [top] = 0;
+    stackMask[top] = mask & packet.mask;
+    stackDist[top] = _mm256_setzero_ps();
+    top++;
+
+    u32 hit = 0;
+    while ( top > 0 )
+    {
+        --top;
+
+        auto lanes = stackMask[top];
+        auto child = stack[top];
+
+        // 各レーンの現在の交差距離を取得.
+        auto distance = _mm256_set1_ps( F_HIT_MAX );
+        if ( nearest )
+        {
+            distance = _mm256_set_ps(
+                pRecords[7].distance, pRecords[6].distance, pRecords[5].distance, pRecords[4].distance,
+                pRecords[3].distance, pRecords[2].distance, pRecords[1].distance, pRecords[0].distance );
+
+            // 積んだ後に見つかった交差より遠いレーンは判定しない.
+            lanes &= _mm256_movemask_ps( _mm256_cmp_ps( stackDist[top], distance, _CMP_LE_OQ ) );
+        }
+
+        if ( lanes == 0 )
+        { continue; }
+
+        if ( child < 0 )
+        {
+            u32 offset = 0;
+            u32 count  = 0;
+            DecodeLeaf( child, offset, count );
+
+            if ( m_pBlocks != nullptr )
+            {
+                for(u32 i=0; i<8; ++i)
+                {
+                    auto bit = 0x1u << i;
+                    if ( (lanes & bit) == bit && m_pBlocks[offset].IsHit( packet.raySet[i], pRecords[i] ) )
+                    { hit |= bit; }
+                }
+                continue;
+            }
+
+            for(u32 j=0; j<count; ++j)
+            { hit |= m_Shapes[offset + j]->IsHit8( packet, lanes, pRecords ); }
+
+            continue;
+        }
+
+        // レーンが発散したら，残りのレーンは1本ずつ走査する.
+        if ( CountLane( lanes ) < PacketMinLane )
+        {
+            for(u32 i=0; i<8; ++i)
+            {
+                auto bit = 0x1u << i;
+                if ( (lanes & bit) == bit && Traverse( child, packet.raySet[i], pRecords[i] ) )
+                { hit |= bit; }
+            }
+            continue;
+        }
+
+        const auto& node = m_pNodes[child];
+
+        S3D_ALIGN(32) f32 bounds[2][3][8];
+        for(auto i=0; i<2; ++i)
+        {
+            _mm256_store_ps( bounds[i][0], node.box.value[i][0] );
+            _mm256_store_ps( bounds[i][1], node.box.value[i][1] );
+            _mm256_store_ps( bounds[i][2], node.box.value[i][2] );
+        }
+
+        u32  order    [8];
+        u32  childMask[8];
+        b256 childDist[8];
+        f32  dist     [8];
+        u32  count = 0;
+        for(u32 i=0; i<8; ++i)
+        {
+            if ( (node.mask & (0x1u << i)) == 0 )
+            { continue; }
+
+            b256 mini[3] = {
+                _mm256_broadcast_ss( &bounds[0][0][i] ),
+                _mm256_broadcast_ss( &bounds[0][1][i] ),
+                _mm256_broadcast_ss( &bounds[0][2][i] ) };
+            b256 maxi[3] = {
+                _mm256_broadcast_ss( &bounds[1][0][i] ),
+                _mm256_broadcast_ss( &bounds[1][1][i] ),
+                _mm256_broadcast_ss( &bounds[1][2][i] ) };
+
+            b256 tnear;
+            auto hitLanes = packet.IsHit( mini, maxi, distance, tnear ) & lanes;
+            if ( hitLanes == 0 )
+            { continue; }
+
+            // 交差したレーンの中で最も近い進入距離を並び替えに使う.
+            S3D_ALIGN(32) f32 tnears[8];
+            _mm256_store_ps( tnears, tnear );
+
+            dist[i] = F_HIT_MAX;
+            for(u32 j=0; j<8; ++j)
+            {
+                if ( (hitLanes & (0x1u << j)) != 0 )
+                { dist[i] = s3d::Min( dist[i], tnears[j] ); }
+            }
+
+            childMask[i]   = hitLanes;
+            childDist[i]   = tnear;
+            order[count++] = i;
+        }
+
+        if ( nearest )
+        { SortByDistance( count, order, dist ); }
+
+        // 先頭の子ノードから処理されるように逆順に積みます.
+        for (auto i=static_cast<s32>(count) - 1; i>=0; --i)
+        {
+            stack    [top] = node.child[order[i]];
+            stackMask[top] = childMask[order[i]];
+            stackDist[top] = childDist[order[i]];
+            top++;
+        }
+    }
+
+    return hit;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      バウンディングボックスを取得します.
+//-------------------------------------------------------------------------------------------------
+BoundingBox FlatBVH8::GetBox() const
+{ return m_Box; }
+
+//-------------------------------------------------------------------------------------------------
+//      中心座標を取得します.
+//-------------------------------------------------------------------------------------------------
+Vector3 FlatBVH8::GetCenter() const
+{ return m_Box.center; }
+
+//-------------------------------------------------------------------------------------------------
+//      構築時のSAHコストを取得します.
+//-------------------------------------------------------------------------------------------------
+f32 FlatBVH8::GetBuildCost() const
+{ return m_BuildCost; }
+
+//-------------------------------------------------------------------------------------------------
+//      生成処理を行います.
+//-------------------------------------------------------------------------------------------------
+IShape* FlatBVH8::Create(size_t count, IShape** ppShapes, size_t leafSize, BUILD_MODE mode)
+{
+    auto instance = new (std::nothrow) FlatBVH8();
+    if ( instance == nullptr )
+    { return nullptr; }
+
+    if ( !instance->Init( count, ppShapes, leafSize, mode ) )
+    {
+        SafeRelease( instance );
+        return nullptr;
+    }
+
+    return instance;
+}
+
+} // namespace s3d
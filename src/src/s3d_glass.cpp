@@ -112,7 +112,7 @@ Color3 Glass::Shade( ShadingArg& arg ) const
     auto prob = 0.5f;
 
     // 反射の場合.
-    if ( arg.random.GetAsF32() < P )
+    if ( arg.sampler.GetAsF32(BOUNCE_DIMENSION_LOBE) < P )
     {
         // 出射方向.
         arg.output = reflect;
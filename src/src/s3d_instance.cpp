@@ -10,6 +10,25 @@
 #include <s3d_instance.h>
 
 
+namespace /* anonymous */ {
+
+//-------------------------------------------------------------------------------------------------
+//      ワールド空間の距離をローカル空間の距離に変換します.
+//-------------------------------------------------------------------------------------------------
+S3D_INLINE
+f32 ToLocalDistance( f32 distance, f32 scale )
+{ return ( distance < s3d::F_MAX ) ? distance * scale : distance; }
+
+//-------------------------------------------------------------------------------------------------
+//      ローカル空間の距離をワールド空間の距離に変換します.
+//-------------------------------------------------------------------------------------------------
+S3D_INLINE
+f32 ToWorldDistance( f32 distance, f32 scale )
+{ return ( distance < s3d::F_MAX ) ? distance / scale : distance; }
+
+} // namespace /* anonymous */
+
+
 namespace s3d {
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
@@ -28,7 +47,7 @@ Instance::Instance( IShape* shape, const Matrix& world )
 , m_WorldCenter ( Vector3::Transform( m_pShape->GetCenter(), world ) )
 {
     m_pShape->AddRef();
-    m_WorldCenter = ( m_WorldBox.maxi + m_WorldBox.maxi ) * 0.5f;
+    m_WorldCenter = m_WorldBox.center;
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -64,11 +83,103 @@ u32 Instance::GetCount() const
 //-------------------------------------------------------------------------------------------------
 bool Instance::IsHit( const RaySet& raySet, HitRecord& record ) const
 {
-    auto pos = Vector3::TransformCoord ( raySet.ray.pos, m_InvWorld );
-    auto dir = Vector3::TransformNormal( raySet.ray.dir, m_InvWorld );
-    auto localRaySet = MakeRaySet( pos, Vector3::UnitVector( dir ) );
+    f32  scale;
+    auto localRaySet = ToLocal( raySet, &scale );
+
+    auto distance = record.distance;
+    record.distance = ToLocalDistance( distance, scale );
+
+    if ( !m_pShape->IsHit( localRaySet, record ) )
+    {
+        record.distance = distance;
+        return false;
+    }
+
+    record.distance = ToWorldDistance( record.distance, scale );
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      遮蔽判定を行います.
+//-------------------------------------------------------------------------------------------------
+bool Instance::IsOccluded( const RaySet& raySet, f32 distance ) const
+{
+    f32  scale;
+    auto localRaySet = ToLocal( raySet, &scale );
+
+    return m_pShape->IsOccluded( localRaySet, ToLocalDistance( distance, scale ) );
+}
 
-    return m_pShape->IsHit( localRaySet, record );
+//-------------------------------------------------------------------------------------------------
+//      パケットにまとめたレイの交差判定を行います.
+//-------------------------------------------------------------------------------------------------
+u32 Instance::IsHit8( const RayPacket8& packet, u32 mask, HitRecord* pRecords ) const
+{
+    if ( mask == 0 )
+    { return 0; }
+
+    RayPacket8 local;
+
+    S3D_ALIGN(32) f32 pos   [3][8];
+    S3D_ALIGN(32) f32 invDir[3][8];
+    S3D_ALIGN(32) f32 tmin  [8];
+    S3D_ALIGN(32) f32 tmax  [8];
+
+    f32 scale   [8];
+    f32 distance[8];
+
+    // 無効なレーンは先頭の有効なレーンで埋めて，マスクで無効にします.
+    u32 first = 0;
+    while( ( mask & ( 0x1u << first ) ) == 0 )
+    { first++; }
+
+    for( u32 i=0; i<8; ++i )
+    {
+        auto idx = ( ( mask & ( 0x1u << i ) ) != 0 ) ? i : first;
+
+        auto& localRaySet = local.raySet[i];
+        localRaySet = ToLocal( packet.raySet[idx], &scale[i] );
+
+        for( auto j=0; j<3; ++j )
+        {
+            pos   [j][i] = localRaySet.ray.pos.a[j];
+            invDir[j][i] = localRaySet.invDir.a[j];
+        }
+
+        tmin[i] = localRaySet.tmin;
+        tmax[i] = localRaySet.tmax;
+
+        // 交差しなかったレーンは元の距離に戻すので退避しておく.
+        distance[i] = pRecords[i].distance;
+        if ( idx == i )
+        { pRecords[i].distance = ToLocalDistance( distance[i], scale[i] ); }
+    }
+
+    for( auto j=0; j<3; ++j )
+    {
+        local.pos   [j] = _mm256_load_ps( pos   [j] );
+        local.invDir[j] = _mm256_load_ps( invDir[j] );
+    }
+
+    local.tmin = _mm256_load_ps( tmin );
+    local.tmax = _mm256_load_ps( tmax );
+    local.mask = mask;
+
+    auto hit = m_pShape->IsHit8( local, mask, pRecords );
+
+    for( u32 i=0; i<8; ++i )
+    {
+        auto bit = 0x1u << i;
+        if ( ( mask & bit ) == 0 )
+        { continue; }
+
+        if ( ( hit & bit ) == bit )
+        { pRecords[i].distance = ToWorldDistance( pRecords[i].distance, scale[i] ); }
+        else
+        { pRecords[i].distance = distance[i]; }
+    }
+
+    return hit;
 }
 
 void Instance::CalcParam(const Vector3& pos, const Vector2& barycentric, Vector3* normal, Vector2* texcoord) const
@@ -97,7 +208,21 @@ void Instance::UpdateMatrix(const Matrix& matrix)
     m_World         = matrix;
     m_InvWorld      = Matrix::Invert( matrix );
     m_WorldBox      = BoundingBox::Transform( m_pShape->GetBox(), matrix );
-    m_WorldCenter   = Vector3::Transform( m_pShape->GetCenter(), matrix );
+    m_WorldCenter   = m_WorldBox.center;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      ワールド空間のレイをローカル空間に変換します.
+//-------------------------------------------------------------------------------------------------
+RaySet Instance::ToLocal( const RaySet& raySet, f32* pScale ) const
+{
+    // ローカル空間での方向ベクトルの長さが，ワールド空間から見た距離の拡大率になる.
+    auto pos = Vector3::TransformCoord ( raySet.ray.pos, m_InvWorld );
+    auto dir = Vector3::TransformNormal( raySet.ray.dir, m_InvWorld );
+    auto scale = dir.Length();
+
+    *pScale = scale;
+    return MakeRaySet( pos, dir / scale, ToLocalDistance( raySet.tmin, scale ), ToLocalDistance( raySet.tmax, scale ) );
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -72,10 +72,10 @@ Color3 Lambert::Shade( ShadingArg& arg ) const
     TangentSpace(N, T, B);
 
     // インポータンスサンプリング.
-    auto s = SampleLambert(arg.random.GetAsF32(), arg.random.GetAsF32());
+    auto s = SampleLambert(arg.sampler.GetAsF32(BOUNCE_DIMENSION_BSDF_U), arg.sampler.GetAsF32(BOUNCE_DIMENSION_BSDF_V));
 
     arg.output = Vector3::SafeUnitVector( T * s.x + B * s.y + N * s.z );
-    arg.dice   = ( arg.random.GetAsF32() >= m_Threshold );
+    arg.dice   = ( arg.sampler.GetAsF32(BOUNCE_DIMENSION_ROULETTE) >= m_Threshold );
 
     // 以下の処理の省略.
     //      pdf = cosine * F_1DIVPI;
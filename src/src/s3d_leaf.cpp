@@ -86,6 +86,20 @@ bool Leaf::IsHit( const RaySet& raySet, HitRecord& record ) const
     return hit;
 }
 
+//-------------------------------------------------------------------------------------------------
+//      遮蔽判定を行います.
+//-------------------------------------------------------------------------------------------------
+bool Leaf::IsOccluded( const RaySet& raySet, f32 distance ) const
+{
+    for( size_t i=0; i<m_pShapes.size(); ++i )
+    {
+        if ( m_pShapes[ i ]->IsOccluded( raySet, distance ) )
+        { return true; }
+    }
+
+    return false;
+}
+
 //-------------------------------------------------------------------------------------------------
 //      バウンディングボックスを取得します.
 //-------------------------------------------------------------------------------------------------
@@ -14,6 +14,9 @@
 #include <s3d_bvh2.h>
 #include <s3d_bvh4.h>
 #include <s3d_bvh8.h>
+#include <s3d_flatbvh8.h>
+#include <s3d_accel.h>
+#include <s3d_timer.h>
 #include <s3d_logger.h>
 #include <s3d_triangle.h>
 #include <s3d_materialfactory.h>
@@ -188,6 +191,35 @@ s3d::Vector2 Convert( SMD_VECTOR2& value )
 s3d::Vector3 Convert( SMD_VECTOR3& value )
 { return s3d::Vector3( value.x, value.y, value.z ); }
 
+//-------------------------------------------------------------------------------------------------
+//      BVHを構築します.
+//-------------------------------------------------------------------------------------------------
+s3d::IShape* CreateBVH( size_t count, s3d::IShape** ppShapes, s3d::BUILD_MODE mode )
+{
+    s3d::Timer timer;
+    timer.Start();
+
+    s3d::IShape* pBVH = nullptr;
+
+#if 1
+    // 平坦化したノード配列によるBVHを構築します.
+    pBVH = s3d::FlatBVH8::Create( count, ppShapes, 8, mode );
+#endif
+
+    // 空間分割で構築できなかった場合は通常のSAHで構築します.
+    if ( pBVH == nullptr && mode == s3d::BUILD_MODE_SPATIAL )
+    { pBVH = s3d::FlatBVH8::Create( count, ppShapes ); }
+
+    // ノードをポインタで連結したBVHを構築します.
+    if ( pBVH == nullptr )
+    { pBVH = s3d::BVH8::Create( count, ppShapes ); }
+
+    timer.Stop();
+    s3d::Accel::AddBuildTime( s3d::ACCEL_LEVEL_BOTTOM, timer.GetElapsedTimeMsec() );
+
+    return pBVH;
+}
+
 } // namespace /* anonymous */
 
 
@@ -201,8 +233,14 @@ namespace s3d {
 //      コンストラクタです.
 //-------------------------------------------------------------------------------------------------
 Mesh::Mesh()
-: m_Count( 1 )
-, m_pBVH ( nullptr )
+: m_Count        ( 1 )
+, m_TriangleCount( 0 )
+, m_pTriangles   ( nullptr )
+, m_pNormals     ( nullptr )
+, m_pTexCoords   ( nullptr )
+, m_pMaterialIds ( nullptr )
+, m_pPrimitives  ( nullptr )
+, m_pBVH         ( nullptr )
 { /* DO_NOTHING */ }
 
 //-------------------------------------------------------------------------------------------------
@@ -210,16 +248,16 @@ Mesh::Mesh()
 //-------------------------------------------------------------------------------------------------
 Mesh::~Mesh()
 {
+    // BVHは三角形を参照しているので先に解放します.
     SafeRelease( m_pBVH );
 
-    for(size_t i=0; i<m_Triangles.size(); ++i)
-    { SafeRelease(m_Triangles[i]); }
-    
     for(size_t i=0; i<m_Materials.size(); ++i)
     { SafeRelease(m_Materials[i]); }
 
-    m_Triangles.clear();
     m_Materials.clear();
+
+    // 頂点データと三角形は1回で解放します.
+    m_Arena.Term();
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -247,7 +285,7 @@ u32 Mesh::GetCount() const
 //-------------------------------------------------------------------------------------------------
 //      ファイルから読み込みします.
 //-------------------------------------------------------------------------------------------------
-bool Mesh::LoadFromFile( const char* filename )
+bool Mesh::LoadFromFile( const char* filename, BUILD_MODE mode )
 {
     FILE* pFile;
 
@@ -309,7 +347,12 @@ bool Mesh::LoadFromFile( const char* filename )
         return false;
     }
 
-    m_Triangles.resize( fileHeader.DataHeader.NumTriangles );
+    if ( !Resize( fileHeader.DataHeader.NumTriangles ) )
+    {
+        fclose( pFile );
+        return false;
+    }
+
     m_Materials.resize( fileHeader.DataHeader.NumMaterials );
     m_Textures .resize( fileHeader.DataHeader.NumTextures );
 
@@ -440,34 +483,29 @@ bool Mesh::LoadFromFile( const char* filename )
     }
 
     // 三角形データを読み込みます.
-    for ( size_t i = 0; i < m_Triangles.size(); ++i )
+    for ( size_t i = 0; i < m_TriangleCount; ++i )
     {
         SMD_TRIANGLE triangle;
         fread( &triangle, sizeof( SMD_TRIANGLE ), 1, pFile );
 
-        Vertex vertex[3];
         for(auto idx=0; idx<3; ++idx)
         {
-            vertex[idx].Position = Convert(triangle.Vertex[idx].Position);
-            vertex[idx].Normal   = Convert(triangle.Vertex[idx].Normal);
-            vertex[idx].TexCoord = Convert(triangle.Vertex[idx].TexCoord);
+            m_pTriangles[i * 3 + idx] = Convert(triangle.Vertex[idx].Position);
+            m_pNormals  [i * 3 + idx] = Convert(triangle.Vertex[idx].Normal);
+            m_pTexCoords[i * 3 + idx] = Convert(triangle.Vertex[idx].TexCoord);
         }
 
-        auto material = (triangle.MaterialId >= 0 ) ? m_Materials[triangle.MaterialId] : nullptr;
-
-        m_Triangles[i] = Triangle::Create(vertex, material);
+        m_pMaterialIds[i] = triangle.MaterialId;
     }
 
     // BVHを構築します.
-    m_pBVH = BVH8::Create( m_Triangles.size(), m_Triangles.data() );
-
-    return true;
+    return Build( mode );
 }
 
 //-------------------------------------------------------------------------------------------------
 //      初期化処理を行います.
 //-------------------------------------------------------------------------------------------------
-bool Mesh::Init(u32 vertexCount, Vertex* pVertices, IMaterial* pMaterial)
+bool Mesh::Init(u32 vertexCount, Vertex* pVertices, IMaterial* pMaterial, BUILD_MODE mode)
 {
     if (vertexCount % 3 != 0)
     { return false; }
@@ -476,27 +514,87 @@ bool Mesh::Init(u32 vertexCount, Vertex* pVertices, IMaterial* pMaterial)
     m_Materials[0] = pMaterial;
     m_Materials[0]->AddRef();
 
-    auto triangleCount = vertexCount / 3;
-
-    bool failed = false;
-    m_Triangles.resize(triangleCount);
+    if ( !Resize(vertexCount / 3) )
+    { return false; }
 
-    for(u32 i=0; i<triangleCount; ++i)
+    for(u32 i=0; i<vertexCount; ++i)
     {
-       m_Triangles[i] = Triangle::Create(&pVertices[i * 3], pMaterial);
-       if (m_Triangles[i] == nullptr)
-       { failed = true; }
+        m_pTriangles[i] = pVertices[i].Position;
+        m_pNormals  [i] = pVertices[i].Normal;
+        m_pTexCoords[i] = pVertices[i].TexCoord;
     }
 
-    if (failed)
-    { return false; }
+    for(u32 i=0; i<m_TriangleCount; ++i)
+    { m_pMaterialIds[i] = 0; }
 
     // BVHを構築します.
-    m_pBVH = BVH8::Create( m_Triangles.size(), m_Triangles.data() );
+    return Build(mode);
+}
+
+//-------------------------------------------------------------------------------------------------
+//      三角形数に合わせて頂点データの格納先を確保します.
+//-------------------------------------------------------------------------------------------------
+bool Mesh::Resize(size_t triangleCount)
+{
+    if ( triangleCount == 0 )
+    { return false; }
+
+    // 全て同じアリーナから確保して，読み込み時の確保と破棄時の解放を1回で済ませる.
+    auto vertexCount = triangleCount * 3;
+    m_Arena.Reserve( ( sizeof(Vector3) * 2 + sizeof(Vector2) ) * vertexCount
+                   + ( sizeof(s32) + sizeof(Primitive) ) * triangleCount
+                   + alignof(Primitive) * 5 );
+
+    m_pTriangles   = m_Arena.Alloc<Vector3>  ( vertexCount );
+    m_pNormals     = m_Arena.Alloc<Vector3>  ( vertexCount );
+    m_pTexCoords   = m_Arena.Alloc<Vector2>  ( vertexCount );
+    m_pMaterialIds = m_Arena.Alloc<s32>      ( triangleCount );
+    m_pPrimitives  = m_Arena.Alloc<Primitive>( triangleCount );
+
+    if ( m_pTriangles   == nullptr
+      || m_pNormals     == nullptr
+      || m_pTexCoords   == nullptr
+      || m_pMaterialIds == nullptr
+      || m_pPrimitives  == nullptr )
+    {
+        ELOG( "Error : Out of memory." );
+        return false;
+    }
 
+    m_TriangleCount = triangleCount;
     return true;
 }
 
+//-------------------------------------------------------------------------------------------------
+//      三角形を登録してBVHを構築します.
+//-------------------------------------------------------------------------------------------------
+bool Mesh::Build(BUILD_MODE mode)
+{
+    auto count = m_TriangleCount;
+    if ( count == 0 )
+    { return false; }
+
+    // 読み込んだ頂点座標を始点と2辺に置き換える.
+    for(size_t i=0; i<count; ++i)
+    {
+        auto* p = &m_pTriangles[i * 3];
+        p[1] = p[1] - p[0];
+        p[2] = p[2] - p[0];
+    }
+
+    std::vector<IShape*> shapes( count );
+    for(size_t i=0; i<count; ++i)
+    {
+        // 破棄時にデストラクタは呼ばないので，解放処理を持たない型であること.
+        new ( &m_pPrimitives[i] ) Primitive( this, static_cast<u32>( i ) );
+        shapes[i] = &m_pPrimitives[i];
+    }
+
+    m_pBVH = CreateBVH( count, shapes.data(), mode );
+
+    return ( m_pBVH != nullptr );
+}
+
 //-------------------------------------------------------------------------------------------------
 //      交差判定を行います.
 //-------------------------------------------------------------------------------------------------
@@ -518,13 +616,13 @@ Vector3 Mesh::GetCenter() const
 //-------------------------------------------------------------------------------------------------
 //      生成処理を行います.
 //-------------------------------------------------------------------------------------------------
-IShape* Mesh::Create(const char* filename)
+IShape* Mesh::Create(const char* filename, BUILD_MODE mode)
 {
     auto instance = new (std::nothrow) Mesh();
     if ( instance == nullptr )
     { return nullptr; }
 
-    if ( !instance->LoadFromFile(filename) )
+    if ( !instance->LoadFromFile(filename, mode) )
     {
         SafeRelease(instance);
         return nullptr;
@@ -533,16 +631,22 @@ IShape* Mesh::Create(const char* filename)
     return instance;
 }
 
+//-------------------------------------------------------------------------------------------------
+//      遮蔽判定を行います.
+//-------------------------------------------------------------------------------------------------
+bool Mesh::IsOccluded( const RaySet& raySet, f32 distance ) const
+{ return m_pBVH->IsOccluded( raySet, distance ); }
+
 //-------------------------------------------------------------------------------------------------
 //      生成処理を行います.
 //-------------------------------------------------------------------------------------------------
-IShape* Mesh::Create(u32 vertexCount, Vertex* pVertices, IMaterial* pMaterial)
+IShape* Mesh::Create(u32 vertexCount, Vertex* pVertices, IMaterial* pMaterial, BUILD_MODE mode)
 {
     auto instance = new (std::nothrow) Mesh();
     if ( instance == nullptr )
     { return nullptr; }
 
-    if ( !instance->Init(vertexCount, pVertices, pMaterial) )
+    if ( !instance->Init(vertexCount, pVertices, pMaterial, mode) )
     {
         SafeRelease(instance);
         return nullptr;
@@ -551,4 +655,152 @@ IShape* Mesh::Create(u32 vertexCount, Vertex* pVertices, IMaterial* pMaterial)
     return instance;
 }
 
+//-------------------------------------------------------------------------------------------------
+//      パケットにまとめたレイの交差判定を行います.
+//-------------------------------------------------------------------------------------------------
+u32 Mesh::IsHit8( const RayPacket8& packet, u32 mask, HitRecord* pRecords ) const
+{ return m_pBVH->IsHit8( packet, mask, pRecords ); }
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Mesh::Primitive class
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------------------------------
+//      コンストラクタです.
+//-------------------------------------------------------------------------------------------------
+Mesh::Primitive::Primitive(const Mesh* pMesh, u32 index)
+: m_pMesh( pMesh )
+, m_Index( index )
+{ /* DO_NOTHING */ }
+
+//-------------------------------------------------------------------------------------------------
+//      参照カウントを増やします.
+//-------------------------------------------------------------------------------------------------
+void Mesh::Primitive::AddRef()
+{ /* DO_NOTHING */ }
+
+//-------------------------------------------------------------------------------------------------
+//      解放処理を行います.
+//-------------------------------------------------------------------------------------------------
+void Mesh::Primitive::Release()
+{ /* DO_NOTHING */ }
+
+//-------------------------------------------------------------------------------------------------
+//      参照カウントを取得します.
+//-------------------------------------------------------------------------------------------------
+u32 Mesh::Primitive::GetCount() const
+{ return 1; }
+
+//-------------------------------------------------------------------------------------------------
+//      交差判定を行います.
+//-------------------------------------------------------------------------------------------------
+bool Mesh::Primitive::IsHit(const RaySet& raySet, HitRecord& record) const
+{
+    const auto* p = &m_pMesh->m_pTriangles[m_Index * 3];
+
+    f32     dist;
+    Vector2 barycentric;
+    if ( !Triangle::Intersect( p[0], p[1], p[2], raySet, record.distance, dist, barycentric ) )
+    { return false; }
+
+    auto id = m_pMesh->m_pMaterialIds[m_Index];
+
+    record.distance     = dist;
+    record.pShape       = this;
+    record.pMaterial    = ( id >= 0 ) ? m_pMesh->m_Materials[id] : nullptr;
+    record.barycentric  = barycentric;
+
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      遮蔽判定を行います.
+//-------------------------------------------------------------------------------------------------
+bool Mesh::Primitive::IsOccluded(const RaySet& raySet, f32 distance) const
+{
+    const auto* p = &m_pMesh->m_pTriangles[m_Index * 3];
+
+    f32     dist;
+    Vector2 barycentric;
+    return Triangle::Intersect( p[0], p[1], p[2], raySet, distance, dist, barycentric );
+}
+
+//-------------------------------------------------------------------------------------------------
+//      バウンディングボックスを取得します.
+//-------------------------------------------------------------------------------------------------
+BoundingBox Mesh::Primitive::GetBox() const
+{
+    Vector3 p[3];
+    GetPositions( p );
+
+    auto mini = Vector3::Min( Vector3::Min( p[0], p[1] ), p[2] );
+    auto maxi = Vector3::Max( Vector3::Max( p[0], p[1] ), p[2] );
+    return BoundingBox( mini, maxi );
+}
+
+//-------------------------------------------------------------------------------------------------
+//      中心座標を取得します.
+//-------------------------------------------------------------------------------------------------
+Vector3 Mesh::Primitive::GetCenter() const
+{ return GetBox().center; }
+
+//-------------------------------------------------------------------------------------------------
+//      法線ベクトルとテクスチャ座標を求めます.
+//-------------------------------------------------------------------------------------------------
+void Mesh::Primitive::CalcParam(const Vector3&, const Vector2& barycentric, Vector3* pOutNormal, Vector2* pOutTexCoord) const
+{
+    // 交差判定では参照しない頂点属性は，最近接の交差が決まった後にここでだけ読み込む.
+    const auto* n = &m_pMesh->m_pNormals  [m_Index * 3];
+    const auto* t = &m_pMesh->m_pTexCoords[m_Index * 3];
+
+    auto beta  = barycentric.x;
+    auto gamma = barycentric.y;
+    auto alpha = 1.0f - beta - gamma;
+    *pOutNormal = Vector3(
+        n[0].x * alpha + n[1].x * beta + n[2].x * gamma,
+        n[0].y * alpha + n[1].y * beta + n[2].y * gamma,
+        n[0].z * alpha + n[1].z * beta + n[2].z * gamma );
+    pOutNormal->SafeNormalize();
+
+    *pOutTexCoord = Vector2(
+        t[0].x * alpha + t[1].x * beta + t[2].x * gamma,
+        t[0].y * alpha + t[1].y * beta + t[2].y * gamma );
+}
+
+//-------------------------------------------------------------------------------------------------
+//      三角形の一部を包むバウンディングボックスを分割平面で左右に切り分けます.
+//-------------------------------------------------------------------------------------------------
+void Mesh::Primitive::SplitBox(s32 axis, f32 position, const BoundingBox& box, BoundingBox* pLeft, BoundingBox* pRight) const
+{
+    Vector3 p[3];
+    GetPositions( p );
+    Triangle::ClipBox( p, axis, position, box, pLeft, pRight );
+}
+
+//-------------------------------------------------------------------------------------------------
+//      始点と2辺，マテリアルを取得します.
+//-------------------------------------------------------------------------------------------------
+bool Mesh::Primitive::GetTriangle(Vector3* pTriangle, const IMaterial** ppMaterial) const
+{
+    const auto* p = &m_pMesh->m_pTriangles[m_Index * 3];
+    for(auto i=0; i<3; ++i)
+    { pTriangle[i] = p[i]; }
+
+    auto id = m_pMesh->m_pMaterialIds[m_Index];
+    *ppMaterial = ( id >= 0 ) ? m_pMesh->m_Materials[id] : nullptr;
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      始点と2辺から頂点座標を求めます.
+//-------------------------------------------------------------------------------------------------
+void Mesh::Primitive::GetPositions(Vector3* pPositions) const
+{
+    const auto* p = &m_pMesh->m_pTriangles[m_Index * 3];
+    pPositions[0] = p[0];
+    pPositions[1] = p[0] + p[1];
+    pPositions[2] = p[0] + p[2];
+}
+
 } // namespace s3d
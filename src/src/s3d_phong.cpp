@@ -65,7 +65,7 @@ u32 Phong::GetCount() const
 Color3 Phong::Shade( ShadingArg& arg ) const
 {
     // インポータンスサンプリング.
-    auto s = SamplePhong(arg.random.GetAsF32(), arg.random.GetAsF32(), m_Power);
+    auto s = SamplePhong(arg.sampler.GetAsF32(BOUNCE_DIMENSION_BSDF_U), arg.sampler.GetAsF32(BOUNCE_DIMENSION_BSDF_V), m_Power);
 
     auto n = (Vector3::Dot(arg.input, arg.normal) < 0.0f) ? arg.normal : -arg.normal;
 
@@ -82,7 +82,7 @@ Color3 Phong::Shade( ShadingArg& arg ) const
     auto cosine = abs(Vector3::Dot( dir, n ));
 
     arg.output = dir;
-    arg.dice = (arg.random.GetAsF32() >= m_Threshold);
+    arg.dice = (arg.sampler.GetAsF32(BOUNCE_DIMENSION_ROULETTE) >= m_Threshold);
 
     return m_Specular * cosine;
 }
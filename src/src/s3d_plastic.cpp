@@ -82,7 +82,7 @@ Color3 Plastic::Shade( ShadingArg& arg ) const
     auto R = R0 + ( 1.0f - R0 ) * temp1 * temp1 * temp1 * temp1 * temp1;
     auto P = ( R + 0.5f ) / 2.0f;
 
-    if ( arg.random.GetAsF32() <= P )
+    if ( arg.sampler.GetAsF32(BOUNCE_DIMENSION_LOBE) <= P )
     {
         // normalModの方向を基準とした正規直交基底(w, u, v)を作る。
         // この基底に対する半球内で次のレイを飛ばす。
@@ -95,7 +95,7 @@ Color3 Plastic::Shade( ShadingArg& arg ) const
         //const f32 x = r * cosf( phi );
         //const f32 y = r * sinf( phi );
         //const f32 z = SafeSqrt( 1.0f - ( x * x ) - ( y * y ) );
-        auto s = SampleLambert(arg.random.GetAsF32(), arg.random.GetAsF32());
+        auto s = SampleLambert(arg.sampler.GetAsF32(BOUNCE_DIMENSION_BSDF_U), arg.sampler.GetAsF32(BOUNCE_DIMENSION_BSDF_V));
 
         // 出射方向.
         Vector3 dir = Vector3::UnitVector( T * s.x + B * s.y + normalMod * s.z );
@@ -103,7 +103,7 @@ Color3 Plastic::Shade( ShadingArg& arg ) const
 
         // 重み更新 (飛ぶ方向が不定なので確率で割る必要あり).
         auto result = m_Diffuse  * R / P;
-        arg.dice = ( arg.random.GetAsF32() >= m_Threshold[0] );
+        arg.dice = ( arg.sampler.GetAsF32(BOUNCE_DIMENSION_ROULETTE) >= m_Threshold[0] );
 
         return result;
     }
@@ -116,7 +116,7 @@ Color3 Plastic::Shade( ShadingArg& arg ) const
         //const f32 x = cosf( phi ) * sinTheta;
         //const f32 y = sinf( phi ) * sinTheta;
         //const f32 z = cosTheta;
-        auto s = SamplePhong(arg.random.GetAsF32(), arg.random.GetAsF32(), m_Power);
+        auto s = SamplePhong(arg.sampler.GetAsF32(BOUNCE_DIMENSION_BSDF_U), arg.sampler.GetAsF32(BOUNCE_DIMENSION_BSDF_V), m_Power);
 
         // 反射ベクトル.
         Vector3 w = Vector3::Reflect( arg.input, normalMod );
@@ -135,7 +135,7 @@ Color3 Plastic::Shade( ShadingArg& arg ) const
         auto dots = Vector3::Dot( dir, normalMod );
 
         arg.output = dir;
-        arg.dice = ( arg.random.GetAsF32() >= m_Threshold[1] );
+        arg.dice = ( arg.sampler.GetAsF32(BOUNCE_DIMENSION_ROULETTE) >= m_Threshold[1] );
 
         return m_Specular * dots * ( 1.0f - R ) / ( 1.0f - P );
     }
@@ -10,6 +10,7 @@
 #include <cstdio>
 #include <thread>
 #include <mutex>
+#include <algorithm>
 #include <direct.h>
 
 #include <s3d_pt.h>
@@ -20,12 +21,8 @@
 #include <s3d_material.h>
 #include <s3d_testScene.h> // for Debug.
 #include <s3d_denoiser.h>
+#include <s3d_accel.h>
 #include <ppl.h>
-#include <stb_image_write.h>
-
-#if _OPENMP
-#include <omp.h>
-#endif
 
 
 //#define DEBUG_MODE
@@ -41,6 +38,53 @@ namespace /* anonymous */ {
 // Global Variables.
 //-------------------------------------------------------------------------------------------------
 const s3d::TONE_MAPPING_TYPE  ToneMappingType = s3d::TONE_MAPPING_ACES_FILMIC;
+const s32                     TileSize        = 16;     // 16x16ピクセルのタイルでレンダーターゲットの3KB程度をキャッシュに載せる.
+const f32                     ErrorEpsilon    = 1e-3f;  // 暗いピクセルの相対誤差が発散しないように加える値.
+const s32                     MaxRefineCount  = 8;      // 全タイルが収束した時に閾値を半分にする最大回数.
+const u32                     ProbePixelCount = TileSize * TileSize * 16;   // スループットを計測する最初のパスで追跡するピクセル数.
+
+//-------------------------------------------------------------------------------------------------
+//      輝度値を取得します.
+//-------------------------------------------------------------------------------------------------
+S3D_INLINE
+f32 Luminance( const s3d::Color3& value )
+{ return 0.299f * value.x + 0.587f * value.y + 0.114f * value.z; }
+
+//-------------------------------------------------------------------------------------------------
+//      10bitの値を3bit間隔に広げます.
+//-------------------------------------------------------------------------------------------------
+S3D_INLINE
+u32 ExpandBits( u32 value )
+{
+    value = ( value * 0x00010001u ) & 0xFF0000FFu;
+    value = ( value * 0x00000101u ) & 0x0F00F00Fu;
+    value = ( value * 0x00000011u ) & 0xC30C30C3u;
+    value = ( value * 0x00000005u ) & 0x49249249u;
+    return value;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      レイの並び替えキーを求めます.
+//-------------------------------------------------------------------------------------------------
+S3D_INLINE
+u64 CalcRayKey( const s3d::Vector3& pos, const s3d::Vector3& dir, const s3d::BoundingBox& box )
+{
+    // 方向の符号で大きく分けて，同じ象限の中は原点のモートン符号順に並べる.
+    auto octant = ( ( dir.x < 0.0f ) ? 0x1u : 0x0u )
+                | ( ( dir.y < 0.0f ) ? 0x2u : 0x0u )
+                | ( ( dir.z < 0.0f ) ? 0x4u : 0x0u );
+
+    auto size = box.maxi - box.mini;
+    u32 q[3];
+    for( auto i=0; i<3; ++i )
+    {
+        auto t = ( size.a[i] > 0.0f ) ? ( pos.a[i] - box.mini.a[i] ) / size.a[i] : 0.0f;
+        q[i] = static_cast<u32>( s3d::Clamp( t, 0.0f, 1.0f ) * 1023.0f );
+    }
+
+    auto morton = ( ExpandBits( q[0] ) << 2 ) | ( ExpandBits( q[1] ) << 1 ) | ExpandBits( q[2] );
+    return ( static_cast<u64>( octant ) << 30 ) | morton;
+}
 
 } // namespace /* anonymous */
 
@@ -55,8 +99,13 @@ namespace s3d {
 //      コンストラクタです.
 //-------------------------------------------------------------------------------------------------
 PathTracer::PathTracer()
-: m_Intermediate( nullptr )
+: m_SampleCounts( nullptr )
+, m_Moments     ( nullptr )
+, m_TileCountX  ( 0 )
+, m_WavefrontTile( 0 )
+, m_Threshold   ( 0.0f )
 , m_pScene      ( nullptr )
+, m_CaptureRequested( false )
 {
     m_RenderTarget = nullptr;
 }
@@ -67,7 +116,8 @@ PathTracer::PathTracer()
 PathTracer::~PathTracer()
 {
     SafeDeleteArray( m_RenderTarget );
-    SafeDeleteArray( m_Intermediate );
+    SafeDeleteArray( m_SampleCounts );
+    SafeDeleteArray( m_Moments );
     SafeDelete( m_pScene );
 }
 
@@ -100,102 +150,97 @@ bool PathTracer::Run( const Config& config )
     // レンダーターゲットを生成.
     auto size = m_Config.Width * m_Config.Height;
     m_RenderTarget = new Color3 [size];
-    m_Intermediate = new Color3 [size];
+    m_SampleCounts = new u32    [size];
+    m_Moments      = new f32    [size];
 
     // レンダーターゲットをクリア.
     parallel_for<size_t>(0, size, [&](size_t i)
     {
         m_RenderTarget[i] = Color3(0.0f, 0.0f, 0.0f);
-        m_Intermediate[i] = Color3(0.0f, 0.0f, 0.0f);
+        m_SampleCounts[i] = 0;
+        m_Moments     [i] = 0.0f;
     });
 
     // シーン生成.
+    Accel::ResetBuildTime();
     m_pScene = new TestScene( m_Config.Width, m_Config.Height );
 
     m_Updatable = true;
 
     timer.Stop();
-    ILOG("Scene Construct : %lf [msec]", timer.GetElapsedTimeMsec());
+    ILOG("Scene Construct : %lf [msec] (BLAS : %lf [msec], TLAS : %lf [msec])",
+        timer.GetElapsedTimeMsec(),
+        Accel::GetBuildTime(ACCEL_LEVEL_BOTTOM),
+        Accel::GetBuildTime(ACCEL_LEVEL_TOP));
 
     // 経路追跡を実行.
-    TracePath();
+    auto succeeded = TracePath();
 
     // シーンを破棄.
     SafeDelete( m_pScene );
 
     // レンダーターゲット解放.
     SafeDeleteArray(m_RenderTarget);
-    SafeDeleteArray(m_Intermediate);
+    SafeDeleteArray(m_SampleCounts);
+    SafeDeleteArray(m_Moments);
 
-    //return m_IsFinish;
-    return true;
+    return succeeded;
 }
 
+//-------------------------------------------------------------------------------------------------
+//      途中経過のキャプチャーを要求します.
+//-------------------------------------------------------------------------------------------------
+void PathTracer::RequestCapture()
+{ m_CaptureRequested = true; }
+
 //-------------------------------------------------------------------------------------------------
 //      レンダリング結果をキャプチャーします.
 //-------------------------------------------------------------------------------------------------
 void PathTracer::Capture( const char* filename )
 {
-    // トーンマッピングを実行.
-    ToneMapper::Map( ToneMappingType, m_Config.Width, m_Config.Height, m_RenderTarget, m_Intermediate );
-
-    auto size = m_Config.Width * m_Config.Height;
-    std::vector<uint8_t> outputs;
-    outputs.resize(size * 3);
-    parallel_for<size_t>(0, size, [&](size_t i)
-    {
-        auto r = m_Intermediate[i].x;
-        auto g = m_Intermediate[i].y;
-        auto b = m_Intermediate[i].z;
-
-        if ( r > 1.0f ) { r = 1.0f; }
-        if ( g > 1.0f ) { g = 1.0f; }
-        if ( b > 1.0f ) { b = 1.0f; }
-
-        if ( r < 0.0f ) { r = 0.0f; }
-        if ( g < 0.0f ) { g = 0.0f; }
-        if ( b < 0.0f ) { b = 0.0f; }
-
-        // sRGB OETF
-        r = (r <= 0.0031308f) ? 12.92f * r : std::pow(1.055f * r, 1.0f / 2.4f) - 0.055f;
-        g = (g <= 0.0031308f) ? 12.92f * g : std::pow(1.055f * g, 1.0f / 2.4f) - 0.055f;
-        b = (b <= 0.0031308f) ? 12.92f * b : std::pow(1.055f * b, 1.0f / 2.4f) - 0.055f;
-
-        u8 R = static_cast<u8>( r * 255.0f + 0.5f );
-        u8 G = static_cast<u8>( g * 255.0f + 0.5f );
-        u8 B = static_cast<u8>( b * 255.0f + 0.5f );
-
-        outputs[i * 3 + 0] = R;
-        outputs[i * 3 + 1] = G;
-        outputs[i * 3 + 2] = B;
-    });
-
-    // PNG出力.
-    void* ptr = outputs.data();
-    stbi_write_png(filename, m_Config.Width, m_Config.Height, 3, ptr, 0);
+    // スナップショットを取るだけで，トーンマッピングとPNG出力は出力スレッドで行う.
+    m_CaptureWriter.Request( filename, m_RenderTarget, m_SampleCounts );
 }
 
 
 //-------------------------------------------------------------------------------------------------
 //      指定方向からの放射輝度推定を行います.
 //-------------------------------------------------------------------------------------------------
-Color3 PathTracer::Radiance( const Ray& input )
+Color3 PathTracer::Radiance( const Ray& input, const Sampler& sampler )
 {
-    auto arg    = ShadingArg();
     auto raySet = MakeRaySet( input.pos, input.dir );
+    auto record = HitRecord();
+    m_pScene->Intersect( raySet, record );
+
+    return Radiance( raySet, record, sampler );
+}
+
+//-------------------------------------------------------------------------------------------------
+//      判定済みの一次レイの交差から放射輝度推定を行います.
+//-------------------------------------------------------------------------------------------------
+Color3 PathTracer::Radiance( const RaySet& primaryRaySet, const HitRecord& primary, const Sampler& sampler )
+{
+    auto arg    = ShadingArg();
+    auto raySet = primaryRaySet;
 
     Color3 W( 1.0f, 1.0f, 1.0f );
     Color3 L( 0.0f, 0.0f, 0.0f );
 
-    // 乱数設定.
-    arg.random = m_Random;
+    // サンプラー設定.
+    arg.sampler = sampler;
 
     for( auto depth=0; depth < m_Config.MaxBounceCount && m_Updatable ;++depth)
     {
-        auto record = HitRecord();
+        auto record = primary;
 
-        // 交差判定.
-        if ( !m_pScene->Intersect( raySet, record ) )
+        // 交差判定(一次レイは判定済み).
+        if ( depth > 0 )
+        {
+            record = HitRecord();
+            m_pScene->Intersect( raySet, record );
+        }
+
+        if ( record.pShape == nullptr )
         {
             L += Color3::Mul( W, m_pScene->SampleIBL( raySet.ray.dir ) );
             break;
@@ -203,6 +248,9 @@ Color3 PathTracer::Radiance( const Ray& input )
 
         auto pos = raySet.ray.pos + raySet.ray.dir * record.distance;
 
+        // 反射回数毎に別の次元を使う.
+        arg.sampler.SetBounce( depth );
+
         const auto shape    = record.pShape;
         const auto material = record.pMaterial;
         assert( shape    != nullptr );
@@ -218,7 +266,7 @@ Color3 PathTracer::Radiance( const Ray& input )
         // 直接光をサンプリング.
         if ( !record.pMaterial->HasDelta() )
         {
-            L += Color3::Mul( W, NextEventEstimation( pos, arg.normal, arg.texcoord, material, arg.random ) );
+            L += Color3::Mul( W, NextEventEstimation( pos, arg.normal, arg.texcoord, material, arg.sampler ) );
         }
 
         // 色を求める.
@@ -238,9 +286,6 @@ Color3 PathTracer::Radiance( const Ray& input )
         raySet = MakeRaySet( pos, arg.output );
     }
 
-    // 乱数を更新.
-    m_Random = arg.random;
-
     // 計算結果を返却.
     return L;
 }
@@ -254,24 +299,51 @@ Color3 PathTracer::NextEventEstimation
     const Vector3&      normal,
     const Vector2&      texcoord,
     const IMaterial*    pMaterial,
-    PCG&                random
+    const Sampler&      sampler
+)
+{
+    RaySet shadowRay;
+    f32    distance;
+    Color3 contribution;
+
+    // 光源までの間に遮蔽物が無ければライトにヒットした.
+    if ( SampleLight( position, normal, texcoord, pMaterial, sampler, shadowRay, distance, contribution )
+      && !m_pScene->IsOccluded( shadowRay, distance ) )
+    { return contribution; }
+
+    return Color3(0.0f, 0.0f, 0.0f);
+}
+
+//-------------------------------------------------------------------------------------------------
+//      光源をサンプリングしてシャドウレイを生成します.
+//-------------------------------------------------------------------------------------------------
+bool PathTracer::SampleLight
+(
+    const Vector3&      position,
+    const Vector3&      normal,
+    const Vector2&      texcoord,
+    const IMaterial*    pMaterial,
+    const Sampler&      sampler,
+    RaySet&             shadowRay,
+    f32&                distance,
+    Color3&             contribution
 )
 {
-    auto light = m_pScene->GetLight(random);
+    auto light = m_pScene->GetLight(sampler.GetAsF32(BOUNCE_DIMENSION_LIGHT_SELECT));
     Vector3 light_pos;
     float   light_pdf;
-    light->Sample(random, &light_pos, &light_pdf);
+    light->Sample(sampler.GetAsVector2(BOUNCE_DIMENSION_LIGHT_U), &light_pos, &light_pdf);
 
     auto light_dir  = light_pos - position;
     auto light_dist2 = Vector3::Dot(light_dir, light_dir);
     light_dir = Vector3::SafeUnitVector(light_dir);
 
-    auto shadowRay = MakeRaySet( position, light_dir );
+    shadowRay = MakeRaySet( position, light_dir );
 
     HitRecord shadowRecord;
 
-    // ライトにヒットした場合.
-    if ( m_pScene->Intersect(shadowRay, shadowRecord) && light == shadowRecord.pShape )
+    // 光源までの距離を求める.
+    if ( light->IsHit(shadowRay, shadowRecord) )
     {
         auto p = shadowRay.ray.pos + shadowRay.ray.dir * shadowRecord.distance;
         Vector3 light_normal;
@@ -285,71 +357,616 @@ Color3 PathTracer::NextEventEstimation
         auto brdf_pdf = abs(shadowRay.ray.dir.z / F_PI ) * cosLight / light_dist2;
         auto mis_weight = light_pdf / (brdf_pdf + light_pdf);
 
-        return shadowRecord.pMaterial->GetEmissive() * fs * mis_weight * (G / light_pdf);
+        distance     = shadowRecord.distance;
+        contribution = shadowRecord.pMaterial->GetEmissive() * fs * mis_weight * (G / light_pdf);
+        return true;
     }
 
-    return Color3(0.0f, 0.0f, 0.0f);
+    return false;
 }
 
 //-------------------------------------------------------------------------------------------------
 //      経路を追跡します.
 //-------------------------------------------------------------------------------------------------
-void PathTracer::TracePath()
+bool PathTracer::TracePath()
 {
     ILOG( "PathTrace Start.");
 
-    const auto halfRate = 0.5f;
+    // ワーカースレッドを起動.
+    auto workerCount = static_cast<u32>( s3d::Max( m_Config.CpuCoreCount, 0 ) );
+    if ( !m_Scheduler.Init( workerCount, m_Config.Width, m_Config.Height, TileSize ) )
+    {
+        ELOG( "Error : TileScheduler::Init() Failed." );
+        return false;
+    }
+
+    // ブルーノイズマスクなどは描画ループの外で生成しておく.
+    Sampler::Prepare( m_Config.SamplerType );
+
+    // 最初は全てのタイルにサンプルを追加する.
+    m_TileCountX = ( m_Config.Width  + TileSize - 1 ) / TileSize;
+    auto tileCountY = ( m_Config.Height + TileSize - 1 ) / TileSize;
+    m_TileActive.assign( m_TileCountX * tileCountY, 1 );
+    m_WavefrontTile = 0;
+    m_Threshold = m_Config.AdaptiveThreshold;
+
+    // 中断したレンダリングの続きから蓄積する.
+    // 失敗した場合に最初から描くと，再開したいチェックポイントを上書きしてしまうので中止する.
+    if ( m_Config.ResumePath != nullptr && !Resume( m_Config.ResumePath ) )
+    {
+        ELOG( "Error : Resume() Failed. filename = %s", m_Config.ResumePath );
+        m_Scheduler.Term();
+        return false;
+    }
+
+    // 強制終了に備えて定期的にチェックポイントを保存する.
+    auto checkpoint = ( m_Config.CheckpointPath != nullptr && m_Config.CheckpointIntervalSec > 0.0f );
+    if ( checkpoint && !m_Writer.Init( m_Config.CheckpointPath ) )
+    {
+        ELOG( "Error : CheckpointWriter::Init() Failed." );
+        checkpoint = false;
+    }
+
+    // 途中経過の画像はレンダリングを止めずに出力スレッドで書き出す.
+    if ( !m_CaptureWriter.Init( m_Config.Width, m_Config.Height, ToneMappingType ) )
+    {
+        ELOG( "Error : CaptureWriter::Init() Failed." );
+        m_Scheduler.Term();
+        return false;
+    }
 
-    // 乱数初期化.
-    m_Random.SetSeed( 3141592 );
+    m_Timer.Stop();
+    auto checkpointTime = m_Timer.GetElapsedTimeMsec();
+    auto captureTime    = checkpointTime;
+    auto captureIndex   = 0;
 
-    auto sampleCount = 0;
-    auto rayCount    = m_Config.Width * m_Config.Height;
+    // 後処理の時間を残して締め切りを決める.
+    const auto deadline   = ( m_Config.MaxRenderingSec - m_Config.ReservedSec ) * 1000.0;
+    auto       throughput = 0.0;    // 1ミリ秒あたりに追跡したピクセル数.
 
     while(m_Updatable)
     {
-    #if _OPENMP
-        #pragma omp parallel for schedule(dynamic) num_threads(72)
-    #endif
-        for( auto y=0; y<m_Config.Height; ++y )
+        // 最初のパスも含めて締め切りを守る.
+        m_Timer.Stop();
+        auto remain = deadline - m_Timer.GetElapsedTimeMsec();
+        if ( remain <= 0.0 )
+        { break; }
+
+        auto stopped = false;
+        if ( m_Config.Integrator == INTEGRATOR_WAVEFRONT )
         {
-        #if _OPENMP
-            auto thread_id = omp_get_thread_num();
-            auto group = thread_id % 2; // 0, 1でプロセッサグループを指定
-            GROUP_AFFINITY mask;
-            if (GetNumaNodeProcessorMaskEx(group, &mask))
-            { SetThreadGroupAffinity(GetCurrentThread(), &mask, nullptr); }
-        #endif
-
-            for( auto x=0; x<m_Config.Width ; ++x )
-            {
-                auto ray = m_pScene->GetRay(
-                    ( halfRate + x ) / m_Config.Width  - 0.5f,
-                    ( halfRate + y ) / m_Config.Height - 0.5f );
+            // 計測したスループットから残り時間で追跡できるピクセル数を見積もる.
+            // まだ計測していない場合は少数のタイルだけ追跡して計測する.
+            auto maxCount = ( throughput > 0.0 ) ? static_cast<u32>( s3d::Min( remain * throughput, 4294967295.0 ) ) : ProbePixelCount;
 
-                const auto idx = y * m_Config.Width + x;
-                m_RenderTarget[ idx ] += Radiance( ray );
-            }
+            Timer timer;
+            timer.Start();
+            auto count = TraceWavefront( maxCount );
+            timer.Stop();
+
+            throughput = count / s3d::Max( timer.GetElapsedTimeMsec(), 1e-3 );
+            stopped    = ( count == 0 );
+        }
+        else
+        {
+            // 前回のタイル毎の処理時間から，締め切りに間に合わないタイルはスケジューラが捨てる.
+            // 処理時間が分からない最初のパスは経過時間だけで打ち切る.
+            m_Scheduler.Run( [&](u32, const Tile& tile) { return RenderTile( tile ); }, remain );
+            stopped = ( m_Scheduler.GetSkipCount() > 0 );
         }
 
-        sampleCount += rayCount;
+        UpdateActiveTiles();
+
+        // 書き出しはスレッドに任せ，ここではバッファに写すだけにする.
+        m_Timer.Stop();
+        if ( checkpoint
+          && m_Timer.GetElapsedTimeMsec() - checkpointTime >= m_Config.CheckpointIntervalSec * 1000.0
+          && !m_Writer.IsBusy() )
+        {
+            StoreCheckpoint( m_Checkpoint );
+            m_Writer.Request( m_Checkpoint );
+            checkpointTime = m_Timer.GetElapsedTimeMsec();
+        }
 
+        // 一定間隔または要求があった場合に途中経過を出力する.
         m_Timer.Stop();
-        if (m_Timer.GetElapsedTimeSec() >= m_Config.MaxRenderingSec)
+        auto captureDue = m_Config.CaptureIntervalSec > 0.0f
+                       && m_Timer.GetElapsedTimeMsec() - captureTime >= m_Config.CaptureIntervalSec * 1000.0;
+        if ( m_CaptureRequested.exchange( false ) || captureDue )
         {
-            m_Updatable = false;
+            char filename[256];
+            sprintf_s( filename, sizeof(filename), "frame_%03d.png", captureIndex++ );
+            Capture( filename );
+            captureTime = m_Timer.GetElapsedTimeMsec();
+        }
+
+        if ( stopped )
+        {
+            ILOG( "Deadline reached in the middle of a pass." );
             break;
         }
     }
 
+    m_Updatable = false;
+
+    m_Scheduler.Term();
+
+    auto sampleCount = 0.0;
+    for( auto i=0; i<m_Config.Width * m_Config.Height; ++i )
+    { sampleCount += m_SampleCounts[i]; }
+
     m_Timer.Stop();
     auto sample_rate = (sampleCount / 1000.0) / m_Timer.GetElapsedTimeSec();
     ILOG( "Rendering Time %lf sec", m_Timer.GetElapsedTimeSec()); 
     ILOG( "%lf [Mrays/sec]", sample_rate);
 
     Capture("final.png");
+    m_CaptureWriter.Term();
+
+    // 画像を出力してから最終結果を保存する.
+    if ( checkpoint )
+    {
+        m_Writer.Term();
+        StoreCheckpoint( m_Checkpoint );
+        if ( !SaveCheckpoint( m_Config.CheckpointPath, m_Checkpoint ) )
+        { ELOG( "Error : SaveCheckpoint() Failed. filename = %s", m_Config.CheckpointPath ); }
+    }
 
     ILOG( "PathTrace End.");
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      現在の蓄積結果をチェックポイントに写します.
+//-------------------------------------------------------------------------------------------------
+void PathTracer::StoreCheckpoint( Checkpoint& checkpoint ) const
+{
+    auto size = m_Config.Width * m_Config.Height;
+
+    checkpoint.Width       = m_Config.Width;
+    checkpoint.Height      = m_Config.Height;
+    checkpoint.SamplerType = m_Config.SamplerType;
+    checkpoint.Threshold   = m_Threshold;
+    checkpoint.Radiance    .assign( m_RenderTarget, m_RenderTarget + size );
+    checkpoint.SampleCounts.assign( m_SampleCounts, m_SampleCounts + size );
+    checkpoint.Moments     .assign( m_Moments,      m_Moments      + size );
+}
+
+//-------------------------------------------------------------------------------------------------
+//      チェックポイントから蓄積結果を復元します.
+//-------------------------------------------------------------------------------------------------
+bool PathTracer::Resume( const char* filename )
+{
+    Checkpoint checkpoint;
+    if ( !LoadCheckpoint( filename, checkpoint ) )
+    { return false; }
+
+    // サンプル番号の続きから同じ系列を使うため，サンプラーも一致している必要がある.
+    if ( checkpoint.Width       != m_Config.Width
+      || checkpoint.Height      != m_Config.Height
+      || checkpoint.SamplerType != static_cast<u32>( m_Config.SamplerType ) )
+    { return false; }
+
+    auto size = m_Config.Width * m_Config.Height;
+    std::copy( checkpoint.Radiance    .begin(), checkpoint.Radiance    .end(), m_RenderTarget );
+    std::copy( checkpoint.SampleCounts.begin(), checkpoint.SampleCounts.end(), m_SampleCounts );
+    std::copy( checkpoint.Moments     .begin(), checkpoint.Moments     .end(), m_Moments );
+
+    // 収束したタイルは閾値と蓄積結果から決め直す.
+    if ( m_Threshold > 0.0f )
+    { m_Threshold = checkpoint.Threshold; }
+    UpdateActiveTiles();
+
+    auto sampleCount = 0.0;
+    for( auto i=0; i<size; ++i )
+    { sampleCount += m_SampleCounts[i]; }
+
+    ILOG( "Resumed from %s (%lf samples/pixel).", filename, sampleCount / size );
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      サブピクセル位置とレンズ上の位置をサンプリングして一次レイを生成します.
+//-------------------------------------------------------------------------------------------------
+Ray PathTracer::GetPrimaryRay( s32 x, s32 y, const Sampler& sampler )
+{
+    return m_pScene->GetRay(
+        ( x + sampler.GetAsF32( SAMPLE_DIMENSION_PIXEL_X ) ) / m_Config.Width  - 0.5f,
+        ( y + sampler.GetAsF32( SAMPLE_DIMENSION_PIXEL_Y ) ) / m_Config.Height - 0.5f,
+        sampler.GetAsVector2( SAMPLE_DIMENSION_LENS_U ) );
+}
+
+//-------------------------------------------------------------------------------------------------
+//      タイル内のピクセルの経路を追跡します.
+//-------------------------------------------------------------------------------------------------
+bool PathTracer::RenderTile( const Tile& tile )
+{
+    // 収束したタイルは処理しない.
+    if ( !m_TileActive[ GetTileIndex( tile.x, tile.y ) ] )
+    { return false; }
+
+    const auto type        = m_Config.SamplerType;
+    const auto sampleCount = s3d::Max( m_Config.TileSampleCount, 1 );
+
+    for( auto s=0; s<sampleCount; ++s )
+    {
+        // サンプル値はピクセルとピクセル毎のサンプル番号から決めるので，どのワーカーが処理しても同じ画像になる.
+        for( auto y=tile.y; y<tile.y + tile.h; ++y )
+        {
+            if ( m_Config.EnablePacket )
+            {
+                // 隣り合う8ピクセルの一次レイをまとめて判定する.
+                for( auto x=tile.x; x<tile.x + tile.w; x+=8 )
+                {
+                    auto count = s3d::Min( 8, tile.x + tile.w - x );
+
+                    Sampler samplers[8];
+                    Ray     rays[8];
+                    for( auto i=0; i<count; ++i )
+                    {
+                        const auto idx = y * m_Config.Width + x + i;
+                        samplers[i] = Sampler( type, x + i, y, m_SampleCounts[ idx ] );
+                        rays[i]     = GetPrimaryRay( x + i, y, samplers[i] );
+                    }
+
+                    auto packet = MakeRayPacket8( rays, count );
+
+                    HitRecord records[8];
+                    m_pScene->Intersect8( packet, records );
+
+                    for( auto i=0; i<count; ++i )
+                    {
+                        const auto idx = y * m_Config.Width + x + i;
+                        Accumulate( idx, Radiance( packet.raySet[i], records[i], samplers[i] ) );
+                    }
+                }
+                continue;
+            }
+
+            for( auto x=tile.x; x<tile.x + tile.w; ++x )
+            {
+                const auto idx = y * m_Config.Width + x;
+
+                Sampler sampler( type, x, y, m_SampleCounts[ idx ] );
+                auto ray = GetPrimaryRay( x, y, sampler );
+
+                Accumulate( idx, Radiance( ray, sampler ) );
+            }
+        }
+    }
+
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      全ピクセルに1サンプルずつウェーブフロント方式で経路を追跡します.
+//-------------------------------------------------------------------------------------------------
+u32 PathTracer::TraceWavefront( u32 maxPixelCount )
+{
+    const auto size = static_cast<u32>( m_Config.Width * m_Config.Height );
+
+    auto& paths = m_Paths;
+    if ( paths.position.size() != size )
+    {
+        paths.position    .resize( size );
+        paths.direction   .resize( size );
+        paths.throughput  .resize( size );
+        paths.radiance    .resize( size );
+        paths.sampler     .resize( size );
+        paths.record      .resize( size );
+        paths.key         .resize( size );
+        paths.shadowDir   .resize( size );
+        paths.shadowDist  .resize( size );
+        paths.shadowWeight.resize( size );
+        paths.pixel       .reserve( size );
+        paths.active      .reserve( size );
+        paths.hit         .reserve( size );
+        paths.shadow      .reserve( size );
+    }
+
+    // 収束していないタイルのピクセルだけを，最大ピクセル数に収まるタイルまで追跡する.
+    // 途中で打ち切ったパスが画像の上側に偏らないよう，前回の続きのタイルから始める.
+    const auto tileCount = static_cast<s32>( m_TileActive.size() );
+    paths.pixel.clear();
+    for( auto n=0; n<tileCount; ++n )
+    {
+        auto t = ( m_WavefrontTile + n ) % tileCount;
+        if ( !m_TileActive[t] )
+        { continue; }
+
+        auto tile = GetTile( t );
+        if ( paths.pixel.size() + tile.w * tile.h > maxPixelCount )
+        {
+            m_WavefrontTile = t;
+            break;
+        }
+
+        for( auto y=tile.y; y<tile.y + tile.h; ++y )
+        {
+            for( auto x=tile.x; x<tile.x + tile.w; ++x )
+            { paths.pixel.push_back( y * m_Config.Width + x ); }
+        }
+    }
+
+    // 一次レイを生成. 経路毎のサンプラーはピクセルとピクセル毎のサンプル番号から決定的に求める.
+    const auto count = paths.pixel.size();
+    paths.active.resize( count );
+    parallel_for<size_t>(0, count, [&](size_t k)
+    {
+        auto i = paths.pixel[k];
+        auto x = static_cast<s32>( i % m_Config.Width );
+        auto y = static_cast<s32>( i / m_Config.Width );
+
+        paths.sampler[i] = Sampler( m_Config.SamplerType, x, y, m_SampleCounts[i] );
+        auto ray = GetPrimaryRay( x, y, paths.sampler[i] );
+
+        paths.position  [i] = ray.pos;
+        paths.direction [i] = ray.dir;
+        paths.throughput[i] = Color3( 1.0f, 1.0f, 1.0f );
+        paths.radiance  [i] = Color3( 0.0f, 0.0f, 0.0f );
+        paths.active    [k] = i;
+    });
+
+    auto box = m_pScene->GetBox();
+
+    for( auto depth=0; depth < m_Config.MaxBounceCount && m_Updatable && !paths.active.empty(); ++depth )
+    {
+        SortRays( box );
+        ExtendRays();
+        ShadeHits( depth );
+        TraceShadowRays();
+    }
+
+    parallel_for<size_t>(0, count, [&](size_t k)
+    {
+        auto i = paths.pixel[k];
+        Accumulate( i, paths.radiance[i] );
+    });
+
+    return static_cast<u32>( count );
+}
+
+//-------------------------------------------------------------------------------------------------
+//      ピクセルにサンプルを蓄積します.
+//-------------------------------------------------------------------------------------------------
+void PathTracer::Accumulate( s32 index, const Color3& value )
+{
+    auto Y = Luminance( value );
+    m_RenderTarget[index] += value;
+    m_Moments     [index] += Y * Y;
+    m_SampleCounts[index]++;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      タイル内のピクセルの平均の相対誤差を推定します.
+//-------------------------------------------------------------------------------------------------
+f32 PathTracer::EstimateError( const Tile& tile ) const
+{
+    auto error = 0.0f;
+    for( auto y=tile.y; y<tile.y + tile.h; ++y )
+    {
+        for( auto x=tile.x; x<tile.x + tile.w; ++x )
+        {
+            const auto idx = y * m_Config.Width + x;
+            const auto n   = static_cast<f32>( m_SampleCounts[idx] );
+
+            // 標本分散から平均値の標準誤差を求め，平均値との比をとる.
+            auto mean     = Luminance( m_RenderTarget[idx] ) / n;
+            auto variance = s3d::Max( m_Moments[idx] / n - mean * mean, 0.0f ) / s3d::Max( n - 1.0f, 1.0f );
+            error += sqrtf( variance ) / ( mean + ErrorEpsilon );
+        }
+    }
+
+    return error / static_cast<f32>( tile.w * tile.h );
+}
+
+//-------------------------------------------------------------------------------------------------
+//      次のパスでサンプルを追加するタイルを決めます.
+//-------------------------------------------------------------------------------------------------
+void PathTracer::UpdateActiveTiles()
+{
+    if ( m_Threshold <= 0.0f )
+    { return; }
+
+    const auto tileCount = static_cast<s32>( m_TileActive.size() );
+
+    std::vector<f32> errors( tileCount );
+    parallel_for<s32>(0, tileCount, [&](s32 i)
+    {
+        auto tile = GetTile( i );
+
+        // タイル内のピクセルは同じ回数だけ処理されるので，先頭ピクセルのサンプル数で判定する.
+        // 分散の推定には2サンプル以上必要.
+        auto count = m_SampleCounts[ tile.y * m_Config.Width + tile.x ];
+        errors[i] = ( count < static_cast<u32>( s3d::Max( m_Config.AdaptiveMinSampleCount, 2 ) ) ) ? F_MAX : EstimateError( tile );
+    });
+
+    for( auto refine=0; refine <= MaxRefineCount; ++refine )
+    {
+        auto activeCount = 0;
+        for( auto i=0; i<tileCount; ++i )
+        {
+            m_TileActive[i] = ( errors[i] > m_Threshold ) ? 1 : 0;
+            activeCount += m_TileActive[i];
+        }
+
+        if ( activeCount > 0 )
+        { return; }
+
+        // 全て収束したら閾値を下げて残り時間で画質を上げる.
+        m_Threshold *= 0.5f;
+    }
+
+    // それでも収束している場合は全てのタイルに追加する.
+    m_TileActive.assign( tileCount, 1 );
+}
+
+//-------------------------------------------------------------------------------------------------
+//      タイル番号を取得します.
+//-------------------------------------------------------------------------------------------------
+s32 PathTracer::GetTileIndex( s32 x, s32 y ) const
+{ return ( y / TileSize ) * m_TileCountX + x / TileSize; }
+
+//-------------------------------------------------------------------------------------------------
+//      タイル番号からタイルを取得します.
+//-------------------------------------------------------------------------------------------------
+Tile PathTracer::GetTile( s32 index ) const
+{
+    Tile tile;
+    tile.x = ( index % m_TileCountX ) * TileSize;
+    tile.y = ( index / m_TileCountX ) * TileSize;
+    tile.w = s3d::Min( TileSize, m_Config.Width  - tile.x );
+    tile.h = s3d::Min( TileSize, m_Config.Height - tile.y );
+    return tile;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      追跡中のレイを原点と方向で並び替えます.
+//-------------------------------------------------------------------------------------------------
+void PathTracer::SortRays( const BoundingBox& box )
+{
+    auto& paths = m_Paths;
+    auto  count = paths.active.size();
+
+    parallel_for<size_t>(0, count, [&](size_t i)
+    {
+        auto index = paths.active[i];
+        paths.key[index] = CalcRayKey( paths.position[index], paths.direction[index], box );
+    });
+
+    parallel_radixsort( paths.active.begin(), paths.active.end(), [&](u32 index)
+    { return static_cast<size_t>( paths.key[index] ); });
+}
+
+//-------------------------------------------------------------------------------------------------
+//      追跡中のレイの交差判定をまとめて行います.
+//-------------------------------------------------------------------------------------------------
+void PathTracer::ExtendRays()
+{
+    auto& paths = m_Paths;
+    auto  count = paths.active.size();
+
+    parallel_for<size_t>(0, count, [&](size_t i)
+    {
+        auto index  = paths.active[i];
+        auto raySet = MakeRaySet( paths.position[index], paths.direction[index] );
+
+        auto& record = paths.record[index];
+        record = HitRecord();
+
+        // 交差しなかった経路は環境光を加えて終了.
+        if ( !m_pScene->Intersect( raySet, record ) )
+        {
+            auto ibl = m_pScene->SampleIBL( raySet.ray.dir );
+            paths.radiance[index] += Color3::Mul( paths.throughput[index], ibl );
+        }
+    });
+
+    // 交差した経路だけを残し，マテリアル毎にまとめる.
+    paths.hit.clear();
+    for( size_t i=0; i<count; ++i )
+    {
+        auto index = paths.active[i];
+        if ( paths.record[index].pShape != nullptr )
+        { paths.hit.push_back( index ); }
+    }
+
+    parallel_radixsort( paths.hit.begin(), paths.hit.end(), [&](u32 index)
+    { return reinterpret_cast<size_t>( paths.record[index].pMaterial ); });
+}
+
+//-------------------------------------------------------------------------------------------------
+//      交差した経路をマテリアル毎にまとめてシェーディングします.
+//-------------------------------------------------------------------------------------------------
+void PathTracer::ShadeHits( s32 depth )
+{
+    auto& paths = m_Paths;
+    auto  count = paths.hit.size();
+
+    // 最後のバウンスでは次のレイは不要.
+    auto last = ( depth + 1 >= m_Config.MaxBounceCount );
+
+    parallel_for<size_t>(0, count, [&](size_t i)
+    {
+        auto index = paths.hit[i];
+
+        const auto& record   = paths.record[index];
+        const auto  shape    = record.pShape;
+        const auto  material = record.pMaterial;
+        assert( shape    != nullptr );
+        assert( material != nullptr );
+
+        auto  pos = paths.position[index] + paths.direction[index] * record.distance;
+        auto& W   = paths.throughput[index];
+        auto& L   = paths.radiance  [index];
+
+        // 自己発光による放射輝度.
+        L += Color3::Mul( W, material->GetEmissive() );
+
+        auto arg = ShadingArg();
+        arg.input  = paths.direction[index];
+        arg.sampler = paths.sampler[index];
+        arg.sampler.SetBounce( depth );
+        shape->CalcParam(pos, record.barycentric, &arg.normal, &arg.texcoord);
+
+        // シャドウレイを生成.
+        paths.shadowDist[index] = -1.0f;
+        if ( !material->HasDelta() )
+        {
+            RaySet shadowRay;
+            f32    distance;
+            Color3 contribution;
+            if ( SampleLight( pos, arg.normal, arg.texcoord, material, arg.sampler, shadowRay, distance, contribution ) )
+            {
+                paths.shadowDir   [index] = shadowRay.ray.dir;
+                paths.shadowDist  [index] = distance;
+                paths.shadowWeight[index] = Color3::Mul( W, contribution );
+            }
+        }
+
+        // 色を求める.
+        W = Color3::Mul( W, material->Shade( arg ) );
+
+        paths.position [index] = pos;
+        paths.direction[index] = arg.output;
+
+        // 打ち切る経路は重みをゼロにして印を付ける.
+        if ( last || arg.dice ||
+           ( (W.x < FLT_EPSILON) && (W.y < FLT_EPSILON) && (W.z < FLT_EPSILON) ) )
+        { W = Color3( 0.0f, 0.0f, 0.0f ); }
+    });
+
+    // シャドウレイを持つ経路と，追跡を続ける経路をまとめる.
+    paths.shadow.clear();
+    paths.active.clear();
+    for( size_t i=0; i<count; ++i )
+    {
+        auto index = paths.hit[i];
+        if ( paths.shadowDist[index] >= 0.0f )
+        { paths.shadow.push_back( index ); }
+
+        const auto& W = paths.throughput[index];
+        if ( W.x > 0.0f || W.y > 0.0f || W.z > 0.0f )
+        { paths.active.push_back( index ); }
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+//      シャドウレイの遮蔽判定をまとめて行います.
+//-------------------------------------------------------------------------------------------------
+void PathTracer::TraceShadowRays()
+{
+    auto& paths = m_Paths;
+    auto  count = paths.shadow.size();
+
+    parallel_for<size_t>(0, count, [&](size_t i)
+    {
+        auto index     = paths.shadow[i];
+        auto shadowRay = MakeRaySet( paths.position[index], paths.shadowDir[index] );
+
+        if ( !m_pScene->IsOccluded( shadowRay, paths.shadowDist[index] ) )
+        { paths.radiance[index] += paths.shadowWeight[index]; }
+    });
 }
 
 } // namespace s3d
@@ -0,0 +1,380 @@
+﻿//-------------------------------------------------------------------------------------------------
+// File : s3d_sampler.cpp
+// Desc : Sampler Module.
+// Copyright(c) Project Asura. All right reserved.
+//-------------------------------------------------------------------------------------------------
+
+//-------------------------------------------------------------------------------------------------
+// Includes
+//-------------------------------------------------------------------------------------------------
+#include <s3d_sampler.h>
+#include <cmath>
+#include <vector>
+
+
+namespace /* anonymous */ {
+
+//-------------------------------------------------------------------------------------------------
+// Constant Values
+//-------------------------------------------------------------------------------------------------
+const u32 StratumSize   = 4;                            // 層化する1次元あたりの分割数.
+const u32 StratumCount  = StratumSize * StratumSize;    // 全ての層を1回ずつ通るサンプル数.
+const u32 MaskSize      = 64;                           // ブルーノイズマスクの一辺のピクセル数.
+const u32 MaskCount     = MaskSize * MaskSize;          // ブルーノイズマスクのピクセル数.
+const u32 MaskShift     = 20;                           // マスクの順位を32bitの固定小数に変換するシフト量.
+
+// Sobol列の2次元目の方向数.
+const u32 SobolMatrix[32] = {
+    0x80000000u, 0xc0000000u, 0xa0000000u, 0xf0000000u, 0x88000000u, 0xcc000000u, 0xaa000000u, 0xff000000u,
+    0x80800000u, 0xc0c00000u, 0xa0a00000u, 0xf0f00000u, 0x88880000u, 0xcccc0000u, 0xaaaa0000u, 0xffff0000u,
+    0x80008000u, 0xc000c000u, 0xa000a000u, 0xf000f000u, 0x88008800u, 0xcc00cc00u, 0xaa00aa00u, 0xff00ff00u,
+    0x80808080u, 0xc0c0c0c0u, 0xa0a0a0a0u, 0xf0f0f0f0u, 0x88888888u, 0xccccccccu, 0xaaaaaaaau, 0xffffffffu,
+};
+
+//-------------------------------------------------------------------------------------------------
+//      3つの値から32bitのハッシュ値を求めます.
+//-------------------------------------------------------------------------------------------------
+S3D_INLINE
+u32 Hash( u32 a, u32 b, u32 c )
+{ return static_cast<u32>( s3d::MakeSeed( a, b, c ) >> 32 ); }
+
+//-------------------------------------------------------------------------------------------------
+//      ビット列を反転します.
+//-------------------------------------------------------------------------------------------------
+S3D_INLINE
+u32 ReverseBits( u32 value )
+{
+    value = ( value << 16 ) | ( value >> 16 );
+    value = ( ( value & 0x00ff00ffu ) << 8 ) | ( ( value & 0xff00ff00u ) >> 8 );
+    value = ( ( value & 0x0f0f0f0fu ) << 4 ) | ( ( value & 0xf0f0f0f0u ) >> 4 );
+    value = ( ( value & 0x33333333u ) << 2 ) | ( ( value & 0xccccccccu ) >> 2 );
+    value = ( ( value & 0x55555555u ) << 1 ) | ( ( value & 0xaaaaaaaau ) >> 1 );
+    return value;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      下位ビットが上位ビットに依存しない置換を行います(Laine-Karras).
+//-------------------------------------------------------------------------------------------------
+S3D_INLINE
+u32 LaineKarrasPermutation( u32 value, u32 seed )
+{
+    value += seed;
+    value ^= value * 0x6c50b47cu;
+    value ^= value * 0xb82f1e52u;
+    value ^= value * 0xc7afe638u;
+    value ^= value * 0x8d22f6e6u;
+    return value;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      Owenスクランブルを掛けます.
+//-------------------------------------------------------------------------------------------------
+S3D_INLINE
+u32 OwenScramble( u32 value, u32 seed )
+{ return ReverseBits( LaineKarrasPermutation( ReverseBits( value ), seed ) ); }
+
+//-------------------------------------------------------------------------------------------------
+//      Sobol列の値を求めます.
+//-------------------------------------------------------------------------------------------------
+S3D_INLINE
+u32 Sobol( u32 index, u32 dimension )
+{
+    if ( dimension == 0 )
+    { return ReverseBits( index ); }
+
+    auto result = 0u;
+    for( auto i=0; index != 0; index >>= 1, ++i )
+    {
+        if ( index & 0x1 )
+        { result ^= SobolMatrix[i]; }
+    }
+    return result;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      シャッフルしてOwenスクランブルを掛けたSobol列の値を求めます.
+//
+//      2次元毎に番号をシャッフルして別の列として扱うので，Sobol列の先頭2次元だけで任意の次元数を扱える.
+//-------------------------------------------------------------------------------------------------
+S3D_INLINE
+u32 ShuffledSobol( u32 index, u32 dimension, u32 seed )
+{
+    auto shuffled = OwenScramble( index, Hash( seed, dimension >> 1, 0 ) );
+    return OwenScramble( Sobol( shuffled, dimension & 0x1 ), Hash( seed, dimension, 1 ) );
+}
+
+//-------------------------------------------------------------------------------------------------
+//      [0, count)の値を並び替えます(Kensler).
+//-------------------------------------------------------------------------------------------------
+u32 Permute( u32 value, u32 count, u32 seed )
+{
+    auto w = count - 1;
+    w |= w >> 1;
+    w |= w >> 2;
+    w |= w >> 4;
+    w |= w >> 8;
+    w |= w >> 16;
+
+    do
+    {
+        value ^= seed;
+        value *= 0xe170893du;
+        value ^= seed >> 16;
+        value ^= ( value & w ) >> 4;
+        value ^= seed >> 8;
+        value *= 0x0929eb3fu;
+        value ^= seed >> 23;
+        value ^= ( value & w ) >> 1;
+        value *= 1 | seed >> 27;
+        value *= 0x6935fa69u;
+        value ^= ( value & w ) >> 11;
+        value *= 0x74dcb303u;
+        value ^= ( value & w ) >> 2;
+        value *= 0x9e501cc3u;
+        value ^= ( value & w ) >> 2;
+        value *= 0xc860a3dfu;
+        value &= w;
+        value ^= value >> 5;
+    }
+    while ( value >= count );
+
+    return ( value + seed ) % count;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// BlueNoiseMask class
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class BlueNoiseMask
+{
+public:
+    //---------------------------------------------------------------------------------------------
+    //      void-and-cluster法でマスクを生成します.
+    //---------------------------------------------------------------------------------------------
+    BlueNoiseMask()
+    : m_Filter  ( MaskCount )
+    , m_Pattern ( MaskCount )
+    , m_Energy  ( MaskCount )
+    {
+        const auto sigma = 1.5f;
+        for( u32 i=0; i<MaskCount; ++i )
+        {
+            // トーラス上の距離.
+            auto dx = static_cast<f32>( s3d::Min( i % MaskSize, MaskSize - i % MaskSize ) );
+            auto dy = static_cast<f32>( s3d::Min( i / MaskSize, MaskSize - i / MaskSize ) );
+            m_Filter[i] = expf( -( dx * dx + dy * dy ) / ( 2.0f * sigma * sigma ) );
+        }
+
+        // 初期パターンを乱数で配置.
+        s3d::PCG random( 3141592 );
+        auto ones = 0u;
+        while( ones < MaskCount / 10 )
+        {
+            auto i = random.GetAsU32() % MaskCount;
+            if ( !m_Pattern[i] )
+            {
+                Toggle( i );
+                ones++;
+            }
+        }
+
+        // 最も密な点を最も疎な位置に移す操作を収束するまで繰り返す.
+        for( u32 i=0; i<MaskCount; ++i )
+        {
+            auto cluster = Find( true );
+            Toggle( cluster );
+            auto vacancy = Find( false );
+            Toggle( vacancy );
+            if ( cluster == vacancy )
+            { break; }
+        }
+
+        auto pattern = m_Pattern;
+        auto energy  = m_Energy;
+
+        // 初期パターンの点は密な順に取り除いて順位を付ける.
+        for( auto rank=ones; rank > 0; --rank )
+        {
+            auto cluster = Find( true );
+            Toggle( cluster );
+            m_Rank[cluster] = static_cast<u16>( rank - 1 );
+        }
+
+        // 残りは疎な位置から順に埋めて順位を付ける.
+        m_Pattern = pattern;
+        m_Energy  = energy;
+        for( auto rank=ones; rank < MaskCount; ++rank )
+        {
+            auto vacancy = Find( false );
+            Toggle( vacancy );
+            m_Rank[vacancy] = static_cast<u16>( rank );
+        }
+    }
+
+    //---------------------------------------------------------------------------------------------
+    //      マスクの値を32bitの固定小数で取得します.
+    //---------------------------------------------------------------------------------------------
+    u32 Get( u32 x, u32 y ) const
+    {
+        auto i = ( y % MaskSize ) * MaskSize + ( x % MaskSize );
+        return ( static_cast<u32>( m_Rank[i] ) << MaskShift ) | ( 1u << ( MaskShift - 1 ) );
+    }
+
+private:
+    std::vector<f32>    m_Filter;               //!< ガウスフィルタです.
+    std::vector<bool>   m_Pattern;              //!< 二値パターンです.
+    std::vector<f32>    m_Energy;               //!< 二値パターンをフィルタした値です.
+    u16                 m_Rank[MaskCount];      //!< ピクセル毎の順位です.
+
+    //---------------------------------------------------------------------------------------------
+    //      点を反転してエネルギーを更新します.
+    //---------------------------------------------------------------------------------------------
+    void Toggle( u32 index )
+    {
+        m_Pattern[index] = !m_Pattern[index];
+        auto sign = m_Pattern[index] ? 1.0f : -1.0f;
+
+        auto ix = index % MaskSize;
+        auto iy = index / MaskSize;
+        for( u32 i=0; i<MaskCount; ++i )
+        {
+            auto dx = ( i % MaskSize - ix ) & ( MaskSize - 1 );
+            auto dy = ( i / MaskSize - iy ) & ( MaskSize - 1 );
+            m_Energy[i] += sign * m_Filter[ dy * MaskSize + dx ];
+        }
+    }
+
+    //---------------------------------------------------------------------------------------------
+    //      最も密な点，または最も疎な空きを探します.
+    //---------------------------------------------------------------------------------------------
+    u32 Find( bool cluster ) const
+    {
+        auto result = 0u;
+        auto best   = cluster ? -s3d::F_MAX : s3d::F_MAX;
+        for( u32 i=0; i<MaskCount; ++i )
+        {
+            if ( m_Pattern[i] != cluster )
+            { continue; }
+
+            if ( cluster ? ( m_Energy[i] > best ) : ( m_Energy[i] < best ) )
+            {
+                best   = m_Energy[i];
+                result = i;
+            }
+        }
+        return result;
+    }
+};
+
+//-------------------------------------------------------------------------------------------------
+//      ブルーノイズマスクを取得します.
+//-------------------------------------------------------------------------------------------------
+const BlueNoiseMask& GetBlueNoiseMask()
+{
+    static const BlueNoiseMask s_Mask;
+    return s_Mask;
+}
+
+} // namespace /* anonymous */
+
+
+namespace s3d {
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Sampler class
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------------------------------
+//      コンストラクタです.
+//-------------------------------------------------------------------------------------------------
+Sampler::Sampler()
+: m_Type        ( SAMPLER_RANDOM )
+, m_X           ( 0 )
+, m_Y           ( 0 )
+, m_Pixel       ( 0 )
+, m_Index       ( 0 )
+, m_Dimension   ( 0 )
+{ /* DO_NOTHING */ }
+
+//-------------------------------------------------------------------------------------------------
+//      引数付きコンストラクタです.
+//-------------------------------------------------------------------------------------------------
+Sampler::Sampler( SAMPLER_TYPE type, u32 x, u32 y, u32 index )
+: m_Type        ( type )
+, m_X           ( x )
+, m_Y           ( y )
+, m_Pixel       ( Hash( x, y, 0 ) )
+, m_Index       ( index )
+, m_Dimension   ( 0 )
+{ /* DO_NOTHING */ }
+
+//-------------------------------------------------------------------------------------------------
+//      サンプラーが使うテーブルを生成します.
+//-------------------------------------------------------------------------------------------------
+void Sampler::Prepare( SAMPLER_TYPE type )
+{
+    if ( type == SAMPLER_BLUE_NOISE )
+    { GetBlueNoiseMask(); }
+}
+
+//-------------------------------------------------------------------------------------------------
+//      以降の取得で基準とする次元を設定します.
+//-------------------------------------------------------------------------------------------------
+void Sampler::SetDimension( u32 dimension )
+{ m_Dimension = dimension; }
+
+//-------------------------------------------------------------------------------------------------
+//      反射回数に対応する基準の次元を設定します.
+//-------------------------------------------------------------------------------------------------
+void Sampler::SetBounce( s32 depth )
+{ m_Dimension = SAMPLE_DIMENSION_COUNT + static_cast<u32>( depth ) * BOUNCE_DIMENSION_COUNT; }
+
+//-------------------------------------------------------------------------------------------------
+//      [0, 2^32)のサンプル値を取得します.
+//-------------------------------------------------------------------------------------------------
+u32 Sampler::GetAsU32( u32 offset ) const
+{
+    const auto dimension = m_Dimension + offset;
+
+    switch( m_Type )
+    {
+    case SAMPLER_STRATIFIED:
+        {
+            // 2次元の組毎に，StratumCount個のサンプルで全ての層を1回ずつ通るように並び替える.
+            auto block   = m_Index / StratumCount;
+            auto cell    = Permute( m_Index % StratumCount, StratumCount, Hash( m_Pixel, dimension >> 1, block ) );
+            auto stratum = ( dimension & 0x1 ) ? ( cell / StratumSize ) : ( cell % StratumSize );
+            auto jitter  = Hash( m_Pixel, m_Index, dimension ) >> 2;
+            return ( stratum << 30 ) | jitter;
+        }
+
+    case SAMPLER_SOBOL:
+        { return ShuffledSobol( m_Index, dimension, m_Pixel ); }
+
+    case SAMPLER_BLUE_NOISE:
+        {
+            // 全ピクセルで共通の列をブルーノイズの値だけ回転させ，誤差を高周波に寄せる.
+            auto offset = Hash( dimension, 0, 2 );
+            auto mask   = GetBlueNoiseMask().Get( m_X + offset, m_Y + ( offset >> 16 ) );
+            return ShuffledSobol( m_Index, dimension, 0 ) + mask;
+        }
+
+    default:
+        break;
+    }
+
+    return Hash( m_Pixel, m_Index, dimension );
+}
+
+//-------------------------------------------------------------------------------------------------
+//      [0, 1)のサンプル値を取得します.
+//-------------------------------------------------------------------------------------------------
+f32 Sampler::GetAsF32( u32 offset ) const
+{ return static_cast<f32>( GetAsU32( offset ) >> 8 ) / 16777216.0f; }
+
+//-------------------------------------------------------------------------------------------------
+//      [0, 1)^2のサンプル値を取得します.
+//-------------------------------------------------------------------------------------------------
+Vector2 Sampler::GetAsVector2( u32 offset ) const
+{ return Vector2( GetAsF32( offset ), GetAsF32( offset + 1 ) ); }
+
+} // namespace s3d
@@ -0,0 +1,338 @@
+﻿//-------------------------------------------------------------------------------------------------
+// File : s3d_scheduler.cpp
+// Desc : Tile Scheduler Module.
+// Copyright(c) Project Asura. All right reserved.
+//-------------------------------------------------------------------------------------------------
+
+//-------------------------------------------------------------------------------------------------
+// Includes
+//-------------------------------------------------------------------------------------------------
+#include <s3d_scheduler.h>
+#include <s3d_math.h>
+#include <s3d_timer.h>
+#include <algorithm>
+#include <numeric>
+#include <Windows.h>
+
+
+namespace /* anonymous */ {
+
+//-------------------------------------------------------------------------------------------------
+//      16bitの値を1bit間隔に広げます.
+//-------------------------------------------------------------------------------------------------
+S3D_INLINE
+u32 ExpandBits( u32 value )
+{
+    value &= 0x0000ffffu;
+    value = ( value | ( value << 8 ) ) & 0x00ff00ffu;
+    value = ( value | ( value << 4 ) ) & 0x0f0f0f0fu;
+    value = ( value | ( value << 2 ) ) & 0x33333333u;
+    value = ( value | ( value << 1 ) ) & 0x55555555u;
+    return value;
+}
+
+} // namespace /* anonymous */
+
+
+namespace s3d {
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// TileScheduler class
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------------------------------
+//      コンストラクタです.
+//-------------------------------------------------------------------------------------------------
+TileScheduler::TileScheduler()
+: m_HasCost     ( false )
+, m_pWorkers    ( nullptr )
+, m_WorkerCount ( 0 )
+, m_Generation  ( 0 )
+, m_BusyCount   ( 0 )
+, m_Exit        ( false )
+, m_pFunc       ( nullptr )
+, m_TimeLimit   ( -1.0 )
+, m_SkipCount   ( 0 )
+{ /* DO_NOTHING */ }
+
+//-------------------------------------------------------------------------------------------------
+//      デストラクタです.
+//-------------------------------------------------------------------------------------------------
+TileScheduler::~TileScheduler()
+{ Term(); }
+
+//-------------------------------------------------------------------------------------------------
+//      初期化処理を行います.
+//-------------------------------------------------------------------------------------------------
+bool TileScheduler::Init( u32 workerCount, s32 width, s32 height, s32 tileSize )
+{
+    Term();
+
+    if ( width <= 0 || height <= 0 || tileSize <= 0 )
+    { return false; }
+
+    if ( workerCount == 0 )
+    { workerCount = s3d::Max( std::thread::hardware_concurrency(), 1u ); }
+
+    // タイルに分割.
+    auto countX = ( width  + tileSize - 1 ) / tileSize;
+    auto countY = ( height + tileSize - 1 ) / tileSize;
+
+    std::vector<std::pair<u32, Tile>> tiles;
+    tiles.reserve( countX * countY );
+    for( auto j=0; j<countY; ++j )
+    {
+        for( auto i=0; i<countX; ++i )
+        {
+            Tile tile;
+            tile.x = i * tileSize;
+            tile.y = j * tileSize;
+            tile.w = s3d::Min( tileSize, width  - tile.x );
+            tile.h = s3d::Min( tileSize, height - tile.y );
+
+            auto code = ( ExpandBits( j ) << 1 ) | ExpandBits( i );
+            tiles.push_back( std::make_pair( code, tile ) );
+        }
+    }
+
+    // 近いタイルが同じワーカーに割り当てられるようにモートン順に並べる.
+    std::sort( tiles.begin(), tiles.end(),
+        []( const std::pair<u32, Tile>& a, const std::pair<u32, Tile>& b )
+        { return a.first < b.first; });
+
+    m_Tiles.resize( tiles.size() );
+    for( size_t i=0; i<tiles.size(); ++i )
+    { m_Tiles[i] = tiles[i].second; }
+
+    m_Costs.assign( m_Tiles.size(), 0.0 );
+    m_HasCost = false;
+
+    m_pWorkers = new(std::nothrow) Worker [ workerCount ];
+    if ( m_pWorkers == nullptr )
+    { return false; }
+
+    m_WorkerCount = workerCount;
+    m_Exit        = false;
+
+    // 再初期化した場合も以前の実行を処理しないよう，現在の世代から待たせる.
+    for( u32 i=0; i<workerCount; ++i )
+    { m_pWorkers[i].thread = std::thread( &TileScheduler::WorkerMain, this, i, m_Generation ); }
+
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      終了処理を行います.
+//-------------------------------------------------------------------------------------------------
+void TileScheduler::Term()
+{
+    if ( m_pWorkers != nullptr )
+    {
+        {
+            std::lock_guard<std::mutex> locker( m_Mutex );
+            m_Exit = true;
+        }
+        m_StartCond.notify_all();
+
+        for( u32 i=0; i<m_WorkerCount; ++i )
+        {
+            if ( m_pWorkers[i].thread.joinable() )
+            { m_pWorkers[i].thread.join(); }
+        }
+    }
+
+    SafeDeleteArray( m_pWorkers );
+    m_WorkerCount = 0;
+    m_Tiles.clear();
+    m_Costs.clear();
+    m_HasCost = false;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      全てのタイルを処理します.
+//-------------------------------------------------------------------------------------------------
+void TileScheduler::Run( const TileFunc& func, f64 timeLimitMsec )
+{
+    if ( m_pWorkers == nullptr || m_Tiles.empty() )
+    { return; }
+
+    std::unique_lock<std::mutex> locker( m_Mutex );
+
+    Distribute();
+
+    m_Timer.Start();
+    m_TimeLimit = timeLimitMsec;
+    m_SkipCount = 0;
+    m_pFunc     = &func;
+    m_BusyCount = m_WorkerCount;
+    m_Generation++;
+    m_StartCond.notify_all();
+
+    // 全てのワーカーが手を離すまで待つ.
+    m_DoneCond.wait( locker, [&]{ return m_BusyCount == 0; } );
+    m_pFunc   = nullptr;
+    m_HasCost = true;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      ワーカースレッド数を取得します.
+//-------------------------------------------------------------------------------------------------
+u32 TileScheduler::GetWorkerCount() const
+{ return m_WorkerCount; }
+
+//-------------------------------------------------------------------------------------------------
+//      タイル数を取得します.
+//-------------------------------------------------------------------------------------------------
+u32 TileScheduler::GetTileCount() const
+{ return static_cast<u32>( m_Tiles.size() ); }
+
+//-------------------------------------------------------------------------------------------------
+//      前回の実行でタイルの処理にかかった時間をミリ秒単位で取得します.
+//-------------------------------------------------------------------------------------------------
+f64 TileScheduler::GetTileCost( u32 index ) const
+{ return m_Costs[index]; }
+
+//-------------------------------------------------------------------------------------------------
+//      前回の実行で制限時間のために処理しなかったタイル数を取得します.
+//-------------------------------------------------------------------------------------------------
+u32 TileScheduler::GetSkipCount() const
+{ return m_SkipCount; }
+
+//-------------------------------------------------------------------------------------------------
+//      タイルをワーカーのキューに割り当てます.
+//-------------------------------------------------------------------------------------------------
+void TileScheduler::Distribute()
+{
+    auto tileCount = static_cast<u32>( m_Tiles.size() );
+
+    // 初回はモートン順の連続した範囲をワーカーに割り当てる.
+    if ( !m_HasCost )
+    {
+        for( u32 i=0; i<tileCount; ++i )
+        {
+            auto id = static_cast<u32>( u64( i ) * m_WorkerCount / tileCount );
+            std::lock_guard<std::mutex> locker( m_pWorkers[id].mutex );
+            m_pWorkers[id].queue.push_back( i );
+        }
+        return;
+    }
+
+    // 前回の処理時間が長いタイルから順に，割り当て済みの合計時間が最も短いワーカーに積む(LPT).
+    // 各キューは重い順に並ぶので，末尾から奪われるのは軽いタイルになる.
+    std::vector<u32> order( tileCount );
+    std::iota( order.begin(), order.end(), 0u );
+    std::stable_sort( order.begin(), order.end(),
+        [&]( u32 a, u32 b ) { return m_Costs[a] > m_Costs[b]; });
+
+    std::vector<f64> loads( m_WorkerCount, 0.0 );
+    for( auto index : order )
+    {
+        u32 id = 0;
+        for( u32 i=1; i<m_WorkerCount; ++i )
+        {
+            if ( loads[i] < loads[id] )
+            { id = i; }
+        }
+
+        loads[id] += m_Costs[index];
+
+        std::lock_guard<std::mutex> locker( m_pWorkers[id].mutex );
+        m_pWorkers[id].queue.push_back( index );
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+//      ワーカースレッドのメイン関数です.
+//-------------------------------------------------------------------------------------------------
+void TileScheduler::WorkerMain( u32 id, u64 generation )
+{
+    // プロセッサグループを跨いで全コアを使えるよう，起動時に一度だけワーカーをグループに順に割り当てる.
+    auto groupCount = GetActiveProcessorGroupCount();
+    if ( groupCount > 1 )
+    {
+        GROUP_AFFINITY affinity = {};
+        affinity.Group = static_cast<WORD>( id % groupCount );
+
+        auto count = GetActiveProcessorCount( affinity.Group );
+        affinity.Mask = ( count >= sizeof(KAFFINITY) * 8 ) ? ~KAFFINITY(0) : ( ( KAFFINITY(1) << count ) - 1 );
+        SetThreadGroupAffinity( GetCurrentThread(), &affinity, nullptr );
+    }
+
+    for(;;)
+    {
+        {
+            std::unique_lock<std::mutex> locker( m_Mutex );
+            m_StartCond.wait( locker, [&]{ return m_Exit || m_Generation != generation; } );
+            if ( m_Exit )
+            { return; }
+
+            generation = m_Generation;
+        }
+
+        // 次回の割り当てに使うため，タイル毎の処理時間を記録する.
+        Timer timer;
+        u32   index = 0;
+        while( Pop( id, index ) || Steal( id, index ) )
+        {
+            // 前回の処理時間を足すと制限時間を超えるタイルは捨てる.
+            // 処理時間は更新しないので，次回の割り当てには前回の値を使う.
+            if ( m_TimeLimit >= 0.0 && m_Timer.GetLapTimeMsec() + m_Costs[index] > m_TimeLimit )
+            {
+                m_SkipCount++;
+                continue;
+            }
+
+            // 処理しなかったタイルの時間を記録すると，再び処理する時に軽いタイルと見誤る.
+            timer.Start();
+            auto processed = ( *m_pFunc )( id, m_Tiles[index] );
+            timer.Stop();
+            if ( processed )
+            { m_Costs[index] = timer.GetElapsedTimeMsec(); }
+        }
+
+        {
+            std::lock_guard<std::mutex> locker( m_Mutex );
+            m_BusyCount--;
+            if ( m_BusyCount == 0 )
+            { m_DoneCond.notify_all(); }
+        }
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+//      自分のキューの先頭からタイルを取り出します.
+//-------------------------------------------------------------------------------------------------
+bool TileScheduler::Pop( u32 id, u32& index )
+{
+    auto& worker = m_pWorkers[id];
+    std::lock_guard<std::mutex> locker( worker.mutex );
+    if ( worker.queue.empty() )
+    { return false; }
+
+    index = worker.queue.front();
+    worker.queue.pop_front();
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      他のワーカーのキューの末尾からタイルを奪います.
+//-------------------------------------------------------------------------------------------------
+bool TileScheduler::Steal( u32 id, u32& index )
+{
+    // 持ち主が処理している位置から最も遠いタイルを奪う.
+    for( u32 i=1; i<m_WorkerCount; ++i )
+    {
+        auto& victim = m_pWorkers[ ( id + i ) % m_WorkerCount ];
+        std::lock_guard<std::mutex> locker( victim.mutex );
+        if ( victim.queue.empty() )
+        { continue; }
+
+        index = victim.queue.back();
+        victim.queue.pop_back();
+        return true;
+    }
+
+    return false;
+}
+
+} // namespace s3d
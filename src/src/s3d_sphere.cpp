@@ -76,11 +76,11 @@ bool Sphere::IsHit(const RaySet &raySet, HitRecord& record ) const
     const auto t1 = b - sqrt_D4;
     const auto t2 = b + sqrt_D4;
 
-    if (t1 < F_HIT_MIN && t2 < F_HIT_MIN)
+    if (t1 < raySet.tmin && t2 < raySet.tmin)
     { return false; }   // 交差しなかった.
 
-    auto dist = ( t1 > F_HIT_MIN ) ? t1 : t2;
-    if ( dist > record.distance )
+    auto dist = ( t1 > raySet.tmin ) ? t1 : t2;
+    if ( dist > record.distance || dist > raySet.tmax )
     { return false; }
 
     record.distance  = dist;
@@ -91,6 +91,30 @@ bool Sphere::IsHit(const RaySet &raySet, HitRecord& record ) const
     return true;
 }
 
+//-------------------------------------------------------------------------------------------------
+//      遮蔽判定を行います.
+//-------------------------------------------------------------------------------------------------
+bool Sphere::IsOccluded(const RaySet& raySet, f32 distance) const
+{
+    const auto po = m_Center - raySet.ray.pos;
+    const auto b  = Vector3::Dot(po, raySet.ray.dir);
+    const auto D4 = b * b - Vector3::Dot(po, po) + m_Radius * m_Radius;
+
+    if ( D4 < 0.0f )
+    { return false; }
+
+    const auto sqrt_D4 = sqrt(D4);
+    const auto t1 = b - sqrt_D4;
+    const auto t2 = b + sqrt_D4;
+
+    if (t1 < raySet.tmin && t2 < raySet.tmin)
+    { return false; }
+
+    // 光源自身までの距離を指定された場合に自分で遮蔽しないよう，指定距離ちょうどは含めない.
+    auto dist = ( t1 > raySet.tmin ) ? t1 : t2;
+    return ( dist < distance && dist <= raySet.tmax );
+}
+
 void Sphere::CalcParam(const Vector3& pos, const Vector2& barycentric, Vector3* pNormal, Vector2* pTexCoord) const
 {
     *pNormal = Vector3::UnitVector(pos - m_Center);
@@ -103,10 +127,10 @@ void Sphere::CalcParam(const Vector3& pos, const Vector2& barycentric, Vector3*
     *pTexCoord = Vector2( phi * F_1DIV2PI, ( F_PI - theta ) * F_1DIVPI );
 }
 
-void Sphere::Sample(PCG& random, Vector3* pPosition, float* pdf)
+void Sphere::Sample(const Vector2& sample, Vector3* pPosition, float* pdf)
 {
-    const auto r1 = F_2PI * random.GetAsF32();
-    const auto r2 = 1.0f - 2.0f * random.GetAsF32();
+    const auto r1 = F_2PI * sample.x;
+    const auto r2 = 1.0f - 2.0f * sample.y;
     const auto r3 = sqrt(1.0f - r2 * r2);
     const auto light_pos = m_Center + (m_Radius + 1e-1f) * Vector3::SafeUnitVector(Vector3(r3 * cos(r1), r3 * sin(r1), r2));
 
@@ -223,7 +223,8 @@ TestScene::TestScene( const u32 width, const u32 height )
 
     m_pCamera = camera;
     m_FrameCount = 0;
-    //m_pBVH = BVH4::Create( m_Shapes.size(), m_Shapes.data() );
+    if ( !BuildAccel() )
+    { ELOG("Error : BuildAccel() Failed."); }
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -233,7 +234,7 @@ TestScene::~TestScene()
 {
     m_IBL.Term();
 
-    //SafeRelease( m_pBVH );
+    SafeRelease( m_pBVH );
     SafeDelete( m_pCamera );
 
     m_pCan0 = nullptr;
@@ -280,6 +281,8 @@ void TestScene::Update(float deltaTime)
         m_pCup->UpdateMatrix(mat3);
     }
 
+    UpdateAccel();
+
     m_FrameCount++;
 }
 
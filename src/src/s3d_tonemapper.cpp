@@ -10,6 +10,11 @@
 #include <s3d_tonemapper.h>
 #include <s3d_math.h>
 #include <s3d_logger.h>
+#include <ppl.h>
+#include <cstring>
+#include <vector>
+
+using namespace concurrency;
 
 
 namespace /* anonymous */ {
@@ -23,6 +28,8 @@ const s3d::Vector3 RGB2Cr (  0.50000f, -0.41869f, -0.08131f );
 const s3d::Vector3 YCbCr2R(  1.00000f,  0.00000f,  1.40200f );
 const s3d::Vector3 YCbCr2G(  1.00000f, -0.34414f, -0.71414f );
 const s3d::Vector3 YCbCr2B(  1.00000f,  1.77200f,  0.00000f );
+const s32          ChunkSize     = 4096;    // 並列処理の単位とするピクセル数(8の倍数).
+const s32          SRGBTableSize = 4096;    // sRGB変換テーブルの区間数.
 
 
 //------------------------------------------------------------------------------------------------
@@ -191,6 +198,276 @@ void MedianFilter( const s32 width, const s32 height, const s3d::Color3* pPixels
     }
 }
 
+//------------------------------------------------------------------------------------------------
+//      8要素の総和を求めます.
+//------------------------------------------------------------------------------------------------
+S3D_INLINE
+f32 HorizontalSum( const b256& value )
+{
+    auto sum = _mm_add_ps( _mm256_castps256_ps128( value ), _mm256_extractf128_ps( value, 1 ) );
+    sum = _mm_add_ps( sum, _mm_movehl_ps( sum, sum ) );
+    sum = _mm_add_ss( sum, _mm_shuffle_ps( sum, sum, 0x1 ) );
+    return _mm_cvtss_f32( sum );
+}
+
+//------------------------------------------------------------------------------------------------
+//      8要素の最大値を求めます.
+//------------------------------------------------------------------------------------------------
+S3D_INLINE
+f32 HorizontalMax( const b256& value )
+{
+    auto maxi = _mm_max_ps( _mm256_castps256_ps128( value ), _mm256_extractf128_ps( value, 1 ) );
+    maxi = _mm_max_ps( maxi, _mm_movehl_ps( maxi, maxi ) );
+    maxi = _mm_max_ss( maxi, _mm_shuffle_ps( maxi, maxi, 0x1 ) );
+    return _mm_cvtss_f32( maxi );
+}
+
+//------------------------------------------------------------------------------------------------
+//      8要素の自然対数をまとめて求めます(正の正規化数のみ).
+//------------------------------------------------------------------------------------------------
+S3D_INLINE
+b256 Log8( const b256& value )
+{
+    const auto one = _mm256_set1_ps( 1.0f );
+
+    // value = m * 2^e (1 <= m < 2) に分解する.
+    // 指数部のビット列をそのまま整数変換すると (e + 127) * 2^23 になる.
+    auto bits = _mm256_and_ps( value, _mm256_castsi256_ps( _mm256_set1_epi32( 0x7f800000 ) ) );
+    auto e    = _mm256_cvtepi32_ps( _mm256_castps_si256( bits ) );
+    e = _mm256_sub_ps( _mm256_mul_ps( e, _mm256_set1_ps( 1.0f / 8388608.0f ) ), _mm256_set1_ps( 127.0f ) );
+
+    auto m = _mm256_or_ps( _mm256_and_ps( value, _mm256_castsi256_ps( _mm256_set1_epi32( 0x007fffff ) ) ), one );
+
+    // 級数の収束を速めるため m を [sqrt(1/2), sqrt(2)) に収める.
+    auto big = _mm256_cmp_ps( m, _mm256_set1_ps( 1.41421356f ), _CMP_GT_OQ );
+    m = _mm256_blendv_ps( m, _mm256_mul_ps( m, _mm256_set1_ps( 0.5f ) ), big );
+    e = _mm256_add_ps( e, _mm256_and_ps( big, one ) );
+
+    // log(m) = 2 * atanh(t), t = (m - 1) / (m + 1), |t| < 0.172.
+    auto t  = _mm256_div_ps( _mm256_sub_ps( m, one ), _mm256_add_ps( m, one ) );
+    auto t2 = _mm256_mul_ps( t, t );
+    auto p  = _mm256_set1_ps( 1.0f / 9.0f );
+    p = _mm256_add_ps( _mm256_mul_ps( p, t2 ), _mm256_set1_ps( 1.0f / 7.0f ) );
+    p = _mm256_add_ps( _mm256_mul_ps( p, t2 ), _mm256_set1_ps( 1.0f / 5.0f ) );
+    p = _mm256_add_ps( _mm256_mul_ps( p, t2 ), _mm256_set1_ps( 1.0f / 3.0f ) );
+    p = _mm256_add_ps( _mm256_mul_ps( p, t2 ), one );
+
+    auto logM = _mm256_mul_ps( _mm256_mul_ps( p, t ), _mm256_set1_ps( 2.0f ) );
+    return _mm256_add_ps( _mm256_mul_ps( e, _mm256_set1_ps( 0.69314718f ) ), logM );
+}
+
+//------------------------------------------------------------------------------------------------
+//      8ピクセルの輝度値をまとめて求めます.
+//------------------------------------------------------------------------------------------------
+S3D_INLINE
+b256 RGBToY8( const b256& r, const b256& g, const b256& b )
+{
+    auto y = _mm256_mul_ps( r, _mm256_set1_ps( RGB2Y.x ) );
+    y = _mm256_add_ps( y, _mm256_mul_ps( g, _mm256_set1_ps( RGB2Y.y ) ) );
+    y = _mm256_add_ps( y, _mm256_mul_ps( b, _mm256_set1_ps( RGB2Y.z ) ) );
+    return y;
+}
+
+//------------------------------------------------------------------------------------------------
+//      チャンネル毎に並べたピクセルから対数平均と最大輝度値を並列に求めます.
+//------------------------------------------------------------------------------------------------
+void ComputeLogarithmicAverage8
+(
+    const s32       count,
+    const f32*      pRed,
+    const f32*      pGreen,
+    const f32*      pBlue,
+    const f32       epsilon,
+    f32&            aveLw,
+    f32&            maxLw
+)
+{
+    const auto chunkCount = ( count + ChunkSize - 1 ) / ChunkSize;
+
+    // スレッド数によらず同じ結果になるよう，チャンク毎の結果を順番に足す.
+    std::vector<f64> sums( chunkCount );
+    std::vector<f32> maxs( chunkCount );
+
+    parallel_for<s32>(0, chunkCount, [&](s32 c)
+    {
+        const auto eps   = _mm256_set1_ps( epsilon );
+        const auto begin = c * ChunkSize;
+        const auto end   = s3d::Min( begin + ChunkSize, count );
+
+        auto sum  = _mm256_setzero_ps();
+        auto maxi = _mm256_setzero_ps();
+        auto i    = begin;
+        for( ; i + 8 <= end; i += 8 )
+        {
+            auto Lw = RGBToY8( _mm256_loadu_ps( pRed + i ), _mm256_loadu_ps( pGreen + i ), _mm256_loadu_ps( pBlue + i ) );
+
+            // NaNと小さすぎる値はepsilonに置き換える.
+            Lw = _mm256_blendv_ps( eps, Lw, _mm256_cmp_ps( Lw, _mm256_set1_ps( FLT_EPSILON ), _CMP_GE_OQ ) );
+
+            maxi = _mm256_max_ps( maxi, Lw );
+            sum  = _mm256_add_ps( sum, Log8( _mm256_add_ps( eps, Lw ) ) );
+        }
+
+        auto total  = static_cast<f64>( HorizontalSum( sum ) );
+        auto result = HorizontalMax( maxi );
+        for( ; i<end; ++i )
+        {
+            auto Lw = RGBToY( s3d::Vector3( pRed[i], pGreen[i], pBlue[i] ) );
+            if ( !( Lw >= FLT_EPSILON ) )
+            { Lw = epsilon; }
+
+            result = s3d::Max( result, Lw );
+            total += logf( epsilon + Lw );
+        }
+
+        sums[c] = total;
+        maxs[c] = result;
+    });
+
+    auto total = 0.0;
+    maxLw = 0.0f;
+    for( auto c=0; c<chunkCount; ++c )
+    {
+        total += sums[c];
+        maxLw  = s3d::Max( maxLw, maxs[c] );
+    }
+
+    if ( s3d::IsNan( total ) )
+    {
+        DLOG( "Nan!" );
+        total = epsilon;
+    }
+
+    aveLw = static_cast<f32>( exp( total / count ) );
+}
+
+//------------------------------------------------------------------------------------------------
+//      8要素まとめてReinhardのトーンマッピング式を適用します.
+//------------------------------------------------------------------------------------------------
+S3D_INLINE
+b256 Reinhard8( const b256& L, const b256& maxLw2 )
+{
+    const auto one = _mm256_set1_ps( 1.0f );
+    return _mm256_div_ps( _mm256_mul_ps( L, _mm256_add_ps( one, _mm256_div_ps( L, maxLw2 ) ) ), _mm256_add_ps( one, L ) );
+}
+
+//------------------------------------------------------------------------------------------------
+//      8要素まとめてUncharted2のトーンマッピング式を適用します.
+//------------------------------------------------------------------------------------------------
+S3D_INLINE
+b256 Uncharted2Tonemap8( const b256& color )
+{
+    const auto A = 0.15f;
+    const auto B = 0.50f;
+    const auto C = 0.10f;
+    const auto D = 0.20f;
+    const auto E = 0.01f;
+    const auto F = 0.30f;
+
+    auto n = _mm256_add_ps( _mm256_mul_ps( color, _mm256_add_ps( _mm256_mul_ps( _mm256_set1_ps( A ), color ), _mm256_set1_ps( C * B ) ) ), _mm256_set1_ps( D * E ) );
+    auto d = _mm256_add_ps( _mm256_mul_ps( color, _mm256_add_ps( _mm256_mul_ps( _mm256_set1_ps( A ), color ), _mm256_set1_ps( B ) ) ), _mm256_set1_ps( D * F ) );
+    return _mm256_sub_ps( _mm256_div_ps( n, d ), _mm256_set1_ps( E / F ) );
+}
+
+//------------------------------------------------------------------------------------------------
+//      8要素まとめてACES Filmを適用します.
+//------------------------------------------------------------------------------------------------
+S3D_INLINE
+b256 ACESFilm8( const b256& x )
+{
+    const auto a = _mm256_set1_ps( 2.51f );
+    const auto b = _mm256_set1_ps( 0.03f );
+    const auto c = _mm256_set1_ps( 2.43f );
+    const auto d = _mm256_set1_ps( 0.59f );
+    const auto e = _mm256_set1_ps( 0.14f );
+    const auto f = _mm256_set1_ps( 0.665406f );
+    const auto g = _mm256_set1_ps( 12.0f );
+
+    auto xf = _mm256_div_ps( _mm256_mul_ps( x, f ), g );
+    auto n  = _mm256_mul_ps( x, _mm256_add_ps( _mm256_div_ps( _mm256_mul_ps( _mm256_mul_ps( a, x ), f ), g ), b ) );
+    auto dn = _mm256_add_ps( _mm256_mul_ps( xf, _mm256_add_ps( _mm256_mul_ps( _mm256_mul_ps( c, x ), f ), d ) ), e );
+    return _mm256_div_ps( n, dn );
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// SRGBTable structure
+///////////////////////////////////////////////////////////////////////////////////////////////////
+struct SRGBTable
+{
+    f32     threshold[256];             //!< 各値に量子化される最小の入力値です.
+    u8      start[SRGBTableSize + 1];   //!< 入力を等分した区間の先頭での値です.
+};
+
+//------------------------------------------------------------------------------------------------
+//      [0, 1]の値をsRGBに変換して8bitに量子化します.
+//------------------------------------------------------------------------------------------------
+u8 QuantizeSRGB( f32 value )
+{
+    value = (value <= 0.0031308f) ? 12.92f * value : std::pow(1.055f * value, 1.0f / 2.4f) - 0.055f;
+    return static_cast<u8>( value * 255.0f + 0.5f );
+}
+
+//------------------------------------------------------------------------------------------------
+//      sRGB変換テーブルを生成します.
+//------------------------------------------------------------------------------------------------
+SRGBTable CreateSRGBTable()
+{
+    SRGBTable table;
+
+    // 変換式は単調増加なので，正の浮動小数のビット列で二分探索して境界を求める.
+    const u32 OneBits = 0x3f800000;
+    table.threshold[0] = 0.0f;
+    for( auto k=1; k<256; ++k )
+    {
+        u32 lo = 0;
+        u32 hi = OneBits;
+        while( lo < hi )
+        {
+            auto mid = lo + ( hi - lo ) / 2;
+            f32 value;
+            memcpy( &value, &mid, sizeof(value) );
+            if ( QuantizeSRGB( value ) >= k )
+            { hi = mid; }
+            else
+            { lo = mid + 1; }
+        }
+
+        memcpy( &table.threshold[k], &lo, sizeof(f32) );
+
+        // 1でも届かない値には量子化されない.
+        if ( QuantizeSRGB( table.threshold[k] ) < k )
+        { table.threshold[k] = s3d::F_MAX; }
+    }
+
+    for( auto j=0; j<=SRGBTableSize; ++j )
+    { table.start[j] = QuantizeSRGB( static_cast<f32>( j ) / SRGBTableSize ); }
+
+    return table;
+}
+
+//------------------------------------------------------------------------------------------------
+//      sRGB変換テーブルを取得します.
+//------------------------------------------------------------------------------------------------
+const SRGBTable& GetSRGBTable()
+{
+    static const SRGBTable table = CreateSRGBTable();
+    return table;
+}
+
+//------------------------------------------------------------------------------------------------
+//      テーブルを引いて[0, 1]の値をsRGBに変換して8bitに量子化します.
+//------------------------------------------------------------------------------------------------
+S3D_INLINE
+u8 ToSRGB8( const SRGBTable& table, f32 value )
+{
+    // 区間の先頭の値から境界を越えた分だけ進める. 1区間で進むのは高々数段.
+    u32 k = table.start[ static_cast<s32>( value * SRGBTableSize ) ];
+    while( k < 255 && value >= table.threshold[k + 1] )
+    { k++; }
+
+    return static_cast<u8>( k );
+}
+
 } // namespace /* anonymous */
 
 
@@ -352,4 +629,92 @@ void ToneMapper::ACESFilmicToneMapping
     }
 }
 
+//------------------------------------------------------------------------------------------------
+//      トーンマッピングからsRGB変換，8bit量子化までをまとめて行います.
+//------------------------------------------------------------------------------------------------
+void ToneMapper::MapToRGB8
+(
+    TONE_MAPPING_TYPE   type,
+    const s32           width,
+    const s32           height,
+    const f32*          pRed,
+    const f32*          pGreen,
+    const f32*          pBlue,
+    u8*                 pResult
+)
+{
+    assert( pRed != nullptr && pGreen != nullptr && pBlue != nullptr );
+    assert( pResult != nullptr );
+
+    const auto count = width * height;
+    const auto a     = ( type == TONE_MAPPING_ACES_FILMIC ) ? 0.27f : 0.18f;
+    auto aveLw = 0.0f;
+    auto maxLw = 0.0f;
+
+    // 対数平均と最大輝度値を求める.
+    ComputeLogarithmicAverage8( count, pRed, pGreen, pBlue, 0.00001f, aveLw, maxLw );
+
+    const auto coeff  = a / aveLw;
+    const auto maxLw2 = ( maxLw * coeff ) * ( maxLw * coeff );
+    const auto white  = Uncharted2Tonemap( 11.2f );     // "Uncharted 2 : HDR Lighting" に記載の値を使用.
+    const auto& table = GetSRGBTable();
+
+    const auto chunkCount = ( count + ChunkSize - 1 ) / ChunkSize;
+    parallel_for<s32>(0, chunkCount, [&](s32 c)
+    {
+        const f32* pInputs[3] = { pRed, pGreen, pBlue };
+        const auto begin      = c * ChunkSize;
+        const auto end        = s3d::Min( begin + ChunkSize, count );
+
+        S3D_ALIGN(32) f32 values[3][8];
+        for( auto i=begin; i<end; i+=8 )
+        {
+            // 端数は0で埋めて8ピクセル単位で処理する.
+            auto n = s3d::Min( 8, end - i );
+            for( auto ch=0; ch<3; ++ch )
+            {
+                b256 color;
+                if ( n == 8 )
+                { color = _mm256_loadu_ps( pInputs[ch] + i ); }
+                else
+                {
+                    S3D_ALIGN(32) f32 temp[8] = {};
+                    memcpy( temp, pInputs[ch] + i, sizeof(f32) * n );
+                    color = _mm256_load_ps( temp );
+                }
+
+                color = _mm256_mul_ps( color, _mm256_set1_ps( coeff ) );
+
+                switch( type )
+                {
+                    case TONE_MAPPING_REINHARD:
+                    default:
+                        color = Reinhard8( color, _mm256_set1_ps( maxLw2 ) );
+                        break;
+
+                    case TONE_MAPPING_UNCHARTED2_FILMIC:
+                        color = _mm256_div_ps( Uncharted2Tonemap8( _mm256_mul_ps( _mm256_set1_ps( 2.0f ), color ) ), _mm256_set1_ps( white ) );
+                        break;
+
+                    case TONE_MAPPING_ACES_FILMIC:
+                        color = ACESFilm8( color );
+                        break;
+                }
+
+                // [0, 1]に収める. NaNは0にする.
+                color = _mm256_min_ps( _mm256_max_ps( color, _mm256_setzero_ps() ), _mm256_set1_ps( 1.0f ) );
+                _mm256_store_ps( values[ch], color );
+            }
+
+            auto pDst = pResult + i * 3;
+            for( auto k=0; k<n; ++k )
+            {
+                pDst[k * 3 + 0] = ToSRGB8( table, values[0][k] );
+                pDst[k * 3 + 1] = ToSRGB8( table, values[1][k] );
+                pDst[k * 3 + 2] = ToSRGB8( table, values[2][k] );
+            }
+        }
+    });
+}
+
 } // namespace s3d
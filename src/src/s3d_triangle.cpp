@@ -72,38 +72,29 @@ u32 Triangle::GetCount() const
 //-------------------------------------------------------------------------------------------------
 bool Triangle::IsHit(const RaySet& raySet, HitRecord& record) const
 {
-    auto s1  = Vector3::Cross( raySet.ray.dir, m_Edge[1] );
-    auto div = Vector3::Dot( s1, m_Edge[0] );
-
-    if ( abs(div) <= FLT_EPSILON )
-    { return false; }
-
-    auto d = raySet.ray.pos - m_Vertex[0].Position;
-    auto beta = Vector3::Dot( d, s1 ) / div;
-    if ( beta <= 0.0 || beta >= 1.0 )
-    { return false; }
-
-    auto s2 = Vector3::Cross( d, m_Edge[0] );
-    auto gamma = Vector3::Dot( raySet.ray.dir, s2 ) / div;
-    if ( gamma <= 0.0 || ( beta + gamma ) >= 1.0 )
-    { return false; }
-
-    auto dist = Vector3::Dot( m_Edge[1], s2 ) / div;
-    if ( dist < F_HIT_MIN || dist > F_HIT_MAX )
-    { return false; }
-
-    if ( dist >= record.distance )
+    f32     dist;
+    Vector2 barycentric;
+    if ( !Intersect( m_Vertex[0].Position, m_Edge[0], m_Edge[1], raySet, record.distance, dist, barycentric ) )
     { return false; }
 
     record.distance         = dist;
     record.pShape           = this;
     record.pMaterial        = m_pMaterial;
-    record.barycentric.x    = beta;
-    record.barycentric.y    = gamma;
+    record.barycentric      = barycentric;
 
     return true;
 }
 
+//-------------------------------------------------------------------------------------------------
+//      遮蔽判定を行います.
+//-------------------------------------------------------------------------------------------------
+bool Triangle::IsOccluded(const RaySet& raySet, f32 distance) const
+{
+    f32     dist;
+    Vector2 barycentric;
+    return Intersect( m_Vertex[0].Position, m_Edge[0], m_Edge[1], raySet, distance, dist, barycentric );
+}
+
 void Triangle::CalcParam(const Vector3& position, const Vector2& barycentric, Vector3* pOutNormal, Vector2* pOutTexCoord) const
 {
     auto beta  = barycentric.x;
@@ -132,10 +123,286 @@ BoundingBox Triangle::GetBox() const
 Vector3 Triangle::GetCenter() const
 { return m_BoundingBox.center; }
 
+//-------------------------------------------------------------------------------------------------
+//      三角形の一部を包むバウンディングボックスを分割平面で左右に切り分けます.
+//-------------------------------------------------------------------------------------------------
+void Triangle::SplitBox(s32 axis, f32 position, const BoundingBox& box, BoundingBox* pLeft, BoundingBox* pRight) const
+{
+    Vector3 positions[3];
+    for(auto i=0; i<3; ++i)
+    { positions[i] = m_Vertex[i].Position; }
+
+    ClipBox( positions, axis, position, box, pLeft, pRight );
+}
+
+//-------------------------------------------------------------------------------------------------
+//      始点と2辺，マテリアルを取得します.
+//-------------------------------------------------------------------------------------------------
+bool Triangle::GetTriangle(Vector3* pTriangle, const IMaterial** ppMaterial) const
+{
+    pTriangle[0] = m_Vertex[0].Position;
+    pTriangle[1] = m_Edge[0];
+    pTriangle[2] = m_Edge[1];
+
+    *ppMaterial = m_pMaterial;
+    return true;
+}
+
 //-------------------------------------------------------------------------------------------------
 //      生成処理を行います.
 //-------------------------------------------------------------------------------------------------
 IShape* Triangle::Create(Vertex* pVertices, IMaterial* pMaterial)
 {  return new(std::nothrow) Triangle(pVertices, pMaterial); }
 
+//-------------------------------------------------------------------------------------------------
+//      頂点と辺を指定して交差判定を行います.
+//-------------------------------------------------------------------------------------------------
+bool Triangle::Intersect
+(
+    const Vector3&  v0,
+    const Vector3&  e1,
+    const Vector3&  e2,
+    const RaySet&   raySet,
+    f32             maxDistance,
+    f32&            distance,
+    Vector2&        barycentric
+)
+{
+    auto s1  = Vector3::Cross( raySet.ray.dir, e2 );
+    auto div = Vector3::Dot( s1, e1 );
+
+    if ( abs(div) <= FLT_EPSILON )
+    { return false; }
+
+    auto d = raySet.ray.pos - v0;
+    auto beta = Vector3::Dot( d, s1 ) / div;
+    if ( beta <= 0.0 || beta >= 1.0 )
+    { return false; }
+
+    auto s2 = Vector3::Cross( d, e1 );
+    auto gamma = Vector3::Dot( raySet.ray.dir, s2 ) / div;
+    if ( gamma <= 0.0 || ( beta + gamma ) >= 1.0 )
+    { return false; }
+
+    auto dist = Vector3::Dot( e2, s2 ) / div;
+    if ( dist < raySet.tmin || dist > raySet.tmax )
+    { return false; }
+
+    if ( dist >= maxDistance )
+    { return false; }
+
+    distance      = dist;
+    barycentric.x = beta;
+    barycentric.y = gamma;
+
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      三角形の一部を包むバウンディングボックスを分割平面で左右に切り分けます.
+//-------------------------------------------------------------------------------------------------
+void Triangle::ClipBox
+(
+    const Vector3*      pPositions,
+    s32                 axis,
+    f32                 position,
+    const BoundingBox&  box,
+    BoundingBox*        pLeft,
+    BoundingBox*        pRight
+)
+{
+    BoundingBox left;
+    BoundingBox right;
+
+    // 各辺を分割平面でクリップして，左右それぞれに含まれる頂点と交点をマージする.
+    for(auto i=0; i<3; ++i)
+    {
+        const auto& v0 = pPositions[i];
+        const auto& v1 = pPositions[(i + 1) % 3];
+        auto p0 = v0.a[axis];
+        auto p1 = v1.a[axis];
+
+        if ( p0 <= position )
+        { left = BoundingBox::Merge( left, v0 ); }
+
+        if ( p0 >= position )
+        { right = BoundingBox::Merge( right, v0 ); }
+
+        if ( ( p0 < position && position < p1 ) || ( p1 < position && position < p0 ) )
+        {
+            auto t = ( position - p0 ) / ( p1 - p0 );
+            auto p = v0 + ( v1 - v0 ) * t;
+            p.a[axis] = position;
+
+            left  = BoundingBox::Merge( left,  p );
+            right = BoundingBox::Merge( right, p );
+        }
+    }
+
+    // 既に切り分けられた範囲を超えないように共通部分を取る.
+    *pLeft  = BoundingBox::Intersect( box, left );
+    *pRight = BoundingBox::Intersect( box, right );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Triangle8 structure
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------------------------------
+//      三角形を8つ分のSoA形式に詰めます.
+//-------------------------------------------------------------------------------------------------
+bool Triangle8::Pack(u32 count, IShape* const* ppShapes, Triangle8& result)
+{
+    S3D_ALIGN(32) f32 v0[3][8] = {};
+    S3D_ALIGN(32) f32 e1[3][8] = {};
+    S3D_ALIGN(32) f32 e2[3][8] = {};
+
+    for(u32 i=0; i<8; ++i)
+    {
+        result.pShapes   [i] = nullptr;
+        result.pMaterials[i] = nullptr;
+
+        if ( i >= count )
+        { continue; }
+
+        // 単体の判定で用いる辺をそのまま詰めて判定結果を一致させる.
+        Vector3 triangle[3];
+        const IMaterial* pMaterial = nullptr;
+        if ( !ppShapes[i]->GetTriangle( triangle, &pMaterial ) )
+        { return false; }
+
+        for(auto j=0; j<3; ++j)
+        {
+            v0[j][i] = triangle[0].a[j];
+            e1[j][i] = triangle[1].a[j];
+            e2[j][i] = triangle[2].a[j];
+        }
+
+        result.pShapes   [i] = ppShapes[i];
+        result.pMaterials[i] = pMaterial;
+    }
+
+    for(auto j=0; j<3; ++j)
+    {
+        result.v0[j] = _mm256_load_ps( v0[j] );
+        result.e1[j] = _mm256_load_ps( e1[j] );
+        result.e2[j] = _mm256_load_ps( e2[j] );
+    }
+
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      8つの三角形と交差判定を行い，交差したレーンのビットマスクを求めます.
+//-------------------------------------------------------------------------------------------------
+s32 Triangle8::Intersect(const RaySet& raySet, f32 distance, b256& dist, b256& beta, b256& gamma) const
+{
+    const auto& ray = raySet.ray;
+
+    auto dx = _mm256_set1_ps( ray.dir.x );
+    auto dy = _mm256_set1_ps( ray.dir.y );
+    auto dz = _mm256_set1_ps( ray.dir.z );
+
+    // s1 = dir x e2
+    auto s1x = _mm256_sub_ps( _mm256_mul_ps( dy, e2[2] ), _mm256_mul_ps( dz, e2[1] ) );
+    auto s1y = _mm256_sub_ps( _mm256_mul_ps( dz, e2[0] ), _mm256_mul_ps( dx, e2[2] ) );
+    auto s1z = _mm256_sub_ps( _mm256_mul_ps( dx, e2[1] ), _mm256_mul_ps( dy, e2[0] ) );
+
+    auto div = _mm256_add_ps( _mm256_add_ps(
+        _mm256_mul_ps( s1x, e1[0] ),
+        _mm256_mul_ps( s1y, e1[1] ) ),
+        _mm256_mul_ps( s1z, e1[2] ) );
+
+    auto absDiv = _mm256_andnot_ps( _mm256_set1_ps( -0.0f ), div );
+    auto mask   = _mm256_cmp_ps( absDiv, _mm256_set1_ps( FLT_EPSILON ), _CMP_GT_OQ );
+
+    // d = pos - v0
+    auto ddx = _mm256_sub_ps( _mm256_set1_ps( ray.pos.x ), v0[0] );
+    auto ddy = _mm256_sub_ps( _mm256_set1_ps( ray.pos.y ), v0[1] );
+    auto ddz = _mm256_sub_ps( _mm256_set1_ps( ray.pos.z ), v0[2] );
+
+    auto zero = _mm256_setzero_ps();
+    auto one  = _mm256_set1_ps( 1.0f );
+
+    beta = _mm256_div_ps( _mm256_add_ps( _mm256_add_ps(
+        _mm256_mul_ps( ddx, s1x ),
+        _mm256_mul_ps( ddy, s1y ) ),
+        _mm256_mul_ps( ddz, s1z ) ), div );
+    mask = _mm256_and_ps( mask, _mm256_cmp_ps( beta, zero, _CMP_GT_OQ ) );
+    mask = _mm256_and_ps( mask, _mm256_cmp_ps( beta, one,  _CMP_LT_OQ ) );
+
+    // s2 = d x e1
+    auto s2x = _mm256_sub_ps( _mm256_mul_ps( ddy, e1[2] ), _mm256_mul_ps( ddz, e1[1] ) );
+    auto s2y = _mm256_sub_ps( _mm256_mul_ps( ddz, e1[0] ), _mm256_mul_ps( ddx, e1[2] ) );
+    auto s2z = _mm256_sub_ps( _mm256_mul_ps( ddx, e1[1] ), _mm256_mul_ps( ddy, e1[0] ) );
+
+    gamma = _mm256_div_ps( _mm256_add_ps( _mm256_add_ps(
+        _mm256_mul_ps( dx, s2x ),
+        _mm256_mul_ps( dy, s2y ) ),
+        _mm256_mul_ps( dz, s2z ) ), div );
+    mask = _mm256_and_ps( mask, _mm256_cmp_ps( gamma, zero, _CMP_GT_OQ ) );
+    mask = _mm256_and_ps( mask, _mm256_cmp_ps( _mm256_add_ps( beta, gamma ), one, _CMP_LT_OQ ) );
+
+    dist = _mm256_div_ps( _mm256_add_ps( _mm256_add_ps(
+        _mm256_mul_ps( e2[0], s2x ),
+        _mm256_mul_ps( e2[1], s2y ) ),
+        _mm256_mul_ps( e2[2], s2z ) ), div );
+    mask = _mm256_and_ps( mask, _mm256_cmp_ps( dist, _mm256_set1_ps( raySet.tmin ),    _CMP_GE_OQ ) );
+    mask = _mm256_and_ps( mask, _mm256_cmp_ps( dist, _mm256_set1_ps( raySet.tmax ),    _CMP_LE_OQ ) );
+    mask = _mm256_and_ps( mask, _mm256_cmp_ps( dist, _mm256_set1_ps( distance ),        _CMP_LT_OQ ) );
+
+    return _mm256_movemask_ps( mask );
+}
+
+//-------------------------------------------------------------------------------------------------
+//      8つの三角形との交差判定をまとめて行います.
+//-------------------------------------------------------------------------------------------------
+bool Triangle8::IsHit(const RaySet& raySet, HitRecord& record) const
+{
+    b256 dist;
+    b256 beta;
+    b256 gamma;
+    auto bits = Intersect( raySet, record.distance, dist, beta, gamma );
+    if ( bits == 0 )
+    { return false; }
+
+    S3D_ALIGN(32) f32 distances[8];
+    S3D_ALIGN(32) f32 betas    [8];
+    S3D_ALIGN(32) f32 gammas   [8];
+    _mm256_store_ps( distances, dist );
+    _mm256_store_ps( betas,     beta );
+    _mm256_store_ps( gammas,    gamma );
+
+    // 同じ距離の場合は順に判定した時と同じく先頭側を採用する.
+    auto index = -1;
+    for(auto i=0; i<8; ++i)
+    {
+        if ( ( bits & ( 0x1 << i ) ) == 0 )
+        { continue; }
+
+        if ( index < 0 || distances[i] < distances[index] )
+        { index = i; }
+    }
+
+    record.distance         = distances[index];
+    record.pShape           = pShapes[index];
+    record.pMaterial        = pMaterials[index];
+    record.barycentric.x    = betas[index];
+    record.barycentric.y    = gammas[index];
+
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+//      8つの三角形のいずれかが指定距離より手前にあるかを判定します.
+//-------------------------------------------------------------------------------------------------
+bool Triangle8::IsOccluded(const RaySet& raySet, f32 distance) const
+{
+    b256 dist;
+    b256 beta;
+    b256 gamma;
+    return ( Intersect( raySet, distance, dist, beta, gamma ) != 0 );
+}
+
 } // namespace s3d